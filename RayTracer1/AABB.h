@@ -0,0 +1,118 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <algorithm>
+#include "Vector3.h"
+#include "Ray.h"
+
+// Axis aligned bounding box. A default constructed box is empty, so
+// extending it by anything yields exactly that thing's bounds.
+struct AABB
+{
+	Point min;
+	Point max;
+
+	AABB()
+		: min(RAY_T_MAX),
+		max(-RAY_T_MAX)
+	{
+	}
+
+	AABB(const Point& min, const Point& max)
+		: min(min),
+		max(max)
+	{
+	}
+
+	// Bounds of primitives that extend to infinity, such as planes
+	static AABB infinite()
+	{
+		return AABB(Point(-RAY_T_MAX), Point(RAY_T_MAX));
+	}
+
+	bool isEmpty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	bool isFinite() const
+	{
+		return !isEmpty() &&
+			min.x > -RAY_T_MAX && min.y > -RAY_T_MAX && min.z > -RAY_T_MAX &&
+			max.x < RAY_T_MAX && max.y < RAY_T_MAX && max.z < RAY_T_MAX;
+	}
+
+	void extend(const Point& p)
+	{
+		min = Point(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+		max = Point(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+	}
+
+	void extend(const AABB& box)
+	{
+		min = Point(std::min(min.x, box.min.x), std::min(min.y, box.min.y), std::min(min.z, box.min.z));
+		max = Point(std::max(max.x, box.max.x), std::max(max.y, box.max.y), std::max(max.z, box.max.z));
+	}
+
+	AABB padded(float margin) const
+	{
+		return AABB(min - Vector(margin), max + Vector(margin));
+	}
+
+	Point centroid() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	float surfaceArea() const
+	{
+		if (isEmpty())
+			return 0.0f;
+
+		Vector d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// Index of the longest axis, 0 = x, 1 = y, 2 = z
+	int longestAxis() const
+	{
+		Vector d = max - min;
+		if (d.x > d.y && d.x > d.z)
+			return 0;
+		return d.y > d.z ? 1 : 2;
+	}
+
+	// Slab test against a ray whose reciprocal direction is precomputed,
+	// tNear receives the distance at which the ray enters the box
+	bool intersect(const Ray& ray, const Vector& invDirection, float tMax, float& tNear) const
+	{
+		float tx1 = (min.x - ray.origin.x) * invDirection.x;
+		float tx2 = (max.x - ray.origin.x) * invDirection.x;
+		float ty1 = (min.y - ray.origin.y) * invDirection.y;
+		float ty2 = (max.y - ray.origin.y) * invDirection.y;
+		float tz1 = (min.z - ray.origin.z) * invDirection.z;
+		float tz2 = (max.z - ray.origin.z) * invDirection.z;
+
+		float tEnter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+		float tExit = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), tMax));
+
+		tNear = tEnter;
+		return tEnter <= tExit;
+	}
+};
+
+// Reciprocal of a ray direction for AABB::intersect. Zero components map
+// to a huge finite value, so rays lying in a slab plane never produce NaNs.
+inline Vector safeInverse(const Vector& direction)
+{
+	return Vector(direction.x != 0.0f ? 1.0f / direction.x : RAY_T_MAX,
+		direction.y != 0.0f ? 1.0f / direction.y : RAY_T_MAX,
+		direction.z != 0.0f ? 1.0f / direction.z : RAY_T_MAX);
+}
+
+inline float component(const Vector& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+#endif // AABB_H
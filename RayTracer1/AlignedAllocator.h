@@ -0,0 +1,68 @@
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Allocator for std::vector whose storage starts on an Alignment byte
+// boundary, e.g. cache lines for nodes read by SIMD kernels. C++14's
+// operator new ignores alignas beyond that of std::max_align_t.
+template <typename T, size_t Alignment>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() { }
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) { }
+
+	T* allocate(size_t count)
+	{
+		void* memory;
+#ifdef _MSC_VER
+		memory = _aligned_malloc(count * sizeof(T), Alignment);
+#else
+		if (posix_memalign(&memory, Alignment, count * sizeof(T)) != 0)
+			memory = NULL;
+#endif
+		if (!memory)
+			throw std::bad_alloc();
+		return (T*)memory;
+	}
+
+	void deallocate(T* memory, size_t)
+	{
+#ifdef _MSC_VER
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
+
+	template <typename U>
+	bool operator ==(const AlignedAllocator<U, Alignment>&) const
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator !=(const AlignedAllocator<U, Alignment>&) const
+	{
+		return false;
+	}
+};
+
+#endif // ALIGNEDALLOCATOR_H
@@ -0,0 +1,825 @@
+#include "BVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+	std::atomic<int> selectedWidth(2);
+
+	std::atomic<bool> selectedCompression(false);
+
+	// Ranges shorter than this are binned and partitioned on one thread
+	const int parallelGrain = 16384;
+
+	// Subtrees are handed to the workers once they are this small, or
+	// smaller if that leaves too few of them to keep every worker busy
+	const int maxSubtreeSize = 1 << 16;
+
+	const int subtreesPerWorker = 16;
+
+	struct BuildInput
+	{
+		const AABB* bounds;
+		const Point* centroids;
+		int* indices;
+
+		// As long as indices; whoever partitions a range of indices owns
+		// the same range of it
+		int* scratch;
+	};
+
+	// Primitive counts and bounds of the SAH bins of all three axes
+	struct Bins
+	{
+		AABB bounds[3][BVH_BIN_COUNT];
+		int counts[3][BVH_BIN_COUNT];
+
+		Bins()
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (int bin = 0; bin < BVH_BIN_COUNT; bin++)
+					counts[axis][bin] = 0;
+			}
+		}
+
+		void merge(const Bins& other)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (int bin = 0; bin < BVH_BIN_COUNT; bin++)
+				{
+					counts[axis][bin] += other.counts[axis][bin];
+					bounds[axis][bin].extend(other.bounds[axis][bin]);
+				}
+			}
+		}
+	};
+
+	// How a node is divided. A negative axis splits the range in half.
+	struct SplitChoice
+	{
+		bool isLeaf;
+		int axis;
+		int bin;
+	};
+
+	inline float binScale(const AABB& centroidBounds, int axis)
+	{
+		return BVH_BIN_COUNT / (component(centroidBounds.max, axis) - component(centroidBounds.min, axis));
+	}
+
+	inline int binIndex(const Point& centroid, int axis, const AABB& centroidBounds, float scale)
+	{
+		return std::min((int)((component(centroid, axis) - component(centroidBounds.min, axis)) * scale),
+			BVH_BIN_COUNT - 1);
+	}
+
+	void binRange(const BuildInput& input, int begin, int end, const AABB& centroidBounds, Bins& bins)
+	{
+		// Flat axes are never split along and not binned
+		int axes[3];
+		float scales[3];
+		int axisCount = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (component(centroidBounds.max, axis) > component(centroidBounds.min, axis))
+			{
+				axes[axisCount] = axis;
+				scales[axisCount] = binScale(centroidBounds, axis);
+				axisCount++;
+			}
+		}
+
+		for (int i = begin; i < end; i++)
+		{
+			int index = input.indices[i];
+			const Point& centroid = input.centroids[index];
+			const AABB& bounds = input.bounds[index];
+			for (int j = 0; j < axisCount; j++)
+			{
+				int bin = binIndex(centroid, axes[j], centroidBounds, scales[j]);
+				bins.counts[axes[j]][bin]++;
+				bins.bounds[axes[j]][bin].extend(bounds);
+			}
+		}
+	}
+
+	// Cheapest bin boundary over all three axes, judged by the surface
+	// area heuristic against keeping all count primitives in one leaf
+	SplitChoice findSplit(const Bins& bins, const AABB& centroidBounds, float area, int count)
+	{
+		float bestCost = RAY_T_MAX;
+		int bestAxis = -1;
+		int bestBin = 0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (component(centroidBounds.max, axis) <= component(centroidBounds.min, axis))
+				continue;
+
+			// Sweep from the right to get the area and count of every suffix
+			float rightArea[BVH_BIN_COUNT];
+			int rightCount[BVH_BIN_COUNT];
+			AABB right;
+			int rightSum = 0;
+			for (int bin = BVH_BIN_COUNT - 1; bin > 0; bin--)
+			{
+				right.extend(bins.bounds[axis][bin]);
+				rightSum += bins.counts[axis][bin];
+				rightArea[bin] = right.surfaceArea();
+				rightCount[bin] = rightSum;
+			}
+
+			AABB left;
+			int leftSum = 0;
+			for (int bin = 0; bin < BVH_BIN_COUNT - 1; bin++)
+			{
+				left.extend(bins.bounds[axis][bin]);
+				leftSum += bins.counts[axis][bin];
+				if (leftSum == 0 || rightCount[bin + 1] == 0)
+					continue;
+
+				float cost = left.surfaceArea() * leftSum + rightArea[bin + 1] * rightCount[bin + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+
+		// Relative to the cost of testing every primitive in a single leaf
+		float leafCost = (float)count;
+		float splitCost = 1.0f + (area > 0.0f ? bestCost / area : RAY_T_MAX);
+
+		SplitChoice choice = { false, bestAxis, bestBin };
+		if (bestAxis >= 0 && (splitCost < leafCost || count > BVH_MAX_LEAF_SIZE))
+			return choice;
+
+		// Otherwise all centroids coincide and a large node is halved
+		choice.isLeaf = count <= BVH_MAX_LEAF_SIZE;
+		choice.axis = -1;
+		return choice;
+	}
+
+	inline bool goesLeft(const BuildInput& input, int index, const SplitChoice& choice,
+		const AABB& centroidBounds, float scale)
+	{
+		return binIndex(input.centroids[index], choice.axis, centroidBounds, scale) <= choice.bin;
+	}
+
+	// Stable partition of [begin, end) through the scratch space, so the
+	// order of the primitives never depends on how the work was divided
+	int partitionRange(const BuildInput& input, int begin, int end, const SplitChoice& choice,
+		const AABB& centroidBounds)
+	{
+		if (choice.axis < 0)
+			return begin + (end - begin) / 2;
+
+		float scale = binScale(centroidBounds, choice.axis);
+		int left = begin;
+		int right = begin;
+		for (int i = begin; i < end; i++)
+		{
+			int index = input.indices[i];
+			if (goesLeft(input, index, choice, centroidBounds, scale))
+				input.indices[left++] = index;
+			else
+				input.scratch[right++] = index;
+		}
+		std::copy(input.scratch + begin, input.scratch + right, input.indices + left);
+		return left;
+	}
+
+	// Builds the subtree over [begin, end) into nodes on the calling thread.
+	// Inner nodes store the index of their second child within nodes.
+	void buildSubtree(const BuildInput& input, std::vector<BVHNode>& nodes, int nodeIndex,
+		int begin, int end)
+	{
+		AABB bounds;
+		AABB centroidBounds;
+		for (int i = begin; i < end; i++)
+		{
+			bounds.extend(input.bounds[input.indices[i]]);
+			centroidBounds.extend(input.centroids[input.indices[i]]);
+		}
+
+		// Padding keeps rays that graze a face, or run inside its plane, from
+		// slipping past primitives that touch the box
+		nodes[nodeIndex].bounds = bounds.padded(RAY_T_MIN);
+		nodes[nodeIndex].offset = begin;
+		nodes[nodeIndex].count = end - begin;
+		if (end - begin <= 1)
+			return;
+
+		Bins bins;
+		binRange(input, begin, end, centroidBounds, bins);
+		SplitChoice choice = findSplit(bins, centroidBounds, nodes[nodeIndex].bounds.surfaceArea(), end - begin);
+		if (choice.isLeaf)
+			return;
+
+		int middle = partitionRange(input, begin, end, choice, centroidBounds);
+		if (middle == begin || middle == end)
+			return;
+
+		// Children are appended, the first one directly after its parent
+		int first = (int)nodes.size();
+		nodes.push_back(BVHNode());
+		buildSubtree(input, nodes, first, begin, middle);
+
+		int second = (int)nodes.size();
+		nodes.push_back(BVHNode());
+		buildSubtree(input, nodes, second, middle, end);
+
+		nodes[nodeIndex].offset = second;
+		nodes[nodeIndex].count = 0;
+	}
+
+	// Builds the top of the hierarchy on the calling thread, binning and
+	// partitioning each node's range on all workers, down to subtrees that
+	// the workers then build on their own into per-worker node arenas. The
+	// pieces are finally laid out exactly as buildSubtree would have.
+	class ParallelBuild
+	{
+	protected:
+
+		struct TopNode
+		{
+			BVHNode node;
+
+			// Children within top, -1 for leaves
+			int first;
+			int second;
+
+			// Subtree standing in for this node, -1 if none
+			int subtree;
+
+			int position;
+		};
+
+		struct Subtree
+		{
+			int begin;
+			int end;
+
+			// Where its nodes are in the arena of the worker that built it
+			unsigned worker;
+			int start;
+			int size;
+
+			// Where its root goes in the final array
+			int position;
+		};
+
+		ThreadPool& pool;
+
+		const BuildInput& input;
+
+		int subtreeSize;
+
+		std::vector<TopNode> top;
+
+		std::vector<Subtree> subtrees;
+
+		std::vector<std::vector<BVHNode>> arenas;
+
+		int buildTop(int begin, int end)
+		{
+			int index = (int)top.size();
+			TopNode node;
+			node.first = -1;
+			node.second = -1;
+			node.subtree = -1;
+			node.position = 0;
+			node.node.offset = begin;
+			node.node.count = end - begin;
+			top.push_back(node);
+
+			int count = end - begin;
+			if (count <= subtreeSize)
+			{
+				Subtree subtree = { begin, end, 0, 0, 0, 0 };
+				top[index].subtree = (int)subtrees.size();
+				subtrees.push_back(subtree);
+				return index;
+			}
+
+			// Node and centroid bounds, then the bins, each reduced over ranges
+			int ranges = pool.rangeCount(count, parallelGrain);
+			std::vector<AABB> rangeBounds(ranges);
+			std::vector<AABB> rangeCentroids(ranges);
+			pool.parallelRanges(count, parallelGrain, [&](int range, int first, int last, unsigned worker)
+			{
+				for (int i = begin + first; i < begin + last; i++)
+				{
+					rangeBounds[range].extend(input.bounds[input.indices[i]]);
+					rangeCentroids[range].extend(input.centroids[input.indices[i]]);
+				}
+			});
+
+			AABB bounds;
+			AABB centroidBounds;
+			for (int i = 0; i < ranges; i++)
+			{
+				bounds.extend(rangeBounds[i]);
+				centroidBounds.extend(rangeCentroids[i]);
+			}
+			top[index].node.bounds = bounds.padded(RAY_T_MIN);
+
+			std::vector<Bins> rangeBins(ranges);
+			pool.parallelRanges(count, parallelGrain, [&](int range, int first, int last, unsigned worker)
+			{
+				binRange(input, begin + first, begin + last, centroidBounds, rangeBins[range]);
+			});
+			for (int i = 1; i < ranges; i++)
+				rangeBins[0].merge(rangeBins[i]);
+
+			SplitChoice choice = findSplit(rangeBins[0], centroidBounds, top[index].node.bounds.surfaceArea(), count);
+			if (choice.isLeaf)
+				return index;
+
+			int middle = choice.axis < 0 ? begin + count / 2
+				: partition(begin, end, choice, centroidBounds);
+			if (middle == begin || middle == end)
+				return index;
+
+			int first = buildTop(begin, middle);
+			int second = buildTop(middle, end);
+			top[index].first = first;
+			top[index].second = second;
+			top[index].node.count = 0;
+			return index;
+		}
+
+		// Stable like partitionRange: every range counts the primitives it
+		// sends left, which tells it where to scatter them in the scratch
+		// space, and the result is copied back
+		int partition(int begin, int end, const SplitChoice& choice, const AABB& centroidBounds)
+		{
+			int count = end - begin;
+			float scale = binScale(centroidBounds, choice.axis);
+			int ranges = pool.rangeCount(count, parallelGrain);
+
+			std::vector<int> leftCounts(ranges);
+			std::vector<int> rightCounts(ranges);
+			pool.parallelRanges(count, parallelGrain, [&](int range, int first, int last, unsigned worker)
+			{
+				int left = 0;
+				for (int i = begin + first; i < begin + last; i++)
+				{
+					if (goesLeft(input, input.indices[i], choice, centroidBounds, scale))
+						left++;
+				}
+				leftCounts[range] = left;
+				rightCounts[range] = (last - first) - left;
+			});
+
+			int totalLeft = 0;
+			for (int i = 0; i < ranges; i++)
+				totalLeft += leftCounts[i];
+
+			std::vector<int> leftStarts(ranges);
+			std::vector<int> rightStarts(ranges);
+			int left = begin;
+			int right = begin + totalLeft;
+			for (int i = 0; i < ranges; i++)
+			{
+				leftStarts[i] = left;
+				rightStarts[i] = right;
+				left += leftCounts[i];
+				right += rightCounts[i];
+			}
+
+			pool.parallelRanges(count, parallelGrain, [&](int range, int first, int last, unsigned worker)
+			{
+				int left = leftStarts[range];
+				int right = rightStarts[range];
+				for (int i = begin + first; i < begin + last; i++)
+				{
+					int index = input.indices[i];
+					if (goesLeft(input, index, choice, centroidBounds, scale))
+						input.scratch[left++] = index;
+					else
+						input.scratch[right++] = index;
+				}
+			});
+
+			pool.parallelRanges(count, parallelGrain, [&](int range, int first, int last, unsigned worker)
+			{
+				std::copy(input.scratch + begin + first, input.scratch + begin + last, input.indices + begin + first);
+			});
+			return begin + totalLeft;
+		}
+
+		// Assigns final positions in depth-first order, returns the position
+		// after the subtree rooted at index
+		int place(int index, int position)
+		{
+			TopNode& node = top[index];
+			if (node.subtree >= 0)
+			{
+				subtrees[node.subtree].position = position;
+				return position + subtrees[node.subtree].size;
+			}
+
+			node.position = position;
+			if (node.first < 0)
+				return position + 1;
+
+			int second = place(node.first, position + 1);
+			top[index].node.offset = second;
+			return place(top[index].second, second);
+		}
+
+	public:
+
+		ParallelBuild(ThreadPool& pool, const BuildInput& input, int count)
+			: pool(pool),
+			input(input),
+			arenas(pool.size() + 1)
+		{
+			subtreeSize = std::max(BVH_MAX_LEAF_SIZE,
+				std::min(maxSubtreeSize, count / ((int)pool.size() * subtreesPerWorker)));
+		}
+
+		void run(int count, std::vector<BVHNode>& nodes)
+		{
+			buildTop(0, count);
+
+			pool.parallelFor((int)subtrees.size(), [&](int index, unsigned worker)
+			{
+				Subtree& subtree = subtrees[index];
+				std::vector<BVHNode>& arena = arenas[worker];
+				subtree.worker = worker;
+				subtree.start = (int)arena.size();
+				arena.push_back(BVHNode());
+				buildSubtree(input, arena, subtree.start, subtree.begin, subtree.end);
+				subtree.size = (int)arena.size() - subtree.start;
+			});
+
+			nodes.resize(place(0, 0));
+			for (size_t i = 0; i < top.size(); i++)
+			{
+				if (top[i].subtree < 0)
+					nodes[top[i].position] = top[i].node;
+			}
+
+			// Inner nodes of a subtree point into its arena and are moved
+			// along with it
+			pool.parallelFor((int)subtrees.size(), [&](int index, unsigned worker)
+			{
+				const Subtree& subtree = subtrees[index];
+				const BVHNode* source = &arenas[subtree.worker][subtree.start];
+				BVHNode* target = &nodes[subtree.position];
+				int shift = subtree.position - subtree.start;
+				for (int i = 0; i < subtree.size; i++)
+				{
+					target[i] = source[i];
+					if (!target[i].isLeaf())
+						target[i].offset += shift;
+				}
+			});
+		}
+	};
+
+	// Surface area heuristic cost of a node with the unit costs findSplit
+	// uses, before dividing by the area of the root
+	inline double nodeCost(const BVHNode& node)
+	{
+		return (double)node.bounds.surfaceArea() * (node.isLeaf() ? node.count : 1);
+	}
+
+	// Index after the last node of the subtree rooted at index, which the
+	// depth-first layout keeps contiguous
+	int subtreeEnd(const BVHNode* nodes, int index)
+	{
+		while (!nodes[index].isLeaf())
+			index = nodes[index].offset;
+		return index + 1;
+	}
+
+	// Summed SAH cost of some nodes, and the summed areas of the boxes of
+	// the primitives in their leaves
+	struct RefitCost
+	{
+		double nodes;
+		double primitives;
+
+		RefitCost() : nodes(0.0), primitives(0.0) { }
+
+		void add(const RefitCost& other)
+		{
+			nodes += other.nodes;
+			primitives += other.primitives;
+		}
+	};
+
+	// Recomputes the boxes of the nodes [begin, end), a subtree or a single
+	// inner node whose children are done. Children come after their parent,
+	// so sweeping backwards refits them first.
+	RefitCost refitRange(BVHNode* nodes, const int* indices, const AABB* primBounds, int begin, int end)
+	{
+		RefitCost cost;
+		for (int i = end - 1; i >= begin; i--)
+		{
+			BVHNode& node = nodes[i];
+			if (node.isLeaf())
+			{
+				AABB bounds;
+				for (int j = node.offset; j < node.offset + node.count; j++)
+				{
+					bounds.extend(primBounds[indices[j]]);
+					cost.primitives += primBounds[indices[j]].surfaceArea();
+				}
+				node.bounds = bounds.padded(RAY_T_MIN);
+			}
+			else
+			{
+				// Padding the children is the same as padding their union
+				node.bounds = nodes[i + 1].bounds;
+				node.bounds.extend(nodes[node.offset].bounds);
+			}
+			cost.nodes += nodeCost(node);
+		}
+		return cost;
+	}
+
+	// Divides the tree below index into subtrees of at most grain nodes for
+	// the workers to refit. The inner nodes above them are listed in top,
+	// parents before their children.
+	void splitForRefit(const BVHNode* nodes, int index, int grain,
+		std::vector<int>& top, std::vector<int>& roots)
+	{
+		if (subtreeEnd(nodes, index) - index <= grain)
+		{
+			roots.push_back(index);
+			return;
+		}
+
+		top.push_back(index);
+		splitForRefit(nodes, index + 1, grain, top, roots);
+		splitForRefit(nodes, nodes[index].offset, grain, top, roots);
+	}
+
+	// Relative to the primitives' own boxes the cost stays the same when
+	// the scene is moved or scaled as a whole, but not when it turns and
+	// the boxes of the nodes grow faster than those of the primitives
+	float relativeCost(const RefitCost& cost)
+	{
+		return cost.primitives > 0.0 ? (float)(cost.nodes / cost.primitives) : 0.0f;
+	}
+}
+
+void setBVHWidth(int width)
+{
+	selectedWidth.store(width, std::memory_order_relaxed);
+}
+
+int bvhWidth()
+{
+	return selectedWidth.load(std::memory_order_relaxed);
+}
+
+void setBVHCompression(bool compressed)
+{
+	selectedCompression.store(compressed, std::memory_order_relaxed);
+}
+
+bool bvhCompression()
+{
+	return selectedCompression.load(std::memory_order_relaxed);
+}
+
+BVH::BVH()
+	: attachedNodes(NULL),
+	attachedCount(0),
+	builtCost(0.0f),
+	cost(0.0f)
+{
+}
+
+void BVH::build(const std::vector<AABB>& primBounds, ThreadPool* pool)
+{
+	nodes.clear();
+	indices.clear();
+	attachedNodes = NULL;
+	attachedCount = 0;
+	wide4.clear();
+	wide8.clear();
+	compressed4.clear();
+	compressed8.clear();
+	rootBounds = AABB();
+	builtCost = 0.0f;
+	cost = 0.0f;
+
+	int count = (int)primBounds.size();
+	if (count == 0)
+		return;
+
+	std::vector<Point> centroids(count);
+	std::vector<int> scratch(count);
+	indices.resize(count);
+	BuildInput input = { primBounds.data(), centroids.data(), indices.data(), scratch.data() };
+
+	bool parallel = pool && pool->size() > 1 && count > 2 * parallelGrain;
+	if (!parallel)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			centroids[i] = primBounds[i].centroid();
+			indices[i] = i;
+		}
+
+		// A binary tree over n leaves never needs more than 2n - 1 nodes
+		nodes.reserve(2 * count - 1);
+		nodes.push_back(BVHNode());
+		buildSubtree(input, nodes, 0, 0, count);
+		nodes.shrink_to_fit();
+	}
+	else
+	{
+		pool->parallelRanges(count, parallelGrain, [&](int range, int first, int last, unsigned worker)
+		{
+			for (int i = first; i < last; i++)
+			{
+				centroids[i] = primBounds[i].centroid();
+				indices[i] = i;
+			}
+		});
+
+		ParallelBuild build(*pool, input, count);
+		build.run(count, nodes);
+	}
+
+	RefitCost total;
+	for (size_t i = 0; i < nodes.size(); i++)
+		total.nodes += nodeCost(nodes[i]);
+	for (int i = 0; i < count; i++)
+		total.primitives += primBounds[indices[i]].surfaceArea();
+	builtCost = relativeCost(total);
+	cost = builtCost;
+	buildWide();
+}
+
+void BVH::attach(const BVHNode* nodes, int count)
+{
+	this->nodes.clear();
+	indices.clear();
+	attachedNodes = nodes;
+	attachedCount = count;
+	builtCost = 0.0f;
+	cost = 0.0f;
+	buildWide();
+}
+
+void BVH::refit(const std::vector<AABB>& primBounds, ThreadPool* pool)
+{
+	refitNodes(primBounds, pool);
+	refitWide(primBounds);
+}
+
+bool BVH::update(const std::vector<AABB>& primBounds, ThreadPool* pool)
+{
+	if (canRefit() && primBounds.size() == indices.size())
+	{
+		refitNodes(primBounds, pool);
+		if (costGrowth() <= BVH_REFIT_COST_LIMIT)
+		{
+			refitWide(primBounds);
+			return false;
+		}
+	}
+
+	build(primBounds, pool);
+	return true;
+}
+
+void BVH::refitNodes(const std::vector<AABB>& primBounds, ThreadPool* pool)
+{
+	int count = (int)nodes.size();
+	if (count == 0)
+		return;
+
+	RefitCost total;
+	if (!pool || pool->size() <= 1 || count <= 2 * parallelGrain)
+	{
+		total = refitRange(nodes.data(), indices.data(), primBounds.data(), 0, count);
+	}
+	else
+	{
+		int grain = std::max(parallelGrain, count / ((int)pool->size() * subtreesPerWorker));
+		std::vector<int> top;
+		std::vector<int> roots;
+		splitForRefit(nodes.data(), 0, grain, top, roots);
+
+		std::vector<RefitCost> costs(roots.size());
+		pool->parallelFor((int)roots.size(), [&](int index, unsigned worker)
+		{
+			int root = roots[index];
+			costs[index] = refitRange(nodes.data(), indices.data(), primBounds.data(),
+				root, subtreeEnd(nodes.data(), root));
+		});
+
+		for (size_t i = 0; i < costs.size(); i++)
+			total.add(costs[i]);
+		for (int i = (int)top.size() - 1; i >= 0; i--)
+			total.add(refitRange(nodes.data(), indices.data(), primBounds.data(), top[i], top[i] + 1));
+	}
+	cost = relativeCost(total);
+}
+
+void BVH::refitWide(const std::vector<AABB>& primBounds)
+{
+	rootBounds = nodes.empty() ? AABB() : nodes[0].bounds;
+	if (!wide4.isEmpty())
+		wide4.refit(primBounds.data(), indices.data());
+	else if (!wide8.isEmpty())
+		wide8.refit(primBounds.data(), indices.data());
+	else
+		buildWide();
+}
+
+bool BVH::canRefit() const
+{
+	return !nodes.empty() && !indices.empty();
+}
+
+float BVH::costGrowth() const
+{
+	return builtCost > 0.0f ? cost / builtCost : 1.0f;
+}
+
+void BVH::buildWide()
+{
+	wide4.clear();
+	wide8.clear();
+	compressed4.clear();
+	compressed8.clear();
+	rootBounds = nodeCount() > 0 ? nodeArray()[0].bounds : AABB();
+
+	if (bvhWidth() == 4)
+	{
+		wide4.build(nodeArray(), nodeCount());
+		if (bvhCompression())
+		{
+			compressed4.build(wide4);
+			wide4.clear();
+		}
+	}
+	else if (bvhWidth() == 8)
+	{
+		wide8.build(nodeArray(), nodeCount());
+		if (bvhCompression())
+		{
+			compressed8.build(wide8);
+			wide8.clear();
+		}
+	}
+}
+
+void BVH::compact()
+{
+	if (wide4.isEmpty() && wide8.isEmpty() && compressed4.isEmpty() && compressed8.isEmpty())
+		return;
+
+	std::vector<BVHNode>().swap(nodes);
+	std::vector<int>().swap(indices);
+	attachedNodes = NULL;
+	attachedCount = 0;
+}
+
+bool BVH::isEmpty() const
+{
+	return rootBounds.isEmpty();
+}
+
+bool BVH::hasBinaryNodes() const
+{
+	return nodeCount() > 0;
+}
+
+const AABB& BVH::bounds() const
+{
+	return rootBounds;
+}
+
+size_t BVH::memoryUsage() const
+{
+	return nodes.capacity() * sizeof(BVHNode) + indices.capacity() * sizeof(int)
+		+ wide4.memoryUsage() + wide8.memoryUsage()
+		+ compressed4.memoryUsage() + compressed8.memoryUsage();
+}
+
+const BVHNode* BVH::getNodes() const
+{
+	return nodeArray();
+}
+
+const std::vector<int>& BVH::getIndices() const
+{
+	return indices;
+}
@@ -0,0 +1,415 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "AABB.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "WideBVH.h"
+
+class ThreadPool;
+
+// Primitives per leaf above which a split is forced even if SAH disagrees
+#define BVH_MAX_LEAF_SIZE 8
+
+// Number of centroid bins evaluated per axis during the SAH build
+#define BVH_BIN_COUNT 16
+
+// Deepest path the traversal stack can hold
+#define BVH_STACK_SIZE 64
+
+// Growth of the SAH cost through refitting, relative to the tree as
+// built, beyond which BVH::update() builds a new tree instead
+#define BVH_REFIT_COST_LIMIT 1.3f
+
+// Children per node single rays traverse: 2 keeps the binary tree, 4 or 8
+// also collapse it into a WideBVH. Applies to hierarchies built or
+// attached afterwards.
+void setBVHWidth(int width);
+
+int bvhWidth();
+
+// Stores the wide nodes as CompressedBVHNode, for a width of 4 or 8
+void setBVHCompression(bool compressed);
+
+bool bvhCompression();
+
+struct BVHNode
+{
+	AABB bounds;
+
+	// Leaves: index of the first primitive in BVH::indices.
+	// Inner nodes: index of the second child, the first one follows directly.
+	int offset;
+
+	// Number of primitives, 0 for inner nodes
+	int count;
+
+	bool isLeaf() const
+	{
+		return count > 0;
+	}
+};
+
+// Bounding volume hierarchy over an arbitrary list of primitives. It only
+// knows their bounds, the caller supplies the primitive tests through a
+// leaf callback that receives a range of BVH::indices.
+class BVH
+{
+protected:
+
+	std::vector<BVHNode> nodes;
+
+	std::vector<int> indices;
+
+	// Nodes owned by someone else, see attach(); NULL while the vector
+	// above is in use
+	const BVHNode* attachedNodes;
+
+	int attachedCount;
+
+	// Collapsed copies of the tree for single rays, at most one is in use
+	WideBVH<4> wide4;
+	WideBVH<8> wide8;
+	CompressedBVH<4> compressed4;
+	CompressedBVH<8> compressed8;
+
+	// Kept for bounds() once the nodes are released
+	AABB rootBounds;
+
+	// SAH cost of the binary tree relative to the summed areas of the
+	// primitives' boxes, as built and as last refitted
+	float builtCost;
+	float cost;
+
+	void buildWide();
+
+	void refitNodes(const std::vector<AABB>& primBounds, ThreadPool* pool);
+
+	// Brings the wide tree in line with the refitted binary one
+	void refitWide(const std::vector<AABB>& primBounds);
+
+	const BVHNode* nodeArray() const
+	{
+		return attachedNodes ? attachedNodes : nodes.data();
+	}
+
+public:
+
+	BVH();
+
+	// Builds the hierarchy with a binned surface area heuristic. With a pool
+	// the upper levels are binned and partitioned on all workers and the
+	// subtrees below are built as separate tasks; the result is the same
+	// as without one.
+	void build(const std::vector<AABB>& primBounds, ThreadPool* pool = NULL);
+
+	// Uses a finished hierarchy from existing memory, e.g. a mapped scene
+	// cache, in place of building one. The nodes must outlive this object
+	// or the next build(). getIndices() is empty afterwards.
+	void attach(const BVHNode* nodes, int count);
+
+	// Recomputes every node box from new primitive bounds, indexed like in
+	// build(), and keeps the tree as it is, e.g. after primitives moved.
+	// Needs canRefit() and the same number of primitives. A pool refits
+	// the subtrees on all of its workers.
+	void refit(const std::vector<AABB>& primBounds, ThreadPool* pool = NULL);
+
+	// Refits, or builds a new tree when the hierarchy cannot be refitted or
+	// refitting made its cost grow beyond BVH_REFIT_COST_LIMIT. Returns
+	// true if it built, which changes getIndices().
+	bool update(const std::vector<AABB>& primBounds, ThreadPool* pool = NULL);
+
+	// False for attached or compacted hierarchies
+	bool canRefit() const;
+
+	// SAH cost after the last refit over the cost as built, 1 after build()
+	float costGrowth() const;
+
+	// Releases the binary nodes and indices once a wide tree took their
+	// place, e.g. after the scene cache was written. Only single rays can
+	// traverse the hierarchy afterwards.
+	void compact();
+
+	bool isEmpty() const;
+
+	// False after compact(); the packet traversals need the binary nodes
+	bool hasBinaryNodes() const;
+
+	// Box around all primitives, padded like the nodes
+	const AABB& bounds() const;
+
+	// Bytes of node and index memory owned by the hierarchy, not counting
+	// attached nodes
+	size_t memoryUsage() const;
+
+	const BVHNode* getNodes() const;
+
+	int nodeCount() const
+	{
+		return attachedNodes ? attachedCount : (int)nodes.size();
+	}
+
+	// Primitive indices in leaf order
+	const std::vector<int>& getIndices() const;
+
+	// Closest hit. leaf(first, count) tests the primitives
+	// indices[first .. first + count) and returns true on a hit; it must
+	// shrink tMax whenever it finds a closer hit.
+	template <typename Leaf>
+	bool intersect(const Ray& ray, const float& tMax, Leaf leaf) const
+	{
+		if (!compressed8.isEmpty())
+			return compressed8.intersect(ray, tMax, leaf);
+		if (!compressed4.isEmpty())
+			return compressed4.intersect(ray, tMax, leaf);
+		if (!wide8.isEmpty())
+			return wide8.intersect(ray, tMax, leaf);
+		if (!wide4.isEmpty())
+			return wide4.intersect(ray, tMax, leaf);
+
+		const BVHNode* tree = nodeArray();
+		if (nodeCount() == 0)
+			return false;
+
+		Vector invDirection = safeInverse(ray.direction);
+
+		bool hit = false;
+		int stack[BVH_STACK_SIZE];
+		int stackSize = 0;
+		int current = 0;
+
+		float tNear;
+		if (!tree[0].bounds.intersect(ray, invDirection, tMax, tNear))
+			return false;
+
+		while (true)
+		{
+			const BVHNode& node = tree[current];
+
+			if (node.isLeaf())
+			{
+				if (leaf(node.offset, node.count))
+					hit = true;
+			}
+			else
+			{
+				// Visit the nearer child first so tMax shrinks early
+				int first = current + 1;
+				int second = node.offset;
+				float tFirst, tSecond;
+				bool hitFirst = tree[first].bounds.intersect(ray, invDirection, tMax, tFirst);
+				bool hitSecond = tree[second].bounds.intersect(ray, invDirection, tMax, tSecond);
+
+				if (hitFirst && hitSecond)
+				{
+					if (tSecond < tFirst)
+						std::swap(first, second);
+					stack[stackSize++] = second;
+					current = first;
+					continue;
+				}
+				if (hitFirst)
+				{
+					current = first;
+					continue;
+				}
+				if (hitSecond)
+				{
+					current = second;
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+
+			// The node may have fallen behind a hit found since it was pushed
+			while (!tree[current].bounds.intersect(ray, invDirection, tMax, tNear))
+			{
+				if (stackSize == 0)
+					return hit;
+				current = stack[--stackSize];
+			}
+		}
+
+		return hit;
+	}
+
+	// Any hit. leaf(first, count) returns true as soon as one of the
+	// primitives blocks the ray, which ends the traversal.
+	template <typename Leaf>
+	bool occluded(const Ray& ray, Leaf leaf) const
+	{
+		if (!compressed8.isEmpty())
+			return compressed8.occluded(ray, leaf);
+		if (!compressed4.isEmpty())
+			return compressed4.occluded(ray, leaf);
+		if (!wide8.isEmpty())
+			return wide8.occluded(ray, leaf);
+		if (!wide4.isEmpty())
+			return wide4.occluded(ray, leaf);
+
+		const BVHNode* tree = nodeArray();
+		if (nodeCount() == 0)
+			return false;
+
+		Vector invDirection = safeInverse(ray.direction);
+
+		int stack[BVH_STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node = tree[stack[--stackSize]];
+
+			float tNear;
+			if (!node.bounds.intersect(ray, invDirection, ray.tMax, tNear))
+				continue;
+
+			if (node.isLeaf())
+			{
+				if (leaf(node.offset, node.count))
+					return true;
+			}
+			else
+			{
+				stack[stackSize++] = node.offset;
+				stack[stackSize++] = (int)(&node - tree) + 1;
+			}
+		}
+
+		return false;
+	}
+	// Closest hits for the lanes in active. leaf(first, count, mask) tests
+	// the primitives for the lanes in mask and shrinks packet.tMax. A node
+	// is entered when any lane hits it, lanes that miss are masked off.
+	template <typename Leaf>
+	void intersect(RayPacket& packet, unsigned active, Leaf leaf) const
+	{
+		const BVHNode* tree = nodeArray();
+		if (nodeCount() == 0)
+			return;
+
+		int stack[BVH_STACK_SIZE];
+		unsigned stackMask[BVH_STACK_SIZE];
+		int stackSize = 0;
+		int current = 0;
+
+		float tNear;
+		unsigned mask = packet.intersect(tree[0].bounds, active, tNear);
+		if (mask == 0)
+			return;
+
+		while (true)
+		{
+			const BVHNode& node = tree[current];
+
+			if (node.isLeaf())
+			{
+				leaf(node.offset, node.count, mask);
+			}
+			else
+			{
+				// Nearer child first, judged by the lane that reaches it first
+				int first = current + 1;
+				int second = node.offset;
+				float tFirst, tSecond;
+				unsigned maskFirst = packet.intersect(tree[first].bounds, mask, tFirst);
+				unsigned maskSecond = packet.intersect(tree[second].bounds, mask, tSecond);
+
+				if (maskFirst && maskSecond)
+				{
+					if (tSecond < tFirst)
+					{
+						std::swap(first, second);
+						std::swap(maskFirst, maskSecond);
+					}
+					stack[stackSize] = second;
+					stackMask[stackSize] = maskSecond;
+					stackSize++;
+					current = first;
+					mask = maskFirst;
+					continue;
+				}
+				if (maskFirst)
+				{
+					current = first;
+					mask = maskFirst;
+					continue;
+				}
+				if (maskSecond)
+				{
+					current = second;
+					mask = maskSecond;
+					continue;
+				}
+			}
+
+			// Lanes may have found hits in front of the node since it was pushed
+			do
+			{
+				if (stackSize == 0)
+					return;
+				stackSize--;
+				current = stack[stackSize];
+				mask = packet.intersect(tree[current].bounds, stackMask[stackSize], tNear);
+			} while (mask == 0);
+		}
+	}
+
+	// Any hit for the lanes in active, returns the blocked lanes.
+	// leaf(first, count, mask) returns the lanes in mask it blocks; blocked
+	// lanes leave the traversal, which ends once all of them are blocked.
+	template <typename Leaf>
+	unsigned occluded(const RayPacket& packet, unsigned active, Leaf leaf) const
+	{
+		const BVHNode* tree = nodeArray();
+		if (nodeCount() == 0)
+			return 0;
+
+		int stack[BVH_STACK_SIZE];
+		unsigned stackMask[BVH_STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize] = 0;
+		stackMask[stackSize] = active;
+		stackSize++;
+
+		unsigned blocked = 0;
+		while (stackSize > 0)
+		{
+			stackSize--;
+			const BVHNode& node = tree[stack[stackSize]];
+			unsigned mask = stackMask[stackSize] & ~blocked;
+			if (mask == 0)
+				continue;
+
+			float tNear;
+			mask = packet.intersect(node.bounds, mask, tNear);
+			if (mask == 0)
+				continue;
+
+			if (node.isLeaf())
+			{
+				blocked |= leaf(node.offset, node.count, mask);
+				if (blocked == active)
+					return blocked;
+			}
+			else
+			{
+				stack[stackSize] = node.offset;
+				stackMask[stackSize] = mask;
+				stackSize++;
+				stack[stackSize] = (int)(&node - tree) + 1;
+				stackMask[stackSize] = mask;
+				stackSize++;
+			}
+		}
+
+		return blocked;
+	}
+};
+
+#endif // BVH_H
@@ -1,14 +1,124 @@
 #include "Camera.h"
+#include "Matrix44.h"
+#include "Simd.h"
 
 #include <cmath>
 
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+void Camera::makeRays(int x, int y, int count, int width, int height,
+	const RayArrays& rays, float jitterX, float jitterY) const
+{
+	for (int i = 0; i < count; i++)
+	{
+		Vector2 screenCoord((2.0f * (x + i + jitterX)) / width - 1.0f,
+			(-2.0f * (y + jitterY)) / height + 1.0f);
+
+		Ray ray = makeRay(screenCoord);
+		rays.originX[i] = ray.origin.x;
+		rays.originY[i] = ray.origin.y;
+		rays.originZ[i] = ray.origin.z;
+		rays.directionX[i] = ray.direction.x;
+		rays.directionY[i] = ray.direction.y;
+		rays.directionZ[i] = ray.direction.z;
+	}
+}
+
+namespace
+{
+	// Direction of pixel column c is rowBase + ((c * scale - 1) * w) * right,
+	// the kernels return how many of the count rays they wrote
+
+	int directionsScalar(const Vector& rowBase, const Vector& right, float w, float scale,
+		float x, int first, int count, const RayArrays& rays)
+	{
+		for (int i = first; i < count; i++)
+		{
+			float offset = ((x + i) * scale - 1.0f) * w;
+			Vector direction = rowBase + offset * right;
+			float length = direction.length();
+
+			rays.directionX[i] = direction.x / length;
+			rays.directionY[i] = direction.y / length;
+			rays.directionZ[i] = direction.z / length;
+		}
+		return count;
+	}
+
+#ifdef SIMD_X86
+
+	SIMD_TARGET("sse4.1")
+	int directionsSSE4(const Vector& rowBase, const Vector& right, float w, float scale,
+		float x, int count, const RayArrays& rays)
+	{
+		__m128 baseX = _mm_set1_ps(rowBase.x), baseY = _mm_set1_ps(rowBase.y), baseZ = _mm_set1_ps(rowBase.z);
+		__m128 rightX = _mm_set1_ps(right.x), rightY = _mm_set1_ps(right.y), rightZ = _mm_set1_ps(right.z);
+		__m128 width = _mm_set1_ps(w), step = _mm_set1_ps(scale), one = _mm_set1_ps(1.0f);
+
+		// Column numbers advance by the vector width each iteration
+		__m128 column = _mm_add_ps(_mm_set1_ps(x), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+		__m128 delta = _mm_set1_ps(4.0f);
+
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 offset = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(column, step), one), width);
+			__m128 dx = _mm_add_ps(baseX, _mm_mul_ps(offset, rightX));
+			__m128 dy = _mm_add_ps(baseY, _mm_mul_ps(offset, rightY));
+			__m128 dz = _mm_add_ps(baseZ, _mm_mul_ps(offset, rightZ));
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+			_mm_storeu_ps(rays.directionX + i, _mm_div_ps(dx, length));
+			_mm_storeu_ps(rays.directionY + i, _mm_div_ps(dy, length));
+			_mm_storeu_ps(rays.directionZ + i, _mm_div_ps(dz, length));
+			column = _mm_add_ps(column, delta);
+		}
+		return i;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	int directionsAVX2(const Vector& rowBase, const Vector& right, float w, float scale,
+		float x, int count, const RayArrays& rays)
+	{
+		__m256 baseX = _mm256_set1_ps(rowBase.x), baseY = _mm256_set1_ps(rowBase.y), baseZ = _mm256_set1_ps(rowBase.z);
+		__m256 rightX = _mm256_set1_ps(right.x), rightY = _mm256_set1_ps(right.y), rightZ = _mm256_set1_ps(right.z);
+		__m256 width = _mm256_set1_ps(w), step = _mm256_set1_ps(scale), one = _mm256_set1_ps(1.0f);
+
+		__m256 column = _mm256_add_ps(_mm256_set1_ps(x),
+			_mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+		__m256 delta = _mm256_set1_ps(8.0f);
+
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 offset = _mm256_mul_ps(_mm256_fmsub_ps(column, step, one), width);
+			__m256 dx = _mm256_fmadd_ps(offset, rightX, baseX);
+			__m256 dy = _mm256_fmadd_ps(offset, rightY, baseY);
+			__m256 dz = _mm256_fmadd_ps(offset, rightZ, baseZ);
+			__m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx))));
+
+			_mm256_storeu_ps(rays.directionX + i, _mm256_div_ps(dx, length));
+			_mm256_storeu_ps(rays.directionY + i, _mm256_div_ps(dy, length));
+			_mm256_storeu_ps(rays.directionZ + i, _mm256_div_ps(dz, length));
+			column = _mm256_add_ps(column, delta);
+		}
+		return i;
+	}
+
+#endif // SIMD_X86
+}
+
 PerspectiveCamera::PerspectiveCamera(Point origin,
 	Vector target, Vector upguide, float fov, float aspectRatio)
 	: origin(origin)
 {
-	forward = (target - origin).normalized();
-	right = cross(forward, upguide).normalized();
-	up = cross(right, forward);
+	// The rows of the view matrix are the camera axes in world space
+	Matrix33 axes = Matrix44::lookAt(origin, target, upguide).getOrientation().transposed();
+	right = axes.getXAxis();
+	up = axes.getYAxis();
+	forward = -axes.getZAxis();
 
 	h = tan(fov);
 	w = h * aspectRatio;
@@ -21,3 +131,33 @@ Ray PerspectiveCamera::makeRay(Vector2 point) const
 
 	return Ray(origin, direction.normalized());
 }
+
+void PerspectiveCamera::makeRays(int x, int y, int count, int width, int height,
+	const RayArrays& rays, float jitterX, float jitterY) const
+{
+	for (int i = 0; i < count; i++)
+	{
+		rays.originX[i] = origin.x;
+		rays.originY[i] = origin.y;
+		rays.originZ[i] = origin.z;
+	}
+
+	// Everything but the horizontal term is shared by the whole row
+	float screenY = 1.0f - (2.0f * (y + jitterY)) / height;
+	Vector rowBase = forward + screenY * h * up;
+	float scale = 2.0f / width;
+	float column = x + jitterX;
+
+	int done = 0;
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2: done = directionsAVX2(rowBase, right, w, scale, column, count, rays); break;
+	case SIMD_SSE4: done = directionsSSE4(rowBase, right, w, scale, column, count, rays); break;
+#endif
+	default: break;
+	}
+
+	directionsScalar(rowBase, right, w, scale, column, done, count, rays);
+}
@@ -4,7 +4,18 @@
 #include "Vector3.h"
 #include "Vector2.h"
 //#include "Maths.h"
-#include "ray.h"
+#include "Ray.h"
+
+// Destination of Camera::makeRays, one array per ray component
+struct RayArrays
+{
+	float* originX;
+	float* originY;
+	float* originZ;
+	float* directionX;
+	float* directionY;
+	float* directionZ;
+};
 
 class Camera
 {
@@ -12,6 +23,12 @@ public:
 	virtual ~Camera() { }
 
 	virtual Ray makeRay(Vector2 point) const = 0;
+
+	// Rays through the count pixels of row y starting at column x of a
+	// width by height image, written to rays[0 .. count). The jitter moves
+	// every ray by the same fraction of a pixel.
+	virtual void makeRays(int x, int y, int count, int width, int height,
+		const RayArrays& rays, float jitterX = 0.0f, float jitterY = 0.0f) const;
 };
 
 class PerspectiveCamera : public Camera
@@ -29,6 +46,11 @@ public:
 		Vector upguide, float fov, float aspectRatio);
 
 	virtual Ray makeRay(Vector2 point) const;
+
+	// Steps the direction by a constant delta along the row and
+	// normalizes several rays per instruction
+	virtual void makeRays(int x, int y, int count, int width, int height,
+		const RayArrays& rays, float jitterX = 0.0f, float jitterY = 0.0f) const;
 };
 
 #endif // CAMERA_H
\ No newline at end of file
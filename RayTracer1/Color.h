@@ -0,0 +1,83 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <cmath>
+
+// sRGB transfer function, for values in [0, 1]
+inline float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Linear RGB radiance or reflectance. Unlike sf::Color it is not limited
+// to [0, 1], so shading never clamps or rounds between bounces.
+struct Color
+{
+	float r, g, b;
+
+	constexpr Color()
+		: r(0.0f),
+		g(0.0f),
+		b(0.0f)
+	{
+	}
+
+	constexpr Color(float r, float g, float b)
+		: r(r),
+		g(g),
+		b(b)
+	{
+	}
+
+	// Linear value of an 8-bit sRGB colour, as written in scene setups
+	static Color fromSRGB8(int r, int g, int b)
+	{
+		return Color(srgbToLinear(r / 255.0f), srgbToLinear(g / 255.0f), srgbToLinear(b / 255.0f));
+	}
+
+	constexpr Color operator +(const Color& c) const
+	{
+		return Color(r + c.r, g + c.g, b + c.b);
+	}
+
+	constexpr Color operator *(const Color& c) const
+	{
+		return Color(r * c.r, g * c.g, b * c.b);
+	}
+
+	constexpr Color operator *(float f) const
+	{
+		return Color(r * f, g * f, b * f);
+	}
+
+	Color& operator +=(const Color& c)
+	{
+		r += c.r;
+		g += c.g;
+		b += c.b;
+		return *this;
+	}
+
+	Color& operator *=(const Color& c)
+	{
+		r *= c.r;
+		g *= c.g;
+		b *= c.b;
+		return *this;
+	}
+
+	Color& operator *=(float f)
+	{
+		r *= f;
+		g *= f;
+		b *= f;
+		return *this;
+	}
+};
+
+#endif // COLOR_H
@@ -0,0 +1,202 @@
+#include "Framebuffer.h"
+#include "Color.h"
+#include "Simd.h"
+
+#include <cmath>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// 8-bit sRGB value of the linear intensity i / (SRGB_LUT_SIZE - 1)
+	const unsigned char* srgbTable()
+	{
+		struct Table
+		{
+			unsigned char values[SRGB_LUT_SIZE];
+
+			Table()
+			{
+				for (int i = 0; i < SRGB_LUT_SIZE; i++)
+					values[i] = (unsigned char)std::lrint(255.0f * linearToSrgb(i / (float)(SRGB_LUT_SIZE - 1)));
+			}
+		};
+
+		static const Table table;
+		return table.values;
+	}
+
+	// The kernels turn count accumulated channel values into table indices:
+	// scale, tone map, clamp to [0, 1] (NaN becomes 0) and round
+
+	void indicesScalar(const float* values, int* indices, int first, int count, float scale, ToneMapOperator op)
+	{
+		for (int i = first; i < count; i++)
+		{
+			float value = values[i] * scale;
+			if (op == TONEMAP_REINHARD)
+				value = value / (1.0f + value);
+			else if (op == TONEMAP_ACES)
+				value = (value * (2.51f * value + 0.03f)) / (value * (2.43f * value + 0.59f) + 0.14f);
+
+			value = value > 0.0f ? value : 0.0f;
+			value = value < 1.0f ? value : 1.0f;
+			indices[i] = (int)std::lrint(value * (SRGB_LUT_SIZE - 1));
+		}
+	}
+
+#ifdef SIMD_X86
+
+	SIMD_TARGET("sse4.1")
+	int indicesSSE4(const float* values, int* indices, int count, float scale, ToneMapOperator op)
+	{
+		__m128 factor = _mm_set1_ps(scale);
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 size = _mm_set1_ps((float)(SRGB_LUT_SIZE - 1));
+
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 value = _mm_mul_ps(_mm_loadu_ps(values + i), factor);
+			if (op == TONEMAP_REINHARD)
+			{
+				value = _mm_div_ps(value, _mm_add_ps(one, value));
+			}
+			else if (op == TONEMAP_ACES)
+			{
+				__m128 numerator = _mm_mul_ps(value, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), value), _mm_set1_ps(0.03f)));
+				__m128 denominator = _mm_add_ps(_mm_mul_ps(value,
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), value), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+				value = _mm_div_ps(numerator, denominator);
+			}
+
+			value = _mm_min_ps(_mm_max_ps(value, zero), one);
+			_mm_storeu_si128((__m128i*)(indices + i), _mm_cvtps_epi32(_mm_mul_ps(value, size)));
+		}
+		return i;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	int indicesAVX2(const float* values, int* indices, int count, float scale, ToneMapOperator op)
+	{
+		__m256 factor = _mm256_set1_ps(scale);
+		__m256 zero = _mm256_setzero_ps();
+		__m256 one = _mm256_set1_ps(1.0f);
+		__m256 size = _mm256_set1_ps((float)(SRGB_LUT_SIZE - 1));
+
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 value = _mm256_mul_ps(_mm256_loadu_ps(values + i), factor);
+			if (op == TONEMAP_REINHARD)
+			{
+				value = _mm256_div_ps(value, _mm256_add_ps(one, value));
+			}
+			else if (op == TONEMAP_ACES)
+			{
+				__m256 numerator = _mm256_mul_ps(value, _mm256_fmadd_ps(_mm256_set1_ps(2.51f), value, _mm256_set1_ps(0.03f)));
+				__m256 denominator = _mm256_fmadd_ps(value,
+					_mm256_fmadd_ps(_mm256_set1_ps(2.43f), value, _mm256_set1_ps(0.59f)), _mm256_set1_ps(0.14f));
+				value = _mm256_div_ps(numerator, denominator);
+			}
+
+			value = _mm256_min_ps(_mm256_max_ps(value, zero), one);
+			_mm256_storeu_si256((__m256i*)(indices + i), _mm256_cvtps_epi32(_mm256_mul_ps(value, size)));
+		}
+		return i;
+	}
+
+#endif // SIMD_X86
+}
+
+Framebuffer::Framebuffer(int width, int height)
+	: width(0),
+	height(0),
+	sampleCount(0)
+{
+	resize(width, height);
+}
+
+void Framebuffer::resize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	clear();
+}
+
+void Framebuffer::clear()
+{
+	pixels.assign(3 * (size_t)width * height, 0.0f);
+	sampleCount = 0;
+}
+
+int Framebuffer::getWidth() const
+{
+	return width;
+}
+
+int Framebuffer::getHeight() const
+{
+	return height;
+}
+
+float* Framebuffer::row(int y)
+{
+	return &pixels[3 * (size_t)y * width];
+}
+
+const float* Framebuffer::row(int y) const
+{
+	return &pixels[3 * (size_t)y * width];
+}
+
+void Framebuffer::finishSample()
+{
+	sampleCount++;
+}
+
+int Framebuffer::getSampleCount() const
+{
+	return sampleCount;
+}
+
+void Framebuffer::toRGBA8(unsigned char* rgba, const ToneMap& toneMap) const
+{
+	if (width == 0 || height == 0)
+		return;
+
+	const unsigned char* table = srgbTable();
+	float scale = toneMap.exposure / (sampleCount > 0 ? sampleCount : 1);
+#ifdef SIMD_X86
+	SimdLevel level = simdLevel();
+#endif
+
+	// Row by row, so the indices stay in cache between the two loops
+	int channels = 3 * width;
+	std::vector<int> indices(channels);
+	for (int y = 0; y < height; y++)
+	{
+		const float* values = row(y);
+
+		int done = 0;
+#ifdef SIMD_X86
+		if (level >= SIMD_AVX2)
+			done = indicesAVX2(values, &indices[0], channels, scale, toneMap.op);
+		else if (level >= SIMD_SSE4)
+			done = indicesSSE4(values, &indices[0], channels, scale, toneMap.op);
+#endif
+		indicesScalar(values, &indices[0], done, channels, scale, toneMap.op);
+
+		unsigned char* out = rgba + 4 * (size_t)y * width;
+		for (int x = 0; x < width; x++)
+		{
+			out[4 * x] = table[indices[3 * x]];
+			out[4 * x + 1] = table[indices[3 * x + 1]];
+			out[4 * x + 2] = table[indices[3 * x + 2]];
+			out[4 * x + 3] = 255;
+		}
+	}
+}
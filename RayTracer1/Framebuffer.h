@@ -0,0 +1,80 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+
+// Entries in the table that maps linear [0, 1] to 8-bit sRGB
+#define SRGB_LUT_SIZE 16384
+
+enum ToneMapOperator
+{
+	// Values above 1 are clipped
+	TONEMAP_CLAMP,
+
+	// x / (1 + x)
+	TONEMAP_REINHARD,
+
+	// Narkowicz's fit of the ACES filmic curve
+	TONEMAP_ACES
+};
+
+// Applied when the accumulated radiance is turned into an 8-bit image
+struct ToneMap
+{
+	float exposure;
+
+	ToneMapOperator op;
+
+	ToneMap(float exposure = 1.0f, ToneMapOperator op = TONEMAP_CLAMP)
+		: exposure(exposure),
+		op(op)
+	{
+	}
+};
+
+// Row-major HDR accumulation buffer of linear RGB. Every render pass adds
+// one sample per pixel through row() and then calls finishSample(); the
+// buffer holds the sums, so passes can be added progressively and the
+// conversion to 8 bits happens once, for the average, in toRGBA8().
+class Framebuffer
+{
+protected:
+
+	int width;
+
+	int height;
+
+	std::vector<float> pixels;
+
+	int sampleCount;
+
+public:
+
+	Framebuffer(int width = 0, int height = 0);
+
+	// Resizes and clears
+	void resize(int width, int height);
+
+	// Drops all samples
+	void clear();
+
+	int getWidth() const;
+
+	int getHeight() const;
+
+	// First of the 3 * width floats of row y
+	float* row(int y);
+
+	const float* row(int y) const;
+
+	// Counts a pass that added one sample to every pixel
+	void finishSample();
+
+	int getSampleCount() const;
+
+	// Averages the samples, applies exposure and tone mapping and encodes
+	// to sRGB. Writes 4 * width * height bytes of RGBA with alpha 255.
+	void toRGBA8(unsigned char* rgba, const ToneMap& toneMap = ToneMap()) const;
+};
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,177 @@
+#include "ImageFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	typedef std::vector<unsigned char> Bytes;
+
+	std::string extension(const std::string& path)
+	{
+		size_t dot = path.find_last_of('.');
+		if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos)
+			return std::string();
+
+		std::string result = path.substr(dot + 1);
+		for (size_t i = 0; i < result.size(); i++)
+			result[i] = (char)std::tolower((unsigned char)result[i]);
+		return result;
+	}
+
+	unsigned crc32(const unsigned char* data, size_t size, unsigned crc = 0)
+	{
+		struct Table
+		{
+			unsigned values[256];
+
+			Table()
+			{
+				for (unsigned n = 0; n < 256; n++)
+				{
+					unsigned c = n;
+					for (int k = 0; k < 8; k++)
+						c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+					values[n] = c;
+				}
+			}
+		};
+
+		static const Table table;
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void putBig32(Bytes& out, unsigned value)
+	{
+		out.push_back((unsigned char)(value >> 24));
+		out.push_back((unsigned char)(value >> 16));
+		out.push_back((unsigned char)(value >> 8));
+		out.push_back((unsigned char)value);
+	}
+
+	// Length, type, data and the CRC of type and data
+	void putChunk(Bytes& out, const char* type, const Bytes& data)
+	{
+		putBig32(out, (unsigned)data.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		putBig32(out, crc32(&out[start], out.size() - start));
+	}
+
+	// zlib stream of stored deflate blocks. Rendered images compress
+	// poorly with anything short of a real encoder, and this keeps the
+	// writer dependency free and fast.
+	Bytes zlibStored(const Bytes& data)
+	{
+		Bytes out;
+		out.reserve(data.size() + data.size() / 65535 * 5 + 16);
+		out.push_back(0x78);
+		out.push_back(0x01);
+
+		size_t offset = 0;
+		do
+		{
+			size_t size = std::min<size_t>(data.size() - offset, 65535);
+			bool last = offset + size == data.size();
+			out.push_back(last ? 1 : 0);
+			out.push_back((unsigned char)size);
+			out.push_back((unsigned char)(size >> 8));
+			out.push_back((unsigned char)~size);
+			out.push_back((unsigned char)(~size >> 8));
+			out.insert(out.end(), data.begin() + offset, data.begin() + offset + size);
+			offset += size;
+		} while (offset < data.size());
+
+		// Adler-32, reduced often enough that the sums cannot overflow
+		unsigned a = 1, b = 0;
+		for (size_t i = 0; i < data.size(); )
+		{
+			size_t end = std::min(data.size(), i + 5552);
+			for (; i < end; i++)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		putBig32(out, (b << 16) | a);
+		return out;
+	}
+
+	bool writeFile(const std::string& path, const Bytes& data)
+	{
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+
+		bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+		return std::fclose(file) == 0 && ok;
+	}
+
+	bool writePNG(const std::string& path, const unsigned char* rgba, int width, int height)
+	{
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		Bytes out(signature, signature + 8);
+
+		Bytes header;
+		putBig32(header, (unsigned)width);
+		putBig32(header, (unsigned)height);
+		header.push_back(8);	// bits per channel
+		header.push_back(2);	// RGB
+		header.push_back(0);
+		header.push_back(0);
+		header.push_back(0);
+		putChunk(out, "IHDR", header);
+
+		// Every row starts with filter type 0 (none)
+		Bytes pixels;
+		pixels.reserve((3 * (size_t)width + 1) * height);
+		for (int y = 0; y < height; y++)
+		{
+			pixels.push_back(0);
+			const unsigned char* row = rgba + 4 * (size_t)y * width;
+			for (int x = 0; x < width; x++)
+				pixels.insert(pixels.end(), row + 4 * x, row + 4 * x + 3);
+		}
+		putChunk(out, "IDAT", zlibStored(pixels));
+		putChunk(out, "IEND", Bytes());
+
+		return writeFile(path, out);
+	}
+
+	bool writePPM(const std::string& path, const unsigned char* rgba, int width, int height)
+	{
+		char header[64];
+		int length = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+		Bytes out(header, header + length);
+		out.reserve(length + 3 * (size_t)width * height);
+		for (size_t i = 0; i < (size_t)width * height; i++)
+			out.insert(out.end(), rgba + 4 * i, rgba + 4 * i + 3);
+
+		return writeFile(path, out);
+	}
+}
+
+bool writeImage(const std::string& path, const unsigned char* rgba, int width, int height)
+{
+	std::string type = extension(path);
+	if (type == "png")
+		return writePNG(path, rgba, width, height);
+	if (type == "ppm")
+		return writePPM(path, rgba, width, height);
+	return false;
+}
+
+bool isImageFormatSupported(const std::string& path)
+{
+	std::string type = extension(path);
+	return type == "png" || type == "ppm";
+}
@@ -0,0 +1,15 @@
+#ifndef IMAGEFILE_H
+#define IMAGEFILE_H
+
+#include <string>
+
+// Writes width * height RGBA8 pixels, row-major and top row first. The
+// format follows the extension of path: .png (uncompressed deflate, no
+// external library needed) or .ppm (binary P6, alpha dropped).
+// Returns false for other extensions or when the file cannot be written.
+bool writeImage(const std::string& path, const unsigned char* rgba, int width, int height);
+
+// True if writeImage knows the extension of path
+bool isImageFormatSupported(const std::string& path);
+
+#endif // IMAGEFILE_H
@@ -0,0 +1,243 @@
+#include "Integrator.h"
+
+#include <algorithm>
+#include <vector>
+
+// Seen by secondary rays that leave the scene
+static const Color background = Color::fromSRGB8(20, 20, 20);
+
+// Uniform float in [0, 1) from a xorshift state
+static float nextRandom(unsigned& seed)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Primary hits, read in place; path i shades entry i of the batch
+struct PrimaryPaths
+{
+	const Intersection* hits;
+
+	const float* throughputs;
+
+	const Intersection& hit(int i) const
+	{
+		return hits[i];
+	}
+
+	float throughput(int i) const
+	{
+		return throughputs[i];
+	}
+
+	int owner(int i) const
+	{
+		return i;
+	}
+};
+
+// Paths after the first bounce
+struct SecondaryPaths
+{
+	const Intersection* hits;
+
+	const float* throughputs;
+
+	const int* owners;
+
+	const Intersection& hit(int i) const
+	{
+		return hits[i];
+	}
+
+	float throughput(int i) const
+	{
+		return throughputs[i];
+	}
+
+	int owner(int i) const
+	{
+		return owners[i];
+	}
+};
+
+// Orders the paths in active by material with a counting sort over the
+// range of ids they use, which keeps the screen order of the rays within
+// each group. Afterwards groupEnds[id - lowest] is the end of the group of
+// id in order, and lowest is returned.
+template <typename Paths>
+static MaterialId groupByMaterial(const Paths& paths, const std::vector<int>& active,
+	std::vector<int>& order, std::vector<int>& groupEnds)
+{
+	MaterialId lowest = paths.hit(active[0]).material;
+	MaterialId highest = lowest;
+	for (size_t i = 1; i < active.size(); i++)
+	{
+		lowest = std::min(lowest, paths.hit(active[i]).material);
+		highest = std::max(highest, paths.hit(active[i]).material);
+	}
+
+	groupEnds.assign(highest - lowest + 1, 0);
+	if (lowest == highest)
+	{
+		// One group, already in order
+		groupEnds[0] = (int)active.size();
+		order = active;
+		return lowest;
+	}
+
+	for (size_t i = 0; i < active.size(); i++)
+		groupEnds[paths.hit(active[i]).material - lowest]++;
+	int start = 0;
+	for (size_t group = 0; group < groupEnds.size(); group++)
+	{
+		int size = groupEnds[group];
+		groupEnds[group] = start;
+		start += size;
+	}
+
+	order.resize(active.size());
+	for (size_t i = 0; i < active.size(); i++)
+		order[groupEnds[paths.hit(active[i]).material - lowest]++] = active[i];
+	return lowest;
+}
+
+// Adds the surface colour of the paths listed in group, scaled by their
+// throughput times weight, to the entries of colors they shade
+template <typename Paths>
+static void addSurfaceColor(const MaterialTable& materials, const Material& material,
+	const Paths& paths, const int* group, int count, float weight, Color* colors)
+{
+	if (material.texture >= 0)
+	{
+		const CheckerTexture& texture = materials.getTexture(material.texture);
+		for (int i = 0; i < count; i++)
+		{
+			int path = group[i];
+			colors[paths.owner(path)] += texture.at(paths.hit(path).position()) * (weight * paths.throughput(path));
+		}
+	}
+	else
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int path = group[i];
+			colors[paths.owner(path)] += material.diffuse * (weight * paths.throughput(path));
+		}
+	}
+}
+
+// One bounce of the paths in active: each material group ends its paths
+// at the surface colour or passes them on to output
+template <typename Paths>
+static void scatter(const MaterialTable& materials, const Paths& paths, const std::vector<int>& active,
+	std::vector<int>& order, std::vector<int>& groupEnds, Color* colors, PathArrays& output)
+{
+	MaterialId lowest = groupByMaterial(paths, active, order, groupEnds);
+
+	int first = 0;
+	for (size_t group = 0; group < groupEnds.size(); group++)
+	{
+		const int* members = order.data() + first;
+		int size = groupEnds[group] - first;
+		first = groupEnds[group];
+		if (size == 0)
+			continue;
+
+		const Material& material = materials[(MaterialId)(lowest + group)];
+		if (material.ior > 0.0f)
+		{
+			for (int i = 0; i < size; i++)
+			{
+				const Intersection& hit = paths.hit(members[i]);
+				output.add(hit.pShape->makeRefractionRay(hit, material.ior),
+					paths.throughput(members[i]), paths.owner(members[i]));
+			}
+			continue;
+		}
+
+		// What is not reflected ends at the surface colour
+		if (material.reflectivity < 1.0f)
+			addSurfaceColor(materials, material, paths, members, size, 1.0f - material.reflectivity, colors);
+
+		if (material.reflectivity > 0.0f)
+		{
+			for (int i = 0; i < size; i++)
+			{
+				const Intersection& hit = paths.hit(members[i]);
+				output.add(hit.pShape->makeReflectedRay(hit),
+					paths.throughput(members[i]) * material.reflectivity, paths.owner(members[i]));
+			}
+		}
+	}
+}
+
+Integrator::Integrator(int maxDepth, float minThroughput, int rouletteDepth)
+	: maxDepth(maxDepth),
+	minThroughput(minThroughput),
+	rouletteDepth(rouletteDepth)
+{
+}
+
+void Integrator::shade(const Shape* scene, const MaterialTable& materials,
+	const Intersection* hits, const Ray* shadows, unsigned* seeds,
+	int count, Color* colors, ShadingBuffers& buffers) const
+{
+	std::vector<float>& throughputs = buffers.throughputs;
+	std::vector<int>& active = buffers.active;
+	throughputs.resize(count);
+	active.clear();
+	for (int i = 0; i < count; i++)
+	{
+		colors[i] = Color();
+		throughputs[i] = hits[i].pShape->lighting(hits[i], shadows[i]);
+		if (throughputs[i] > 0.0f)
+			active.push_back(i);
+	}
+	if (active.empty())
+		return;
+
+	// The paths of the next bounce are traced into current
+	PathArrays& current = buffers.current;
+	PathArrays& next = buffers.next;
+	next.clear();
+	PrimaryPaths primary = { hits, throughputs.data() };
+	scatter(materials, primary, active, buffers.order, buffers.groupEnds, colors, next);
+
+	for (int depth = 1; depth < maxDepth && !next.hits.empty(); depth++)
+	{
+		std::swap(current, next);
+		next.clear();
+		active.clear();
+		for (size_t i = 0; i < current.hits.size(); i++)
+		{
+			float& throughput = current.throughputs[i];
+			int owner = current.owners[i];
+
+			// Past the roulette depth a path survives with a probability
+			// that follows its throughput, survivors are weighted up to
+			// compensate
+			if (depth >= rouletteDepth)
+			{
+				float survival = throughput < 1.0f ? throughput : 1.0f;
+				if (nextRandom(seeds[owner]) >= survival)
+					continue;
+				throughput /= survival;
+			}
+
+			if (!scene->intersect(current.hits[i]))
+				colors[owner] += background * throughput;
+			else if (throughput >= minThroughput)
+				active.push_back((int)i);
+		}
+		if (active.empty())
+			break;
+
+		SecondaryPaths paths = { current.hits.data(), current.throughputs.data(), current.owners.data() };
+		scatter(materials, paths, active, buffers.order, buffers.groupEnds, colors, next);
+	}
+
+	// Paths cut short carry no light
+}
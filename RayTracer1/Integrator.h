@@ -0,0 +1,91 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <vector>
+#include "Color.h"
+#include "Material.h"
+#include "Shape.h"
+
+// Default number of surfaces a path may visit, including the primary hit
+#define INTEGRATOR_MAX_DEPTH 8
+
+// Default throughput below which a path ends at its next surface instead
+// of being shaded. Primary hits are always shaded: in linear light even a
+// dim lit surface shows after the sRGB encode and any exposure.
+#define INTEGRATOR_MIN_THROUGHPUT (1.0f / 256.0f)
+
+// Default number of bounces before Russian roulette starts
+#define INTEGRATOR_ROULETTE_DEPTH 3
+
+// Paths leaving a bounce, each with the ray it continues along in hits;
+// owners are the entries of the batch the paths shade
+struct PathArrays
+{
+	std::vector<Intersection> hits;
+
+	std::vector<float> throughputs;
+
+	std::vector<int> owners;
+
+	void add(const Ray& ray, float throughput, int owner)
+	{
+		hits.push_back(Intersection(ray));
+		throughputs.push_back(throughput);
+		owners.push_back(owner);
+	}
+
+	void clear()
+	{
+		hits.clear();
+		throughputs.clear();
+		owners.clear();
+	}
+};
+
+// Working memory of Integrator::shade. Kept by the caller, one per
+// thread, so that shading a batch does not allocate.
+struct ShadingBuffers
+{
+	std::vector<float> throughputs;
+
+	// Paths still going, and the same grouped by material
+	std::vector<int> active;
+	std::vector<int> order;
+
+	std::vector<int> groupEnds;
+
+	PathArrays current;
+	PathArrays next;
+};
+
+// Follows the paths leaving primary hits as an explicit loop, so the cost
+// of a pixel is bounded by maxDepth no matter how the mirrors are arranged.
+// The paths of a batch advance one bounce at a time. At every bounce they
+// are grouped by material, and each group runs the code of its kind of
+// material with the branches taken once for the whole group.
+class Integrator
+{
+protected:
+
+	int maxDepth;
+
+	float minThroughput;
+
+	int rouletteDepth;
+
+public:
+
+	Integrator(int maxDepth = INTEGRATOR_MAX_DEPTH,
+		float minThroughput = INTEGRATOR_MIN_THROUGHPUT,
+		int rouletteDepth = INTEGRATOR_ROULETTE_DEPTH);
+
+	// Linear radiance of count primary hits that the light reaches through
+	// the given shadow rays, into colors. seeds[i] is the random state of
+	// the pixel of hits[i] for Russian roulette and is advanced by the
+	// call. The hits' materials index materials.
+	void shade(const Shape* scene, const MaterialTable& materials,
+		const Intersection* hits, const Ray* shadows, unsigned* seeds,
+		int count, Color* colors, ShadingBuffers& buffers) const;
+};
+
+#endif // INTEGRATOR_H
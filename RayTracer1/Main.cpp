@@ -1,140 +1,118 @@
-#include <SFML\Graphics.hpp>
-#include <SFML\Window.hpp>
-#include <thread>
-#include <mutex>
 #include "Camera.h"
+#include "ImageFile.h"
+#include "Options.h"
+#include "Renderer.h"
+#include "Scene.h"
 #include "Shape.h"
 #include "Vector3.h"
 #include "Vector2.h"
 //#include "Maths.h"
 #include "Ray.h"
-#define PI 3.1415926f
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Rendered when no --scene is given
+static const char* defaultScene =
+	"camera -5 1 0  0 1 0  0 1 0  25\n"
+	"light -6 10 5\n"
+	"material floor checker\n"
+	"material red diffuse 255 0 0\n"
+	"material mirror mirror\n"
+	"plane 0 0 0  0 1 0  floor\n"
+	"sphere 2 1 -1  1  red\n"
+	"sphere 5.5 1 1.5  1  mirror\n";
 
-void rayTrace(sf::Image& image, Camera* camera, Shape* scene, int width, int height, Light light_source)
+int main(int argc, char* argv[])
 {
-	for (int x = 0; x < width; x++)
+	RenderOptions options;
+	std::string error;
+	if (!parseOptions(argc, argv, options, error))
 	{
-		for (int y = 0; y < height; y++)
-		{
-			Vector2 screenCoord((2.0f * x) / width - 1.0f,
-				(-2.0f * y) / height + 1.0f);
-
-			Ray ray = camera->makeRay(screenCoord);
-
-			Intersection intersection(ray);
-						
-			if (scene->intersect(intersection))
-			{				
-				Ray shadow_ray = scene->makeRay(intersection, light_source);
-				Intersection shadow(shadow_ray);
-				if (scene->intersect(shadow))
-				{
-					intersection.color = sf::Color::Black;
-				}
-				else
-				{
-					scene->setColor(intersection, scene, shadow, light_source);	
-				}	
-				image.setPixel(x, y, intersection.color);
-			}
-			else
-			{
-				image.setPixel(x, y,sf::Color::Black);
-			}
-		}
+		std::fprintf(stderr, "%s: %s\n", argv[0], error.c_str());
+		printUsage(stderr, argv[0]);
+		return 2;
 	}
-}
-
-std::mutex mutex;
-
-struct Job
-{
-	sf::Image& image;
-	Camera* camera;
-	Shape* scene;
-	int width;
-	int height;
-	Light light_source;
-	int x;
-};
-
-void Render(Job the_job)
-{
-	for (the_job.x; the_job.x < the_job.width; the_job.x += 4)
+	if (options.help)
 	{
-		for (int y = 0; y < the_job.height; y++)
-		{
-
-			Vector2 screenCoord((2.0f * the_job.x) / the_job.width - 1.0f,
-				(-2.0f * y) / the_job.height + 1.0f);
+		printUsage(stdout, argv[0]);
+		return 0;
+	}
+	if (!isImageFormatSupported(options.outputPath))
+	{
+		std::fprintf(stderr, "%s: %s: output must be a .png or .ppm file\n", argv[0], options.outputPath.c_str());
+		return 2;
+	}
+	if (options.simdLevel >= 0)
+		setSimdLevel((SimdLevel)options.simdLevel);
+	setBVHWidth(options.bvhWidth);
+	setBVHCompression(options.compressBVH);
+
+	// Mesh files are already parsed on the render threads
+	ThreadPool pool(options.threads);
+
+	std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+	Scene scene(pool);
+	std::string cachePath;
+	if (!options.noCache)
+		cachePath = options.cachePath.empty() ? options.scenePath + ".cache" : options.cachePath;
+
+	bool loaded = options.scenePath.empty()
+		? scene.parse(defaultScene, std::strlen(defaultScene), "built-in scene", error)
+		: scene.load(options.scenePath, error, cachePath);
+	if (!loaded)
+	{
+		std::fprintf(stderr, "%s: %s\n", argv[0], error.c_str());
+		return 1;
+	}
+	std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+	if (scene.getCacheStatus() == SCENE_CACHE_WRITE_FAILED)
+		std::fprintf(stderr, "%s: warning: cannot write scene cache %s\n", argv[0], cachePath.c_str());
 
-			Ray ray = the_job.camera->makeRay(screenCoord);
+	int width = options.width;
+	int height = options.height;
+	PerspectiveCamera camera = scene.makeCamera((float)width / (float)height);
 
-			Intersection intersection(ray);
+	Renderer renderer(pool, Integrator(options.maxDepth), options.tileSize);
 
-			if (the_job.scene->intersect(intersection))
-			{
-				Ray shadow_ray = the_job.scene->makeRay(intersection, the_job.light_source);
-				Intersection shadow(shadow_ray);
-				if (the_job.scene->intersect(shadow))
-				{
-					intersection.color = sf::Color::Black;
-				}
-				else
-				{
-					mutex.lock();
+	if (options.verbose)
+	{
+		static const char* cacheNames[] = { "", ", cache not used", " from the cache", ", cache written", ", cache not written" };
+		std::fprintf(stderr, "%d planes, %d spheres and %d triangles in %d meshes",
+			scene.getPlaneCount(), scene.getSphereCount(), scene.getTriangleCount(), scene.getMeshCount());
+		if (scene.getInstanceCount() > 0)
+			std::fprintf(stderr, ", %d instances of %d objects", scene.getInstanceCount(), scene.getObjectCount());
+		std::fprintf(stderr, " loaded in %.3f s%s\n", loadTime.count(),
+			options.scenePath.empty() ? "" : cacheNames[scene.getCacheStatus() + 1]);
+		std::fprintf(stderr, "acceleration structures take %.1f MB", scene.getBVHMemory() / 1048576.0);
+		if (scene.getBuildTime() > 0.0)
+			std::fprintf(stderr, ", built in %.3f s", scene.getBuildTime());
+		std::fprintf(stderr, "\n");
+		std::fprintf(stderr, "%dx%d, %d spp, depth %d, %u threads, %dpx tiles, %s, %d-wide%s BVH\n",
+			width, height, options.samples, options.maxDepth, pool.size(),
+			options.tileSize, simdLevelName(simdLevel()), bvhWidth(),
+			bvhCompression() ? " compressed" : "");
+	}
 
-					the_job.scene->setColor(intersection, the_job.scene, shadow, the_job.light_source);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < options.samples; i++)
+		renderer.render(&camera, &scene.getShapes(), scene.getMaterials(), width, height, scene.getLight());
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-					mutex.unlock();
-				}
+	if (options.verbose)
+	{
+		std::fprintf(stderr, "rendered in %.3f s (%.2f Mrays/s primary)\n", elapsed.count(),
+			(double)width * height * options.samples / elapsed.count() * 1e-6);
+	}
 
-				the_job.image.setPixel(the_job.x, y, intersection.color);
-			}
-			else
-			{
-				the_job.image.setPixel(the_job.x, y, sf::Color::Black);
-			}
-		}
+	std::vector<unsigned char> rgba(4 * (size_t)width * height);
+	renderer.getFramebuffer().toRGBA8(&rgba[0], options.toneMap);
+	if (!writeImage(options.outputPath, &rgba[0], width, height))
+	{
+		std::fprintf(stderr, "%s: cannot write %s\n", argv[0], options.outputPath.c_str());
+		return 1;
 	}
+	return 0;
 }
-
-int main(int argc, char* argv[])
-{
-    int width = 800;
-    int height = 640;
-    sf::Image image;
-    image.create(width, height, sf::Color::Yellow);
-	PerspectiveCamera camera(Point(-5.0f, 1.0f, 0.0f),
-		Vector(0.0f, 1.0f, 0.0f), Vector(0.0f, 1.0f, 0.0f), 25.0f * PI / 180.0f,
-		(float)width / (float)height);
-
-	ShapeSet scene;
-
-	Plane floor(Point(0.0f, 0.0f, 0.0f), Vector(0.0f, 1.0f, 0.0f), 1);
-	scene.addShape(&floor);
-	Sphere sphere(Point(2.0f, 1.0f, -1.0f), 1.0f, sf::Color(255,0,0), 1);
-	scene.addShape(&sphere);
-	Sphere sphere1(Point(5.5f, 1.0f, 1.5f), 1.0f, sf::Color(0,0,255), 2);
-	scene.addShape(&sphere1);
-
-	Light light_source(Point(-6.0f,10.0f,5.0f));
-
-	rayTrace(image, &camera, &scene, width, height, light_source);
-
-	/*std::thread thread1 = std::thread(Render, Job{ image, &camera, &scene, width, height, light_source,0 });
-	std::thread thread2 = std::thread(Render, Job{ image, &camera, &scene, width, height, light_source,1 });
-	std::thread thread3 = std::thread(Render, Job{ image, &camera, &scene, width, height, light_source,2 });
-	std::thread thread4 = std::thread(Render, Job{ image, &camera, &scene, width, height, light_source,3 });
-
-	thread1.join();
-	thread2.join();
-	thread3.join();
-	thread4.join();*/
-
-
-    if (!image.saveToFile("result.png"))
-        return -1;
-
-}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are loaded by the
+// operating system on first access and shared between processes that
+// map the same file, so large data can be used in place without reading
+// or copying it.
+class MappedFile
+{
+protected:
+
+	const unsigned char* data;
+
+	size_t size;
+
+#ifdef _WIN32
+	void* file;
+
+	void* mapping;
+#endif
+
+public:
+
+	MappedFile();
+
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+
+	MappedFile& operator =(const MappedFile&) = delete;
+
+	// Maps path, closing any previous mapping first. Returns false if the
+	// file cannot be opened or is empty.
+	bool open(const std::string& path);
+
+	void close();
+
+	bool isOpen() const;
+
+	const unsigned char* getData() const;
+
+	size_t getSize() const;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,66 @@
+#include "Material.h"
+
+Material Material::makeDiffuse(const Color& color)
+{
+	Material material;
+	material.diffuse = color;
+	material.reflectivity = 0.0f;
+	material.ior = 0.0f;
+	material.texture = -1;
+	return material;
+}
+
+Material Material::makeMirror(float reflectivity)
+{
+	Material material = makeDiffuse(Color());
+	material.reflectivity = reflectivity;
+	return material;
+}
+
+Material Material::makeGlass(float ior)
+{
+	Material material = makeDiffuse(Color());
+	material.ior = ior;
+	return material;
+}
+
+Material Material::makeTextured(int texture)
+{
+	Material material = makeDiffuse(Color());
+	material.texture = texture;
+	return material;
+}
+
+MaterialTable::MaterialTable()
+{
+	clear();
+}
+
+MaterialId MaterialTable::add(const Material& material)
+{
+	materials.push_back(material);
+	return (MaterialId)(materials.size() - 1);
+}
+
+int MaterialTable::addTexture(const CheckerTexture& texture)
+{
+	textures.push_back(texture);
+	return (int)textures.size() - 1;
+}
+
+void MaterialTable::clear()
+{
+	materials.clear();
+	textures.clear();
+	materials.push_back(Material::makeDiffuse(Color::fromSRGB8(0, 255, 0)));
+}
+
+int MaterialTable::size() const
+{
+	return (int)materials.size();
+}
+
+int MaterialTable::getTextureCount() const
+{
+	return (int)textures.size();
+}
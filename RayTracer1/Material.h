@@ -0,0 +1,113 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <cstdint>
+#include <vector>
+#include "Color.h"
+#include "Vector3.h"
+
+// Index of a Material in a MaterialTable, stored on every shape and hit
+typedef uint16_t MaterialId;
+
+// Entry 0 of every table, drawn bright green; shapes made without a
+// material, e.g. instances that keep their object's ones, carry it
+#define MATERIAL_NONE 0
+
+// Largest number of materials a table holds
+#define MATERIAL_MAX_COUNT 65536
+
+// Same as (int)std::round(value) for |value| < 2^31, without the library
+// call: the fraction left after truncating is exact
+inline int roundToInt(float value)
+{
+	int truncated = (int)value;
+	float fraction = value - (float)truncated;
+	return truncated + (fraction >= 0.5f) - (fraction <= -0.5f);
+}
+
+// Squares of two colours on the x-z plane, centred on the multiples of
+// cellSize
+struct CheckerTexture
+{
+	Color dark;
+
+	Color light;
+
+	float cellSize;
+
+	// dark where the cells' x and z numbers are both even or both odd
+	Color at(const Point& position) const
+	{
+		int x = roundToInt(position.x / cellSize);
+		int z = roundToInt(position.z / cellSize);
+		return ((x ^ z) & 1) ? light : dark;
+	}
+};
+
+// What a surface does with the light of a path. Refraction takes
+// precedence over reflection: with ior > 0 the path passes through the
+// surface. Otherwise the fraction reflectivity continues as the mirror
+// reflection and the rest ends at the surface colour.
+struct Material
+{
+	// Linear surface colour, used where there is no texture
+	Color diffuse;
+
+	float reflectivity;
+
+	// Index of refraction of the inside, 0 for opaque surfaces
+	float ior;
+
+	// Index into the table's textures, -1 for none
+	int texture;
+
+	static Material makeDiffuse(const Color& color);
+
+	static Material makeMirror(float reflectivity = 1.0f);
+
+	static Material makeGlass(float ior);
+
+	static Material makeTextured(int texture);
+};
+
+// All materials of a scene, indexed by the MaterialId on each shape, so
+// adding a kind of material does not touch the shape classes. Shading
+// only reads the table.
+class MaterialTable
+{
+protected:
+
+	std::vector<Material> materials;
+
+	std::vector<CheckerTexture> textures;
+
+public:
+
+	// Holds only MATERIAL_NONE
+	MaterialTable();
+
+	// Returns the id of the new entry; the table must not be full
+	MaterialId add(const Material& material);
+
+	// Returns the index for Material::texture
+	int addTexture(const CheckerTexture& texture);
+
+	// Back to only MATERIAL_NONE
+	void clear();
+
+	int size() const;
+
+	int getTextureCount() const;
+
+	const Material& operator [](MaterialId id) const
+	{
+		return materials[id];
+	}
+
+	const CheckerTexture& getTexture(int index) const
+	{
+		return textures[index];
+	}
+};
+
+#endif // MATERIAL_H
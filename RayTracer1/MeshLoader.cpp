@@ -0,0 +1,806 @@
+#include "MeshLoader.h"
+#include "MappedFile.h"
+#include "Shape.h"
+#include "TextCursor.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace
+{
+	// Chunks are at least this large so small files are not split up
+	const size_t minChunkSize = 1 << 20;
+
+	// Several chunks per worker let stealing even out uneven chunks
+	const int chunksPerWorker = 4;
+
+	// Largest mesh whose index list still fits in an int
+	const long long maxTriangles = INT_MAX / 3;
+
+	int chunkCount(size_t bytes, const ThreadPool& pool)
+	{
+		size_t count = bytes / minChunkSize;
+		size_t limit = (size_t)pool.size() * chunksPerWorker;
+		return (int)std::max<size_t>(1, std::min(count, limit));
+	}
+
+	std::string lineError(const std::string& path, int line, const char* message)
+	{
+		char number[16];
+		std::snprintf(number, sizeof(number), "%d", line);
+		return path + ":" + number + ": " + message;
+	}
+
+	bool hasExtension(const std::string& path, const char* extension)
+	{
+		size_t length = std::strlen(extension);
+		if (path.size() < length)
+			return false;
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = path[path.size() - length + i];
+			if (c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			if (c != extension[i])
+				return false;
+		}
+		return true;
+	}
+
+	// OBJ
+
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+
+		// Counted by the first pass
+		int lines;
+		long long vertices;
+		long long triangles;
+
+		// Where the chunk starts in the whole file
+		int firstLine;
+		int firstVertex;
+		int firstTriangle;
+
+		// First problem found, errorLine counts from the chunk's first line
+		const char* errorMessage;
+		int errorLine;
+	};
+
+	void setError(ObjChunk& chunk, const TextCursor& cursor, const char* message)
+	{
+		if (!chunk.errorMessage)
+		{
+			chunk.errorMessage = message;
+			chunk.errorLine = cursor.line;
+		}
+	}
+
+	void nextLine(TextCursor& cursor)
+	{
+		skipLine(cursor);
+		if (cursor.pos < cursor.end)
+		{
+			cursor.pos++;
+			cursor.line++;
+		}
+	}
+
+	void countObj(ObjChunk& chunk)
+	{
+		TextCursor cursor = { chunk.begin, chunk.end, 0 };
+		while (cursor.pos < cursor.end)
+		{
+			const char* word;
+			size_t length = readWord(cursor, word);
+			if (length == 1 && word[0] == 'v')
+			{
+				chunk.vertices++;
+			}
+			else if (length == 1 && word[0] == 'f')
+			{
+				int corners = 0;
+				while (readWord(cursor, word) > 0)
+					corners++;
+				if (corners < 3)
+					setError(chunk, cursor, "a face needs at least three vertices");
+				else
+					chunk.triangles += corners - 2;
+			}
+			nextLine(cursor);
+		}
+		chunk.lines = cursor.line;
+	}
+
+	// Vertex number of a face corner ("v", "v/vt", "v//vn" or "v/vt/vn"),
+	// converted to an index into the vertices. Negative numbers count back
+	// from defined, the number of vertices read so far.
+	bool readCorner(TextCursor& cursor, int defined, int vertexCount, int& index)
+	{
+		const char* p = cursor.pos;
+		bool negative = false;
+		if (p < cursor.end && *p == '-')
+		{
+			negative = true;
+			p++;
+		}
+		if (p == cursor.end || !isDigit(*p))
+			return false;
+
+		long long number = 0;
+		for (; p < cursor.end && isDigit(*p); p++)
+		{
+			if (number <= INT_MAX)
+				number = number * 10 + (*p - '0');
+		}
+		if (p < cursor.end && *p != '/')
+		{
+			cursor.pos = p;
+			if (!isWordEnd(cursor))
+				return false;
+		}
+
+		// Texture and normal numbers are not used
+		cursor.pos = p;
+		while (!isWordEnd(cursor))
+			cursor.pos++;
+
+		long long result = negative ? defined - number : number - 1;
+		if (number == 0 || result < 0 || result >= vertexCount)
+			return false;
+		index = (int)result;
+		return true;
+	}
+
+	void parseObj(ObjChunk& chunk, Point* vertices, int* indices, int vertexCount)
+	{
+		TextCursor cursor = { chunk.begin, chunk.end, 0 };
+		int vertex = chunk.firstVertex;
+		int* triangle = indices + 3 * (size_t)chunk.firstTriangle;
+
+		while (cursor.pos < cursor.end)
+		{
+			const char* word;
+			size_t length = readWord(cursor, word);
+			if (length == 1 && word[0] == 'v')
+			{
+				// An optional w or vertex colour may follow
+				Point& position = vertices[vertex++];
+				if (!readFloat(cursor, position.x) || !readFloat(cursor, position.y)
+					|| !readFloat(cursor, position.z))
+				{
+					setError(chunk, cursor, "malformed vertex");
+					return;
+				}
+			}
+			else if (length == 1 && word[0] == 'f')
+			{
+				// Polygons are split into a fan around their first corner
+				int first = 0;
+				int previous = 0;
+				for (int corner = 0; ; corner++)
+				{
+					skipBlanks(cursor);
+					if (cursor.pos == cursor.end || *cursor.pos == '\n')
+						break;
+
+					int index;
+					if (!readCorner(cursor, vertex, vertexCount, index))
+					{
+						setError(chunk, cursor, "malformed face or vertex out of range");
+						return;
+					}
+					if (corner == 0)
+						first = index;
+					else if (corner >= 2)
+					{
+						triangle[0] = first;
+						triangle[1] = previous;
+						triangle[2] = index;
+						triangle += 3;
+					}
+					previous = index;
+				}
+			}
+			nextLine(cursor);
+		}
+	}
+
+	bool loadObj(const std::string& path, const MappedFile& file, ThreadPool& pool, Mesh& mesh,
+		std::string& error)
+	{
+		const char* text = (const char*)file.getData();
+		size_t size = file.getSize();
+		const char* end = text + size;
+
+		// Every chunk starts at the beginning of a line
+		int count = chunkCount(size, pool);
+		std::vector<ObjChunk> chunks(count);
+		for (int i = 0; i < count; i++)
+		{
+			ObjChunk& chunk = chunks[i];
+			std::memset(&chunk, 0, sizeof(chunk));
+			if (i == 0)
+			{
+				chunk.begin = text;
+			}
+			else
+			{
+				const char* split = text + (size_t)((unsigned long long)size * i / count) - 1;
+				split = std::max(split, chunks[i - 1].begin);
+				const char* lineEnd = (const char*)std::memchr(split, '\n', end - split);
+				chunk.begin = lineEnd ? lineEnd + 1 : end;
+				chunks[i - 1].end = chunk.begin;
+			}
+		}
+		chunks[count - 1].end = end;
+
+		pool.parallelFor(count, [&](int index, unsigned worker)
+		{
+			countObj(chunks[index]);
+		});
+
+		long long lines = 1;
+		long long vertices = 0;
+		long long triangles = 0;
+		for (int i = 0; i < count; i++)
+		{
+			ObjChunk& chunk = chunks[i];
+			chunk.firstLine = (int)std::min<long long>(lines, INT_MAX);
+			chunk.firstVertex = (int)std::min<long long>(vertices, INT_MAX);
+			chunk.firstTriangle = (int)std::min<long long>(triangles, INT_MAX);
+			if (chunk.errorMessage)
+			{
+				error = lineError(path, chunk.firstLine + chunk.errorLine, chunk.errorMessage);
+				return false;
+			}
+			lines += chunk.lines;
+			vertices += chunk.vertices;
+			triangles += chunk.triangles;
+		}
+		if (vertices > INT_MAX || triangles > maxTriangles)
+		{
+			error = path + ": too many vertices or triangles";
+			return false;
+		}
+		if (triangles == 0)
+		{
+			error = path + ": the file has no faces";
+			return false;
+		}
+
+		mesh.resize((int)vertices, (int)triangles);
+		Point* vertexData = mesh.getVertexData();
+		int* indexData = mesh.getIndexData();
+		pool.parallelFor(count, [&](int index, unsigned worker)
+		{
+			parseObj(chunks[index], vertexData, indexData, (int)vertices);
+		});
+
+		for (int i = 0; i < count; i++)
+		{
+			if (chunks[i].errorMessage)
+			{
+				error = lineError(path, chunks[i].firstLine + chunks[i].errorLine, chunks[i].errorMessage);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// PLY
+
+	enum PlyType
+	{
+		PLY_NONE,
+		PLY_INT8,
+		PLY_UINT8,
+		PLY_INT16,
+		PLY_UINT16,
+		PLY_INT32,
+		PLY_UINT32,
+		PLY_FLOAT32,
+		PLY_FLOAT64
+	};
+
+	struct PlyProperty
+	{
+		std::string name;
+
+		PlyType type;
+
+		// Type of the length of a list property, PLY_NONE for scalars
+		PlyType countType;
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+
+		int count;
+
+		std::vector<PlyProperty> properties;
+	};
+
+	PlyType plyType(const char* word, size_t length)
+	{
+		static const struct { const char* name; PlyType type; } names[] = {
+			{ "char", PLY_INT8 }, { "int8", PLY_INT8 },
+			{ "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+			{ "short", PLY_INT16 }, { "int16", PLY_INT16 },
+			{ "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+			{ "int", PLY_INT32 }, { "int32", PLY_INT32 },
+			{ "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+			{ "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 },
+			{ "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+		};
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		{
+			if (isKeyword(word, length, names[i].name))
+				return names[i].type;
+		}
+		return PLY_NONE;
+	}
+
+	int plySize(PlyType type)
+	{
+		static const int sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+		return sizes[type];
+	}
+
+	// One value of the given type, byte swapped if the file's byte order
+	// differs from the machine's
+	double readScalar(const unsigned char* p, PlyType type, bool swap)
+	{
+		unsigned char bytes[8];
+		int size = plySize(type);
+		for (int i = 0; i < size; i++)
+			bytes[i] = p[swap ? size - 1 - i : i];
+
+		switch (type)
+		{
+		case PLY_INT8: { int8_t value; std::memcpy(&value, bytes, 1); return value; }
+		case PLY_UINT8: { uint8_t value; std::memcpy(&value, bytes, 1); return value; }
+		case PLY_INT16: { int16_t value; std::memcpy(&value, bytes, 2); return value; }
+		case PLY_UINT16: { uint16_t value; std::memcpy(&value, bytes, 2); return value; }
+		case PLY_INT32: { int32_t value; std::memcpy(&value, bytes, 4); return value; }
+		case PLY_UINT32: { uint32_t value; std::memcpy(&value, bytes, 4); return value; }
+		case PLY_FLOAT32: { float value; std::memcpy(&value, bytes, 4); return value; }
+		case PLY_FLOAT64: { double value; std::memcpy(&value, bytes, 8); return value; }
+		default: return 0.0;
+		}
+	}
+
+	bool isLittleEndian()
+	{
+		uint16_t probe = 1;
+		unsigned char first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
+
+	bool parsePlyHeader(const MappedFile& file, std::vector<PlyElement>& elements, bool& swap,
+		size_t& dataOffset, std::string& message)
+	{
+		const char* text = (const char*)file.getData();
+		TextCursor cursor = { text, text + file.getSize(), 1 };
+
+		const char* word;
+		size_t length = readWord(cursor, word);
+		if (!isKeyword(word, length, "ply") || !readLineEnd(cursor))
+		{
+			message = "not a PLY file";
+			return false;
+		}
+
+		bool hasFormat = false;
+		while (cursor.pos < cursor.end)
+		{
+			length = readWord(cursor, word);
+			if (isKeyword(word, length, "end_header"))
+			{
+				if (!hasFormat || !readLineEnd(cursor))
+					break;
+				dataOffset = cursor.pos - text;
+				return true;
+			}
+			else if (isKeyword(word, length, "format"))
+			{
+				length = readWord(cursor, word);
+				if (isKeyword(word, length, "binary_little_endian"))
+					swap = !isLittleEndian();
+				else if (isKeyword(word, length, "binary_big_endian"))
+					swap = isLittleEndian();
+				else
+				{
+					message = "only binary PLY files are supported";
+					return false;
+				}
+				hasFormat = true;
+			}
+			else if (isKeyword(word, length, "element"))
+			{
+				PlyElement element;
+				length = readWord(cursor, word);
+				element.name.assign(word, length);
+				if (length == 0 || !readInt(cursor, element.count) || element.count < 0)
+					break;
+				elements.push_back(element);
+			}
+			else if (isKeyword(word, length, "property"))
+			{
+				if (elements.empty())
+					break;
+				PlyProperty property;
+				property.countType = PLY_NONE;
+				length = readWord(cursor, word);
+				if (isKeyword(word, length, "list"))
+				{
+					length = readWord(cursor, word);
+					property.countType = plyType(word, length);
+					length = readWord(cursor, word);
+					if (property.countType == PLY_NONE || property.countType >= PLY_FLOAT32)
+						break;
+				}
+				property.type = plyType(word, length);
+				length = readWord(cursor, word);
+				property.name.assign(word, length);
+				if (property.type == PLY_NONE || length == 0)
+					break;
+				elements.back().properties.push_back(property);
+			}
+			else if (!isKeyword(word, length, "comment") && !isKeyword(word, length, "obj_info"))
+			{
+				break;
+			}
+
+			// Comments run to the end of the line
+			skipLine(cursor);
+			if (!readLineEnd(cursor))
+				break;
+		}
+
+		message = "malformed PLY header";
+		return false;
+	}
+
+	struct FaceLayout
+	{
+		// Bytes of the scalar properties around the vertex index list
+		int prefix;
+		int suffix;
+
+		PlyType countType;
+		PlyType indexType;
+	};
+
+	struct FaceChunk
+	{
+		size_t offset;
+		int firstFace;
+		int faceCount;
+		int firstTriangle;
+
+		// Set when a face is not a triangle although all were assumed to be
+		bool irregular;
+
+		const char* errorMessage;
+	};
+
+	// Converts the faces of a chunk into triangles. With assumeTriangles
+	// every face must have three corners, otherwise polygons are split
+	// into fans.
+	void parseFaces(FaceChunk& chunk, const MappedFile& file, const FaceLayout& layout, bool swap,
+		bool assumeTriangles, int vertexCount, int* indices)
+	{
+		const unsigned char* data = file.getData();
+		size_t size = file.getSize();
+		int countSize = plySize(layout.countType);
+		int indexSize = plySize(layout.indexType);
+
+		size_t offset = chunk.offset;
+		int* triangle = indices + 3 * (size_t)chunk.firstTriangle;
+		for (int face = 0; face < chunk.faceCount; face++)
+		{
+			if (offset > size || size - offset < (size_t)(layout.prefix + countSize))
+			{
+				chunk.errorMessage = "unexpected end of file";
+				return;
+			}
+			offset += layout.prefix;
+			double corners = readScalar(data + offset, layout.countType, swap);
+			offset += countSize;
+
+			if (assumeTriangles && corners != 3.0)
+			{
+				chunk.irregular = true;
+				return;
+			}
+			if (corners < 3.0)
+			{
+				chunk.errorMessage = "a face needs at least three vertices";
+				return;
+			}
+			if ((double)(size - offset) < corners * indexSize + layout.suffix)
+			{
+				chunk.errorMessage = "unexpected end of file";
+				return;
+			}
+
+			int first = 0;
+			int previous = 0;
+			for (int corner = 0; corner < (int)corners; corner++)
+			{
+				double value = readScalar(data + offset, layout.indexType, swap);
+				offset += indexSize;
+				if (value < 0.0 || value >= vertexCount)
+				{
+					chunk.errorMessage = "vertex index out of range";
+					return;
+				}
+				int index = (int)value;
+				if (corner == 0)
+					first = index;
+				else if (corner >= 2)
+				{
+					triangle[0] = first;
+					triangle[1] = previous;
+					triangle[2] = index;
+					triangle += 3;
+				}
+				previous = index;
+			}
+			offset += layout.suffix;
+		}
+	}
+
+	bool loadPly(const std::string& path, const MappedFile& file, ThreadPool& pool, Mesh& mesh,
+		std::string& error)
+	{
+		std::vector<PlyElement> elements;
+		bool swap = false;
+		size_t offset = 0;
+		std::string message;
+		if (!parsePlyHeader(file, elements, swap, offset, message))
+		{
+			error = path + ": " + message;
+			return false;
+		}
+
+		// Elements before the faces have fixed size records, which places
+		// the vertices and the start of the faces
+		const PlyElement* vertexElement = NULL;
+		const PlyElement* faceElement = NULL;
+		size_t vertexOffset = 0;
+		size_t vertexStride = 0;
+		int coordinateOffsets[3] = { -1, -1, -1 };
+		PlyType coordinateTypes[3] = { PLY_NONE, PLY_NONE, PLY_NONE };
+		for (size_t i = 0; i < elements.size() && !faceElement; i++)
+		{
+			const PlyElement& element = elements[i];
+			if (element.name == "face")
+			{
+				faceElement = &element;
+				break;
+			}
+
+			size_t stride = 0;
+			for (size_t j = 0; j < element.properties.size(); j++)
+			{
+				const PlyProperty& property = element.properties[j];
+				if (property.countType != PLY_NONE)
+				{
+					error = path + ": list properties of " + element.name + " are not supported";
+					return false;
+				}
+				static const char* axes[3] = { "x", "y", "z" };
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (property.name == axes[axis])
+					{
+						coordinateOffsets[axis] = (int)stride;
+						coordinateTypes[axis] = property.type;
+					}
+				}
+				stride += plySize(property.type);
+			}
+
+			if (element.name == "vertex")
+			{
+				vertexElement = &element;
+				vertexOffset = offset;
+				vertexStride = stride;
+			}
+			if ((size_t)element.count > (file.getSize() - offset) / std::max<size_t>(stride, 1))
+			{
+				error = path + ": unexpected end of file";
+				return false;
+			}
+			offset += element.count * stride;
+		}
+
+		if (!vertexElement || !faceElement
+			|| coordinateOffsets[0] < 0 || coordinateOffsets[1] < 0 || coordinateOffsets[2] < 0)
+		{
+			error = path + ": the file needs vertices with x, y and z followed by faces";
+			return false;
+		}
+
+		FaceLayout layout = { 0, 0, PLY_NONE, PLY_NONE };
+		for (size_t j = 0; j < faceElement->properties.size(); j++)
+		{
+			const PlyProperty& property = faceElement->properties[j];
+			if (property.countType != PLY_NONE && layout.countType == PLY_NONE
+				&& (property.name == "vertex_indices" || property.name == "vertex_index"))
+			{
+				layout.countType = property.countType;
+				layout.indexType = property.type;
+			}
+			else if (property.countType != PLY_NONE)
+			{
+				error = path + ": list property " + property.name + " of face is not supported";
+				return false;
+			}
+			else if (layout.countType == PLY_NONE)
+			{
+				layout.prefix += plySize(property.type);
+			}
+			else
+			{
+				layout.suffix += plySize(property.type);
+			}
+		}
+		if (layout.countType == PLY_NONE || layout.indexType >= PLY_FLOAT32)
+		{
+			error = path + ": faces need an integer vertex_indices list";
+			return false;
+		}
+
+		int vertexCount = vertexElement->count;
+		int faceCount = faceElement->count;
+		if (faceCount == 0)
+		{
+			error = path + ": the file has no faces";
+			return false;
+		}
+		if (faceCount > maxTriangles)
+		{
+			error = path + ": too many faces";
+			return false;
+		}
+
+		// Vertices have fixed size records, so any range can be converted
+		// on its own
+		mesh.resize(vertexCount, faceCount);
+		Point* vertices = mesh.getVertexData();
+		int vertexChunks = chunkCount(vertexCount * vertexStride, pool);
+		pool.parallelFor(vertexChunks, [&](int index, unsigned worker)
+		{
+			int first = (int)((long long)vertexCount * index / vertexChunks);
+			int last = (int)((long long)vertexCount * (index + 1) / vertexChunks);
+			const unsigned char* record = file.getData() + vertexOffset + first * vertexStride;
+			for (int i = first; i < last; i++, record += vertexStride)
+			{
+				vertices[i].x = (float)readScalar(record + coordinateOffsets[0], coordinateTypes[0], swap);
+				vertices[i].y = (float)readScalar(record + coordinateOffsets[1], coordinateTypes[1], swap);
+				vertices[i].z = (float)readScalar(record + coordinateOffsets[2], coordinateTypes[2], swap);
+			}
+		});
+
+		// Faces are usually all triangles, which makes their records fixed
+		// size as well. That is tried first; when a chunk finds another
+		// polygon, one sequential pass over the corner counts places the
+		// chunks instead.
+		size_t triangleStride = layout.prefix + plySize(layout.countType)
+			+ 3 * plySize(layout.indexType) + layout.suffix;
+		int faceChunks = chunkCount((size_t)faceCount * triangleStride, pool);
+		std::vector<FaceChunk> chunks(faceChunks);
+		for (int i = 0; i < faceChunks; i++)
+		{
+			FaceChunk& chunk = chunks[i];
+			std::memset(&chunk, 0, sizeof(chunk));
+			chunk.firstFace = (int)((long long)faceCount * i / faceChunks);
+			chunk.faceCount = (int)((long long)faceCount * (i + 1) / faceChunks) - chunk.firstFace;
+			chunk.offset = offset + chunk.firstFace * triangleStride;
+			chunk.firstTriangle = chunk.firstFace;
+		}
+
+		int* indices = mesh.getIndexData();
+		pool.parallelFor(faceChunks, [&](int index, unsigned worker)
+		{
+			parseFaces(chunks[index], file, layout, swap, true, vertexCount, indices);
+		});
+
+		bool irregular = false;
+		for (int i = 0; i < faceChunks; i++)
+			irregular = irregular || chunks[i].irregular;
+
+		if (irregular)
+		{
+			const unsigned char* data = file.getData();
+			size_t size = file.getSize();
+			int countSize = plySize(layout.countType);
+			int indexSize = plySize(layout.indexType);
+
+			long long triangles = 0;
+			size_t position = offset;
+			int chunk = 0;
+			for (int face = 0; face < faceCount; face++)
+			{
+				if (chunk < faceChunks && chunks[chunk].firstFace == face)
+				{
+					chunks[chunk].offset = position;
+					chunks[chunk].firstTriangle = (int)triangles;
+					chunks[chunk].errorMessage = NULL;
+					chunk++;
+				}
+				if (size - position < (size_t)(layout.prefix + countSize))
+				{
+					error = path + ": unexpected end of file";
+					return false;
+				}
+				double corners = readScalar(data + position + layout.prefix, layout.countType, swap);
+				if (corners < 3.0)
+				{
+					error = path + ": a face needs at least three vertices";
+					return false;
+				}
+				triangles += (long long)corners - 2;
+				position += layout.prefix + countSize + (size_t)corners * indexSize + layout.suffix;
+				if (position > size || triangles > maxTriangles)
+				{
+					error = path + (position > size ? ": unexpected end of file" : ": too many faces");
+					return false;
+				}
+			}
+
+			mesh.resize(vertexCount, (int)triangles);
+			indices = mesh.getIndexData();
+			pool.parallelFor(faceChunks, [&](int index, unsigned worker)
+			{
+				parseFaces(chunks[index], file, layout, swap, false, vertexCount, indices);
+			});
+		}
+
+		for (int i = 0; i < faceChunks; i++)
+		{
+			if (chunks[i].errorMessage)
+			{
+				error = path + ": " + chunks[i].errorMessage;
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+bool loadMesh(const std::string& path, ThreadPool& pool, Mesh& mesh, std::string& error)
+{
+	bool isObj = hasExtension(path, ".obj");
+	if (!isObj && !hasExtension(path, ".ply"))
+	{
+		error = path + ": unknown mesh format, expected .obj or .ply";
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(path))
+	{
+		// Mapping also fails for files that exist but hold nothing
+		struct stat status;
+		bool empty = stat(path.c_str(), &status) == 0 && status.st_size == 0;
+		error = path + (empty ? ": the file is empty" : ": cannot open file");
+		return false;
+	}
+
+	return isObj ? loadObj(path, file, pool, mesh, error) : loadPly(path, file, pool, mesh, error);
+}
@@ -0,0 +1,23 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <string>
+
+class Mesh;
+class ThreadPool;
+
+// Reads a triangle mesh from a Wavefront OBJ (.obj) or binary PLY (.ply)
+// file into mesh, whose vertex and index lists are replaced; build() is
+// left to the caller. The file is mapped and split into chunks that the
+// pool parses in parallel: a first pass counts the vertices and triangles
+// of every chunk, which fixes where each chunk writes, and a second pass
+// converts them straight into the mesh's arrays.
+//
+// OBJ files contribute their v and f statements, polygons are split into
+// fans and negative (relative) indices are resolved; everything else is
+// ignored. PLY files must be binary and list their vertex element, with
+// float or double x y z, before the face element. On failure error holds
+// "path:line: message" for OBJ and "path: message" for PLY files.
+bool loadMesh(const std::string& path, ThreadPool& pool, Mesh& mesh, std::string& error);
+
+#endif // MESHLOADER_H
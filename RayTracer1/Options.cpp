@@ -0,0 +1,210 @@
+#include "Options.h"
+#include "Integrator.h"
+#include "Renderer.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	bool parseInt(const char* text, int minimum, int& value)
+	{
+		char* end;
+		errno = 0;
+		long result = std::strtol(text, &end, 10);
+		if (end == text || *end != '\0' || errno == ERANGE || result < minimum || result > 1 << 30)
+			return false;
+		value = (int)result;
+		return true;
+	}
+
+	bool parseFloat(const char* text, float& value)
+	{
+		char* end;
+		errno = 0;
+		float result = std::strtof(text, &end);
+		if (end == text || *end != '\0' || errno == ERANGE || !(result > 0.0f))
+			return false;
+		value = result;
+		return true;
+	}
+
+	bool parseToneMap(const std::string& text, ToneMapOperator& op)
+	{
+		if (text == "clamp")
+			op = TONEMAP_CLAMP;
+		else if (text == "reinhard")
+			op = TONEMAP_REINHARD;
+		else if (text == "aces")
+			op = TONEMAP_ACES;
+		else
+			return false;
+		return true;
+	}
+
+	bool parseBVHWidth(const std::string& text, int& width)
+	{
+		if (text != "2" && text != "4" && text != "8")
+			return false;
+		width = text[0] - '0';
+		return true;
+	}
+
+	bool parseSimdLevel(const std::string& text, int& level)
+	{
+		if (text == "auto")
+			level = -1;
+		else if (text == "scalar")
+			level = SIMD_SCALAR;
+		else if (text == "sse4")
+			level = SIMD_SSE4;
+		else if (text == "avx2")
+			level = SIMD_AVX2;
+		else if (text == "avx512")
+			level = SIMD_AVX512;
+		else
+			return false;
+		return true;
+	}
+}
+
+RenderOptions::RenderOptions()
+	: width(800),
+	height(640),
+	threads(0),
+	samples(1),
+	maxDepth(INTEGRATOR_MAX_DEPTH),
+	tileSize(RENDER_TILE_SIZE),
+	noCache(false),
+	outputPath("result.png"),
+	simdLevel(-1),
+	bvhWidth(4),
+	compressBVH(false),
+	verbose(false),
+	help(false)
+{
+}
+
+bool parseOptions(int argc, char* argv[], RenderOptions& options, std::string& error)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		// Both "--name value" and "--name=value" are accepted
+		std::string name = argv[i];
+		std::string value;
+		bool inlineValue = false;
+		size_t equals = name.find('=');
+		if (name.compare(0, 2, "--") == 0 && equals != std::string::npos)
+		{
+			value = name.substr(equals + 1);
+			name = name.substr(0, equals);
+			inlineValue = true;
+		}
+
+		if (name == "-h" || name == "--help")
+		{
+			options.help = true;
+			continue;
+		}
+		if (name == "-v" || name == "--verbose")
+		{
+			options.verbose = true;
+			continue;
+		}
+		if (name == "--no-cache")
+		{
+			options.noCache = true;
+			continue;
+		}
+		if (name == "--compress-bvh")
+		{
+			options.compressBVH = true;
+			continue;
+		}
+
+		if (!inlineValue)
+		{
+			if (i + 1 >= argc)
+			{
+				error = "missing value for " + name;
+				return false;
+			}
+			value = argv[++i];
+		}
+
+		bool ok;
+		if (name == "--width")
+			ok = parseInt(value.c_str(), 1, options.width);
+		else if (name == "--height")
+			ok = parseInt(value.c_str(), 1, options.height);
+		else if (name == "--threads")
+			ok = parseInt(value.c_str(), 0, options.threads);
+		else if (name == "--samples")
+			ok = parseInt(value.c_str(), 1, options.samples);
+		else if (name == "--max-depth")
+			ok = parseInt(value.c_str(), 1, options.maxDepth);
+		else if (name == "--tile-size")
+			ok = parseInt(value.c_str(), 1, options.tileSize);
+		else if (name == "--scene")
+			ok = !(options.scenePath = value).empty();
+		else if (name == "--cache")
+			ok = !(options.cachePath = value).empty();
+		else if (name == "-o" || name == "--output")
+			ok = !(options.outputPath = value).empty();
+		else if (name == "--exposure")
+			ok = parseFloat(value.c_str(), options.toneMap.exposure);
+		else if (name == "--tonemap")
+			ok = parseToneMap(value, options.toneMap.op);
+		else if (name == "--simd")
+			ok = parseSimdLevel(value, options.simdLevel);
+		else if (name == "--bvh-width")
+			ok = parseBVHWidth(value, options.bvhWidth);
+		else
+		{
+			error = "unknown option " + name;
+			return false;
+		}
+
+		if (!ok)
+		{
+			error = "invalid value '" + value + "' for " + name;
+			return false;
+		}
+	}
+
+	if (options.compressBVH && options.bvhWidth == 2)
+	{
+		error = "--compress-bvh needs a --bvh-width of 4 or 8";
+		return false;
+	}
+	return true;
+}
+
+void printUsage(FILE* out, const char* program)
+{
+	RenderOptions defaults;
+	std::fprintf(out,
+		"Usage: %s [options]\n"
+		"\n"
+		"  --width N          image width in pixels (%d)\n"
+		"  --height N         image height in pixels (%d)\n"
+		"  --threads N        worker threads, 0 for one per hardware thread (%d)\n"
+		"  --samples N        samples per pixel (%d)\n"
+		"  --max-depth N      surfaces a path may visit (%d)\n"
+		"  --tile-size N      edge length of the render tiles (%d)\n"
+		"  --scene FILE       scene to render instead of the built-in one\n"
+		"  --cache FILE       binary cache of the scene (scene file + .cache)\n"
+		"  --no-cache         always parse the scene, never read or write a cache\n"
+		"  -o, --output FILE  .png or .ppm image to write (%s)\n"
+		"  --exposure F       multiplier applied before tone mapping (%g)\n"
+		"  --tonemap OP       clamp, reinhard or aces (clamp)\n"
+		"  --simd LEVEL       auto, scalar, sse4, avx2 or avx512 (auto)\n"
+		"  --bvh-width N      children per hierarchy node, 2, 4 or 8 (%d)\n"
+		"  --compress-bvh     quantize the wide nodes to save memory\n"
+		"  -v, --verbose      print settings and timings to stderr\n"
+		"  -h, --help         show this message\n",
+		program, defaults.width, defaults.height, defaults.threads, defaults.samples,
+		defaults.maxDepth, defaults.tileSize, defaults.outputPath.c_str(),
+		defaults.toneMap.exposure, defaults.bvhWidth);
+}
@@ -0,0 +1,65 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "Framebuffer.h"
+#include "Simd.h"
+
+#include <cstdio>
+#include <string>
+
+// Settings of one command line render job
+struct RenderOptions
+{
+	int width;
+
+	int height;
+
+	// 0 uses every hardware thread
+	int threads;
+
+	// Passes of one sample per pixel
+	int samples;
+
+	// Surfaces a path may visit, including the primary hit
+	int maxDepth;
+
+	int tileSize;
+
+	// Empty renders the built-in scene
+	std::string scenePath;
+
+	// Binary cache of the scene, empty for scenePath + ".cache"
+	std::string cachePath;
+
+	// Parse the scene every time, without reading or writing a cache
+	bool noCache;
+
+	std::string outputPath;
+
+	ToneMap toneMap;
+
+	// Below 0 the detected level is used
+	int simdLevel;
+
+	// Children per hierarchy node for single rays: 2, 4 or 8
+	int bvhWidth;
+
+	// Quantized wide nodes, in place of the binary tree once built
+	bool compressBVH;
+
+	// Prints timings and the effective settings to stderr
+	bool verbose;
+
+	// Set by --help, nothing is rendered
+	bool help;
+
+	RenderOptions();
+};
+
+// Fills options from the arguments. On failure error describes the
+// offending argument and options is left partially filled.
+bool parseOptions(int argc, char* argv[], RenderOptions& options, std::string& error);
+
+void printUsage(FILE* out, const char* program);
+
+#endif // OPTIONS_H
@@ -1,10 +1,10 @@
 #ifndef RAY_H
 #define RAY_H
 
-#include <SFML\Graphics.hpp>
-#include <SFML\Window.hpp>
+#include <type_traits>
 #include "Vector3.h"
 #include "Vector2.h"
+#include "Material.h"
 //#include "Maths.h"
 
 // In order to prevent bouncing rays self-intersecting
@@ -19,37 +19,84 @@ struct Ray
 	Vector direction;
 	float tMax;
 
-	Ray();
-	Ray(const Ray& r);
-	Ray(const Point& origin, const Vector& direction,
-		float tMax = RAY_T_MAX);
+	constexpr Ray()
+		: origin(0.0f, 0.0f, 0.0f),
+		direction(),
+		tMax(RAY_T_MAX)
+	{
+	}
 
-	virtual ~Ray();
+	constexpr Ray(const Point& origin, const Vector& direction,
+		float tMax = RAY_T_MAX)
+		: origin(origin),
+		direction(direction),
+		tMax(tMax)
+	{
+	}
 
-	Ray& operator =(const Ray& r);
-
-	Point calculate(float t) const;
+	constexpr Point calculate(float t) const
+	{
+		return origin + direction * t;
+	}
 };
 
 class Shape;
 
+// Hit record filled in by Shape::intersect
 struct Intersection
 {
 	Ray ray;
 	float t;
-	Shape* pShape;
-	sf::Color color;
 
-	Intersection();
-	Intersection(const Intersection& i);
-	Intersection(const Ray& ray);
+	// Part of pShape that was hit, e.g. the triangle of a mesh
+	int primitive;
+
+	// Material of the hit surface, set together with pShape
+	MaterialId material;
+
+	const Shape* pShape;
 
-	virtual ~Intersection();
+	// Shape hit inside the object of an Instance, only meaningful when
+	// pShape is that Instance; primitive then belongs to this shape
+	const Shape* pInstanced;
 
-	Intersection& operator =(const Intersection& i);
+	constexpr Intersection()
+		: ray(),
+		t(RAY_T_MAX),
+		primitive(0),
+		material(MATERIAL_NONE),
+		pShape(NULL),
+		pInstanced(NULL)
+	{
+	}
 
-	bool intersected() const;
-	Point position() const;
+	constexpr Intersection(const Ray& ray)
+		: ray(ray),
+		t(ray.tMax),
+		primitive(0),
+		material(MATERIAL_NONE),
+		pShape(NULL),
+		pInstanced(NULL)
+	{
+	}
+
+	constexpr bool intersected() const
+	{
+		return (pShape != NULL);
+	}
+
+	constexpr Point position() const
+	{
+		return ray.calculate(t);
+	}
 };
 
+// Both are passed by value through every intersection routine. Hits on
+// instances carry the instanced shape as well, one pointer more; the
+// material id fills the padding in front of pShape.
+static_assert(sizeof(Ray) == 7 * sizeof(float), "Ray must stay 28 bytes");
+static_assert(std::is_trivially_copyable<Ray>::value, "Ray must stay trivially copyable");
+static_assert(sizeof(Intersection) <= 14 * sizeof(float), "Intersection must stay within 56 bytes");
+static_assert(std::is_trivially_copyable<Intersection>::value, "Intersection must stay trivially copyable");
+
 #endif // RAY_H
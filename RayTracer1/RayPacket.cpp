@@ -0,0 +1,225 @@
+#include "RayPacket.h"
+#include "Simd.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	unsigned intersectBoxScalar(const RayPacket& packet, const AABB& box, unsigned mask, float& tNear)
+	{
+		unsigned hit = 0;
+		tNear = RAY_T_MAX;
+		for (unsigned bits = mask; bits != 0; bits &= bits - 1)
+		{
+			int lane = lowestBit(bits);
+			Ray ray = packet.ray(lane);
+			Vector invDirection(packet.invDirectionX[lane], packet.invDirectionY[lane], packet.invDirectionZ[lane]);
+
+			float tEnter;
+			if (box.intersect(ray, invDirection, packet.tMax[lane], tEnter))
+			{
+				hit |= 1u << lane;
+				tNear = std::min(tNear, tEnter);
+			}
+		}
+		return hit;
+	}
+
+#ifdef SIMD_X86
+
+	SIMD_TARGET("sse4.1")
+	unsigned intersectBoxSSE4(const RayPacket& packet, const AABB& box, unsigned mask, float& tNear)
+	{
+		__m128 minX = _mm_set1_ps(box.min.x), maxX = _mm_set1_ps(box.max.x);
+		__m128 minY = _mm_set1_ps(box.min.y), maxY = _mm_set1_ps(box.max.y);
+		__m128 minZ = _mm_set1_ps(box.min.z), maxZ = _mm_set1_ps(box.max.z);
+		__m128 nearest = _mm_set1_ps(RAY_T_MAX);
+
+		unsigned hit = 0;
+		for (int base = 0; base < RAY_PACKET_SIZE; base += 4)
+		{
+			unsigned lanes = (mask >> base) & 0xfu;
+			if (lanes == 0)
+				continue;
+
+			__m128 ox = _mm_load_ps(packet.originX + base);
+			__m128 oy = _mm_load_ps(packet.originY + base);
+			__m128 oz = _mm_load_ps(packet.originZ + base);
+			__m128 ix = _mm_load_ps(packet.invDirectionX + base);
+			__m128 iy = _mm_load_ps(packet.invDirectionY + base);
+			__m128 iz = _mm_load_ps(packet.invDirectionZ + base);
+
+			__m128 tx1 = _mm_mul_ps(_mm_sub_ps(minX, ox), ix), tx2 = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+			__m128 ty1 = _mm_mul_ps(_mm_sub_ps(minY, oy), iy), ty2 = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+			__m128 tz1 = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz), tz2 = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+
+			__m128 tEnter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+				_mm_max_ps(_mm_min_ps(tz1, tz2), _mm_setzero_ps()));
+			__m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+				_mm_min_ps(_mm_max_ps(tz1, tz2), _mm_load_ps(packet.tMax + base)));
+
+			__m128 inside = _mm_cmple_ps(tEnter, tExit);
+			unsigned bits = (unsigned)_mm_movemask_ps(inside) & lanes;
+			if (bits == 0)
+				continue;
+
+			hit |= bits << base;
+			__m128 live = _mm_castsi128_ps(_mm_cmpgt_epi32(
+				_mm_and_si128(_mm_set1_epi32((int)bits), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+			nearest = _mm_min_ps(nearest, _mm_blendv_ps(_mm_set1_ps(RAY_T_MAX), tEnter, live));
+		}
+
+		nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+		nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+		tNear = _mm_cvtss_f32(nearest);
+		return hit;
+	}
+
+	SIMD_TARGET("avx2")
+	unsigned intersectBoxAVX2(const RayPacket& packet, const AABB& box, unsigned mask, float& tNear)
+	{
+		__m256 minX = _mm256_set1_ps(box.min.x), maxX = _mm256_set1_ps(box.max.x);
+		__m256 minY = _mm256_set1_ps(box.min.y), maxY = _mm256_set1_ps(box.max.y);
+		__m256 minZ = _mm256_set1_ps(box.min.z), maxZ = _mm256_set1_ps(box.max.z);
+		__m256 nearest = _mm256_set1_ps(RAY_T_MAX);
+		__m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+		unsigned hit = 0;
+		for (int base = 0; base < RAY_PACKET_SIZE; base += 8)
+		{
+			unsigned lanes = (mask >> base) & 0xffu;
+			if (lanes == 0)
+				continue;
+
+			__m256 ox = _mm256_load_ps(packet.originX + base);
+			__m256 oy = _mm256_load_ps(packet.originY + base);
+			__m256 oz = _mm256_load_ps(packet.originZ + base);
+			__m256 ix = _mm256_load_ps(packet.invDirectionX + base);
+			__m256 iy = _mm256_load_ps(packet.invDirectionY + base);
+			__m256 iz = _mm256_load_ps(packet.invDirectionZ + base);
+
+			__m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(minX, ox), ix), tx2 = _mm256_mul_ps(_mm256_sub_ps(maxX, ox), ix);
+			__m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(minY, oy), iy), ty2 = _mm256_mul_ps(_mm256_sub_ps(maxY, oy), iy);
+			__m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(minZ, oz), iz), tz2 = _mm256_mul_ps(_mm256_sub_ps(maxZ, oz), iz);
+
+			__m256 tEnter = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)),
+				_mm256_max_ps(_mm256_min_ps(tz1, tz2), _mm256_setzero_ps()));
+			__m256 tExit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)),
+				_mm256_min_ps(_mm256_max_ps(tz1, tz2), _mm256_load_ps(packet.tMax + base)));
+
+			__m256 inside = _mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ);
+			unsigned bits = (unsigned)_mm256_movemask_ps(inside) & lanes;
+			if (bits == 0)
+				continue;
+
+			hit |= bits << base;
+			__m256 live = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+				_mm256_and_si256(_mm256_set1_epi32((int)bits), laneBits), _mm256_setzero_si256()));
+			nearest = _mm256_min_ps(nearest, _mm256_blendv_ps(_mm256_set1_ps(RAY_T_MAX), tEnter, live));
+		}
+
+		__m128 half = _mm_min_ps(_mm256_castps256_ps128(nearest), _mm256_extractf128_ps(nearest, 1));
+		half = _mm_min_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 0, 3, 2)));
+		half = _mm_min_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(2, 3, 0, 1)));
+		tNear = _mm_cvtss_f32(half);
+		return hit;
+	}
+
+	SIMD_TARGET("avx512f")
+	unsigned intersectBoxAVX512(const RayPacket& packet, const AABB& box, unsigned mask, float& tNear)
+	{
+		__m512 ox = _mm512_load_ps(packet.originX);
+		__m512 oy = _mm512_load_ps(packet.originY);
+		__m512 oz = _mm512_load_ps(packet.originZ);
+		__m512 ix = _mm512_load_ps(packet.invDirectionX);
+		__m512 iy = _mm512_load_ps(packet.invDirectionY);
+		__m512 iz = _mm512_load_ps(packet.invDirectionZ);
+
+		__m512 tx1 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(box.min.x), ox), ix);
+		__m512 tx2 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(box.max.x), ox), ix);
+		__m512 ty1 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(box.min.y), oy), iy);
+		__m512 ty2 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(box.max.y), oy), iy);
+		__m512 tz1 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(box.min.z), oz), iz);
+		__m512 tz2 = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(box.max.z), oz), iz);
+
+		__m512 tEnter = _mm512_max_ps(_mm512_max_ps(_mm512_min_ps(tx1, tx2), _mm512_min_ps(ty1, ty2)),
+			_mm512_max_ps(_mm512_min_ps(tz1, tz2), _mm512_setzero_ps()));
+		__m512 tExit = _mm512_min_ps(_mm512_min_ps(_mm512_max_ps(tx1, tx2), _mm512_max_ps(ty1, ty2)),
+			_mm512_min_ps(_mm512_max_ps(tz1, tz2), _mm512_load_ps(packet.tMax)));
+
+		__mmask16 hit = _mm512_mask_cmp_ps_mask((__mmask16)mask, tEnter, tExit, _CMP_LE_OQ);
+		tNear = _mm512_mask_reduce_min_ps(hit, tEnter);
+		if (hit == 0)
+			tNear = RAY_T_MAX;
+		return hit;
+	}
+
+#endif // SIMD_X86
+}
+
+void RayPacket::load(const Ray* rays, int count)
+{
+	for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+	{
+		int source = lane < count ? lane : 0;
+		const Ray& ray = rays[source];
+		Vector invDirection = safeInverse(ray.direction);
+
+		originX[lane] = ray.origin.x;
+		originY[lane] = ray.origin.y;
+		originZ[lane] = ray.origin.z;
+		directionX[lane] = ray.direction.x;
+		directionY[lane] = ray.direction.y;
+		directionZ[lane] = ray.direction.z;
+		invDirectionX[lane] = invDirection.x;
+		invDirectionY[lane] = invDirection.y;
+		invDirectionZ[lane] = invDirection.z;
+		tMax[lane] = ray.tMax;
+	}
+
+	active = count >= RAY_PACKET_SIZE ? (1u << RAY_PACKET_SIZE) - 1u : (1u << count) - 1u;
+}
+
+Ray RayPacket::ray(int lane) const
+{
+	return Ray(Point(originX[lane], originY[lane], originZ[lane]),
+		Vector(directionX[lane], directionY[lane], directionZ[lane]), tMax[lane]);
+}
+
+bool RayPacket::isCoherent() const
+{
+	if (active == 0)
+		return true;
+
+	int first = lowestBit(active);
+	bool negX = directionX[first] < 0.0f;
+	bool negY = directionY[first] < 0.0f;
+	bool negZ = directionZ[first] < 0.0f;
+
+	for (unsigned bits = active; bits != 0; bits &= bits - 1)
+	{
+		int lane = lowestBit(bits);
+		if ((directionX[lane] < 0.0f) != negX ||
+			(directionY[lane] < 0.0f) != negY ||
+			(directionZ[lane] < 0.0f) != negZ)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned RayPacket::intersect(const AABB& box, unsigned mask, float& tNear) const
+{
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512: return intersectBoxAVX512(*this, box, mask, tNear);
+	case SIMD_AVX2: return intersectBoxAVX2(*this, box, mask, tNear);
+	case SIMD_SSE4: return intersectBoxSSE4(*this, box, mask, tNear);
+#endif
+	default: return intersectBoxScalar(*this, box, mask, tNear);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include "Ray.h"
+#include "AABB.h"
+
+// Rays traced together, one AVX-512 register or two AVX2 registers wide
+#define RAY_PACKET_SIZE 16
+
+// With fewer active lanes than this the primitive tests run per ray
+#define RAY_PACKET_MIN_ACTIVE 4
+
+// Up to RAY_PACKET_SIZE rays stored structure-of-arrays. Lane masks have
+// bit i set for lane i; unused lanes hold a copy of lane 0 so vector code
+// never sees garbage.
+struct RayPacket
+{
+	alignas(64) float originX[RAY_PACKET_SIZE];
+	alignas(64) float originY[RAY_PACKET_SIZE];
+	alignas(64) float originZ[RAY_PACKET_SIZE];
+	alignas(64) float directionX[RAY_PACKET_SIZE];
+	alignas(64) float directionY[RAY_PACKET_SIZE];
+	alignas(64) float directionZ[RAY_PACKET_SIZE];
+	alignas(64) float invDirectionX[RAY_PACKET_SIZE];
+	alignas(64) float invDirectionY[RAY_PACKET_SIZE];
+	alignas(64) float invDirectionZ[RAY_PACKET_SIZE];
+
+	// Closest hit so far, shrunk by the intersection kernels
+	alignas(64) float tMax[RAY_PACKET_SIZE];
+
+	// Lanes that hold a ray
+	unsigned active;
+
+	// Loads count rays, each limited to its own tMax
+	void load(const Ray* rays, int count);
+
+	Ray ray(int lane) const;
+
+	// True if the active rays all point into the same octant, the case in
+	// which they tend to visit the same nodes
+	bool isCoherent() const;
+
+	// Lanes in mask whose ray enters the box before its tMax. tNear
+	// receives the smallest entry distance among them.
+	unsigned intersect(const AABB& box, unsigned mask, float& tNear) const;
+};
+
+#endif // RAYPACKET_H
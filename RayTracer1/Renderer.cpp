@@ -0,0 +1,198 @@
+#include "Renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+TileBuffers::TileBuffers(int pixelCount)
+	: rayData(6 * pixelCount),
+	intersections(pixelCount),
+	pixels(pixelCount),
+	hit(new bool[pixelCount]),
+	shadowed(new bool[pixelCount]),
+	litColors(pixelCount),
+	colors(3 * pixelCount)
+{
+	shadowRays.reserve(pixelCount);
+	shadowPixels.reserve(pixelCount);
+	litHits.reserve(pixelCount);
+	litShadows.reserve(pixelCount);
+	seeds.reserve(pixelCount);
+	litPixels.reserve(pixelCount);
+}
+
+Renderer::Renderer(ThreadPool& pool, const Integrator& integrator, int tileSize)
+	: pool(pool),
+	integrator(integrator),
+	tileSize(tileSize)
+{
+	tileBuffers.reserve(pool.size() + 1);
+	for (unsigned i = 0; i < pool.size() + 1; i++)
+		tileBuffers.emplace_back(tileSize * tileSize);
+}
+
+void Renderer::render(const Camera* camera, const Shape* scene, const MaterialTable& materials,
+	int width, int height, Light light_source)
+{
+	if (width != framebuffer.getWidth() || height != framebuffer.getHeight())
+		framebuffer.resize(width, height);
+
+	// R2 low discrepancy sequence, offset so that pass 0 has no jitter
+	Pass pass;
+	pass.index = framebuffer.getSampleCount();
+	pass.jitterX = 0.0f;
+	pass.jitterY = 0.0f;
+	if (pass.index > 0)
+	{
+		double x = 0.5 + pass.index * 0.7548776662466927;
+		double y = 0.5 + pass.index * 0.5698402909980532;
+		pass.jitterX = (float)(x - std::floor(x)) - 0.5f;
+		pass.jitterY = (float)(y - std::floor(y)) - 0.5f;
+	}
+
+	std::vector<Tile> tiles;
+	for (int y = 0; y < height; y += tileSize)
+	{
+		for (int x = 0; x < width; x += tileSize)
+		{
+			Tile tile = { x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) };
+			tiles.push_back(tile);
+		}
+	}
+
+	pool.parallelFor((int)tiles.size(), [&](int index, unsigned worker)
+	{
+		renderTile(tiles[index], pass, camera, scene, materials, light_source, tileBuffers[worker]);
+	});
+
+	framebuffer.finishSample();
+}
+
+void Renderer::clear()
+{
+	framebuffer.clear();
+}
+
+const Framebuffer& Renderer::getFramebuffer() const
+{
+	return framebuffer;
+}
+
+void Renderer::renderTile(const Tile& tile, const Pass& pass, const Camera* camera,
+	const Shape* scene, const MaterialTable& materials, Light light_source,
+	TileBuffers& buffers)
+{
+	int width = framebuffer.getWidth();
+	int height = framebuffer.getHeight();
+	int tileWidth = tile.x1 - tile.x0;
+	int pixelCount = tileWidth * (tile.y1 - tile.y0);
+
+	// Primary rays for the whole tile, one camera batch per row
+	float* rayData = buffers.rayData.data();
+	RayArrays rays = { &rayData[0], &rayData[pixelCount], &rayData[2 * pixelCount],
+		&rayData[3 * pixelCount], &rayData[4 * pixelCount], &rayData[5 * pixelCount] };
+	for (int y = tile.y0; y < tile.y1; y++)
+	{
+		int row = (y - tile.y0) * tileWidth;
+		RayArrays rowRays = { rays.originX + row, rays.originY + row, rays.originZ + row,
+			rays.directionX + row, rays.directionY + row, rays.directionZ + row };
+		camera->makeRays(tile.x0, y, tileWidth, width, height, rowRays,
+			pass.jitterX, pass.jitterY);
+	}
+
+	// Traced in RENDER_PACKET_BLOCK squares so that each packet covers a
+	// compact patch of the screen. pixels[i] is the tile-relative pixel of
+	// the i-th ray.
+	Intersection* intersections = buffers.intersections.data();
+	int* pixels = buffers.pixels.data();
+	int next = 0;
+	for (int by = 0; by < tile.y1 - tile.y0; by += RENDER_PACKET_BLOCK)
+	{
+		for (int bx = 0; bx < tileWidth; bx += RENDER_PACKET_BLOCK)
+		{
+			for (int y = by; y < std::min(by + RENDER_PACKET_BLOCK, tile.y1 - tile.y0); y++)
+			{
+				for (int x = bx; x < std::min(bx + RENDER_PACKET_BLOCK, tileWidth); x++)
+				{
+					int pixel = y * tileWidth + x;
+					intersections[next] = Intersection(Ray(
+						Point(rays.originX[pixel], rays.originY[pixel], rays.originZ[pixel]),
+						Vector(rays.directionX[pixel], rays.directionY[pixel], rays.directionZ[pixel])));
+					pixels[next] = pixel;
+					next++;
+				}
+			}
+		}
+	}
+
+	bool* hit = buffers.hit.get();
+	scene->intersectBatch(intersections, pixelCount, hit);
+
+	// One shadow segment towards the light per hit, tested as a batch
+	std::vector<Ray>& shadowRays = buffers.shadowRays;
+	std::vector<int>& shadowPixels = buffers.shadowPixels;
+	shadowRays.clear();
+	shadowPixels.clear();
+	for (int i = 0; i < pixelCount; i++)
+	{
+		if (hit[i])
+		{
+			shadowRays.push_back(scene->makeRay(intersections[i], light_source));
+			shadowPixels.push_back(i);
+		}
+	}
+
+	bool* shadowed = buffers.shadowed.get();
+	scene->occluded(shadowRays.data(), (int)shadowRays.size(), shadowed);
+
+	// The lit hits are shaded as one batch
+	std::vector<Intersection>& litHits = buffers.litHits;
+	std::vector<Ray>& litShadows = buffers.litShadows;
+	std::vector<unsigned>& seeds = buffers.seeds;
+	std::vector<int>& litPixels = buffers.litPixels;
+	litHits.clear();
+	litShadows.clear();
+	seeds.clear();
+	litPixels.clear();
+	for (size_t j = 0; j < shadowRays.size(); j++)
+	{
+		if (!shadowed[j])
+		{
+			int i = shadowPixels[j];
+			int x = tile.x0 + pixels[i] % tileWidth;
+			int y = tile.y0 + pixels[i] / tileWidth;
+
+			// Per pixel and pass random state, independent of the tile layout
+			seeds.push_back(((unsigned)(y * width + x) * 2654435761u
+				+ (unsigned)pass.index * 0x9e3779b9u) | 1u);
+			litHits.push_back(intersections[i]);
+			litShadows.push_back(shadowRays[j]);
+			litPixels.push_back(pixels[i]);
+		}
+	}
+
+	Color* litColors = buffers.litColors.data();
+	integrator.shade(scene, materials, litHits.data(), litShadows.data(), seeds.data(),
+		(int)litHits.size(), litColors, buffers.shading);
+
+	// Linear radiance of this pass, misses and shadowed hits stay black
+	float* colors = buffers.colors.data();
+	std::fill(colors, colors + 3 * pixelCount, 0.0f);
+	for (size_t j = 0; j < litHits.size(); j++)
+	{
+		float* rgb = &colors[3 * litPixels[j]];
+		rgb[0] = litColors[j].r;
+		rgb[1] = litColors[j].g;
+		rgb[2] = litColors[j].b;
+	}
+
+	// Tiles never overlap, so their rows are accumulated without locking
+	for (int y = tile.y0; y < tile.y1; y++)
+	{
+		const float* source = &colors[3 * (y - tile.y0) * tileWidth];
+		float* target = framebuffer.row(y) + 3 * tile.x0;
+		for (int i = 0; i < 3 * tileWidth; i++)
+			target[i] += source[i];
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <memory>
+#include <vector>
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "Integrator.h"
+#include "Material.h"
+#include "Shape.h"
+#include "ThreadPool.h"
+
+// Default edge length of the square tiles the frame is split into
+#define RENDER_TILE_SIZE 32
+
+// Edge length of the pixel blocks traced as one ray packet
+#define RENDER_PACKET_BLOCK 4
+
+struct Tile
+{
+	int x0, y0;
+	int x1, y1;
+};
+
+// Per pass state shared by all tiles
+struct Pass
+{
+	// Index of the sample being added, seeds the random numbers
+	int index;
+
+	// Subpixel offset of every camera ray, in pixels
+	float jitterX, jitterY;
+};
+
+// Working memory of one tile, sized for the largest. Kept per worker, so
+// rendering a tile does not allocate.
+struct TileBuffers
+{
+	// Primary rays as RayArrays, one block of pixelCount per component
+	std::vector<float> rayData;
+
+	// pixels[i] is the tile-relative pixel of intersections[i]
+	std::vector<Intersection> intersections;
+	std::vector<int> pixels;
+	std::unique_ptr<bool[]> hit;
+
+	std::vector<Ray> shadowRays;
+	std::vector<int> shadowPixels;
+	std::unique_ptr<bool[]> shadowed;
+
+	// The lit hits, shaded as one batch
+	std::vector<Intersection> litHits;
+	std::vector<Ray> litShadows;
+	std::vector<unsigned> seeds;
+	std::vector<int> litPixels;
+	std::vector<Color> litColors;
+
+	// Linear radiance of the tile, three floats per pixel
+	std::vector<float> colors;
+
+	ShadingBuffers shading;
+
+	explicit TileBuffers(int pixelCount);
+};
+
+class Renderer
+{
+protected:
+
+	ThreadPool& pool;
+
+	Integrator integrator;
+
+	// One per worker of the pool and one for the calling thread
+	std::vector<TileBuffers> tileBuffers;
+
+	int tileSize;
+
+	Framebuffer framebuffer;
+
+	void renderTile(const Tile& tile, const Pass& pass, const Camera* camera,
+		const Shape* scene, const MaterialTable& materials, Light light_source,
+		TileBuffers& buffers);
+
+public:
+
+	Renderer(ThreadPool& pool, const Integrator& integrator = Integrator(),
+		int tileSize = RENDER_TILE_SIZE);
+
+	// Adds one sample per pixel to the renderer's framebuffer, which is
+	// cleared first if its size changes. The first sample goes through the
+	// pixel corner, later ones are spread over the pixel. The shapes'
+	// material ids index materials.
+	void render(const Camera* camera, const Shape* scene, const MaterialTable& materials,
+		int width, int height, Light light_source);
+
+	// Drops the accumulated samples, e.g. after the scene changed
+	void clear();
+
+	const Framebuffer& getFramebuffer() const;
+};
+
+#endif // RENDERER_H
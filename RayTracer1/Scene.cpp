@@ -0,0 +1,707 @@
+#include "Scene.h"
+#include "MeshLoader.h"
+#include "SceneCache.h"
+#include "TextCursor.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	bool readVector(TextCursor& cursor, Vector& value)
+	{
+		return readFloat(cursor, value.x) && readFloat(cursor, value.y) && readFloat(cursor, value.z);
+	}
+
+	bool readColor(TextCursor& cursor, Color& color)
+	{
+		int r, g, b;
+		if (!readInt(cursor, r) || !readInt(cursor, g) || !readInt(cursor, b))
+			return false;
+		if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255)
+			return false;
+		color = Color::fromSRGB8(r, g, b);
+		return true;
+	}
+
+	// Nothing but blanks or a comment is left on the line, so optional
+	// values are missing
+	bool atLineEnd(TextCursor& cursor)
+	{
+		skipBlanks(cursor);
+		return cursor.pos == cursor.end || *cursor.pos == '\n';
+	}
+
+	std::string lineError(const std::string& name, int line, const std::string& message)
+	{
+		char number[16];
+		std::snprintf(number, sizeof(number), "%d", line);
+		return name + ":" + number + ": " + message;
+	}
+}
+
+Scene::Scene(ThreadPool& pool)
+	: pool(pool),
+	hasCamera(false),
+	cacheStatus(SCENE_CACHE_UNUSED),
+	buildTime(0.0)
+{
+}
+
+void Scene::clear()
+{
+	lights.clear();
+	materials.clear();
+	materialTable.clear();
+	planes.clear();
+	spheres.clear();
+	meshes.clear();
+	meshFiles.clear();
+	instances.clear();
+	objects.clear();
+	shapes.clear();
+	hasCamera = false;
+	buildTime = 0.0;
+
+	// Only after the shapes stopped using the mapped arrays
+	cacheFile.reset();
+}
+
+const SceneMaterial* Scene::findMaterial(const char* name, size_t length) const
+{
+	// Scenes define a few materials, a linear search beats hashing the name
+	for (std::vector<SceneMaterial>::const_iterator iter = materials.begin();
+		iter != materials.end();
+		++iter)
+	{
+		if (iter->name.size() == length && std::memcmp(iter->name.data(), name, length) == 0)
+			return &*iter;
+	}
+	return NULL;
+}
+
+const SceneObject* Scene::findObject(const char* name, size_t length) const
+{
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		const std::string& objectName = objects[i]->name;
+		if (objectName.size() == length && std::memcmp(objectName.data(), name, length) == 0)
+			return objects[i].get();
+	}
+	return NULL;
+}
+
+bool Scene::load(const std::string& path, std::string& error, const std::string& cachePath)
+{
+	cacheStatus = SCENE_CACHE_UNUSED;
+
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		error = path + ": cannot open file";
+		return false;
+	}
+
+	// One read of the whole file, the parser works on the buffer in place
+	std::vector<char> text;
+	bool failed = std::fseek(file, 0, SEEK_END) != 0;
+	long size = failed ? -1 : std::ftell(file);
+	failed = size < 0 || std::fseek(file, 0, SEEK_SET) != 0;
+	if (!failed && size > 0)
+	{
+		text.resize((size_t)size);
+		failed = std::fread(text.data(), 1, text.size(), file) != text.size();
+	}
+	std::fclose(file);
+	if (failed)
+	{
+		error = path + ": read error";
+		return false;
+	}
+
+	if (cachePath.empty())
+		return parse(text.data(), text.size(), path, error);
+
+	uint64_t hash = hashSceneText(text.data(), text.size());
+	if (readSceneCache(cachePath, hash, *this))
+	{
+		cacheStatus = SCENE_CACHE_LOADED;
+		compact();
+		return true;
+	}
+
+	if (!parseText(text.data(), text.size(), path, error))
+		return false;
+
+	// The cache has no room for objects and instances
+	if (!objects.empty())
+	{
+		compact();
+		return true;
+	}
+
+	cacheStatus = writeSceneCache(cachePath, hash, *this) ? SCENE_CACHE_WRITTEN : SCENE_CACHE_WRITE_FAILED;
+	compact();
+	return true;
+}
+
+bool Scene::parse(const char* text, size_t size, const std::string& name, std::string& error)
+{
+	if (!parseText(text, size, name, error))
+		return false;
+	compact();
+	return true;
+}
+
+void Scene::compact()
+{
+	if (!bvhCompression())
+		return;
+
+	shapes.compact();
+	for (size_t i = 0; i < meshes.size(); i++)
+		meshes[i].compact();
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		objects[i]->shapes.compact();
+		for (size_t j = 0; j < objects[i]->meshes.size(); j++)
+			objects[i]->meshes[j].compact();
+	}
+}
+
+bool Scene::parseText(const char* text, size_t size, const std::string& name, std::string& error)
+{
+	clear();
+
+	// Line of the mesh statement that vertices and triangles belong to, 0
+	// when there is none or the mesh came from a file
+	int meshLine = 0;
+
+	// Object that spheres and meshes go to, NULL outside of one, and the
+	// line of its object statement
+	SceneObject* object = NULL;
+	int objectLine = 0;
+
+	// A mesh without a file needs its triangles before anything ends it
+	auto isMeshEmpty = [&]()
+	{
+		return meshLine != 0 && (object ? object->meshes : meshes).back().getIndices().empty();
+	};
+
+	// Mesh files are looked up next to the scene
+	size_t slash = name.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : name.substr(0, slash + 1);
+
+	TextCursor cursor = { text, text + size, 1 };
+	while (cursor.pos < cursor.end)
+	{
+		int line = cursor.line;
+		const char* word;
+		size_t length = readWord(cursor, word);
+		if (length == 0)
+		{
+			// Blank or comment line
+			readLineEnd(cursor);
+			continue;
+		}
+
+		bool ok = true;
+		if (isKeyword(word, length, "sphere"))
+		{
+			Point centre;
+			float radius;
+			const char* materialName;
+			size_t materialLength;
+			ok = readVector(cursor, centre) && readFloat(cursor, radius) && radius > 0.0f
+				&& (materialLength = readWord(cursor, materialName)) > 0;
+			if (ok)
+			{
+				const SceneMaterial* material = findMaterial(materialName, materialLength);
+				if (!material)
+				{
+					error = lineError(name, line, "unknown material '" + std::string(materialName, materialLength) + "'");
+					return false;
+				}
+				(object ? object->spheres : spheres).push_back(Sphere(centre, radius, material->id));
+			}
+		}
+		else if (isKeyword(word, length, "vertex") || isKeyword(word, length, "triangle"))
+		{
+			if (meshLine == 0)
+			{
+				error = lineError(name, line, std::string(word, length) + " outside of a mesh");
+				return false;
+			}
+
+			Mesh& mesh = (object ? object->meshes : meshes).back();
+			if (isKeyword(word, length, "vertex"))
+			{
+				Point position;
+				ok = readVector(cursor, position);
+				if (ok)
+					mesh.addVertex(position);
+			}
+			else
+			{
+				int a, b, c;
+				ok = readInt(cursor, a) && readInt(cursor, b) && readInt(cursor, c);
+				int vertexCount = (int)mesh.getVertices().size();
+				if (ok && (a < 0 || a >= vertexCount || b < 0 || b >= vertexCount || c < 0 || c >= vertexCount))
+				{
+					error = lineError(name, line, "vertex index out of range");
+					return false;
+				}
+				if (ok)
+					mesh.addTriangle(a, b, c);
+			}
+		}
+		else if (isKeyword(word, length, "mesh"))
+		{
+			const char* materialName;
+			size_t materialLength = readWord(cursor, materialName);
+			ok = materialLength > 0;
+			if (ok)
+			{
+				const SceneMaterial* material = findMaterial(materialName, materialLength);
+				if (!material)
+				{
+					error = lineError(name, line, "unknown material '" + std::string(materialName, materialLength) + "'");
+					return false;
+				}
+				if (isMeshEmpty())
+				{
+					error = lineError(name, meshLine, "the mesh has no triangles");
+					return false;
+				}
+				std::vector<Mesh>& meshList = object ? object->meshes : meshes;
+				meshList.push_back(Mesh(material->id));
+				meshLine = line;
+
+				const char* file;
+				size_t fileLength = readWord(cursor, file);
+				if (fileLength > 0)
+				{
+					std::string path(file, fileLength);
+					bool isAbsolute = path[0] == '/' || path[0] == '\\' || (fileLength > 1 && path[1] == ':');
+					if (!isAbsolute)
+						path = directory + path;
+
+					std::string meshError;
+					if (!loadMesh(path, pool, meshList.back(), meshError))
+					{
+						error = lineError(name, line, meshError);
+						return false;
+					}
+					meshFiles.push_back(path);
+					meshLine = 0;
+				}
+			}
+		}
+		else if (isKeyword(word, length, "plane"))
+		{
+			Point position;
+			Vector normal;
+			const char* materialName;
+			size_t materialLength;
+			ok = readVector(cursor, position) && readVector(cursor, normal)
+				&& normal.length2() > 0.0f
+				&& (materialLength = readWord(cursor, materialName)) > 0;
+			if (ok && object)
+			{
+				error = lineError(name, line, "planes cannot be part of an object");
+				return false;
+			}
+			if (ok)
+			{
+				const SceneMaterial* material = findMaterial(materialName, materialLength);
+				if (!material)
+				{
+					error = lineError(name, line, "unknown material '" + std::string(materialName, materialLength) + "'");
+					return false;
+				}
+				planes.push_back(Plane(position, normal.normalized(), material->id));
+			}
+		}
+		else if (isKeyword(word, length, "object"))
+		{
+			const char* objectName;
+			size_t objectLength = readWord(cursor, objectName);
+			ok = objectLength > 0;
+			if (ok && object)
+			{
+				error = lineError(name, line, "objects cannot be nested");
+				return false;
+			}
+			if (ok && findObject(objectName, objectLength))
+			{
+				error = lineError(name, line, "object '" + std::string(objectName, objectLength)
+					+ "' is already defined");
+				return false;
+			}
+			if (ok && isMeshEmpty())
+			{
+				error = lineError(name, meshLine, "the mesh has no triangles");
+				return false;
+			}
+			if (ok)
+			{
+				objects.push_back(std::unique_ptr<SceneObject>(new SceneObject()));
+				object = objects.back().get();
+				object->name.assign(objectName, objectLength);
+				objectLine = line;
+				meshLine = 0;
+			}
+		}
+		else if (isKeyword(word, length, "end"))
+		{
+			if (!object)
+			{
+				error = lineError(name, line, "end outside of an object");
+				return false;
+			}
+			if (isMeshEmpty())
+			{
+				error = lineError(name, meshLine, "the mesh has no triangles");
+				return false;
+			}
+			if (object->spheres.empty() && object->meshes.empty())
+			{
+				error = lineError(name, objectLine, "the object is empty");
+				return false;
+			}
+
+			// Built now so instances can take its bounds
+			std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+			object->shapes.reserve((int)(object->spheres.size() + object->meshes.size()));
+			for (size_t i = 0; i < object->spheres.size(); i++)
+				object->shapes.addShape(&object->spheres[i]);
+			for (size_t i = 0; i < object->meshes.size(); i++)
+			{
+				object->meshes[i].build(&pool);
+				object->shapes.addShape(&object->meshes[i]);
+			}
+			object->shapes.build(&pool);
+			buildTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+
+			object = NULL;
+			meshLine = 0;
+		}
+		else if (isKeyword(word, length, "instance"))
+		{
+			const char* objectName;
+			size_t objectLength = readWord(cursor, objectName);
+			Vector position;
+			Vector axis;
+			float angle;
+			float scale;
+			ok = objectLength > 0 && readVector(cursor, position)
+				&& readVector(cursor, axis) && axis.length2() > 0.0f
+				&& readFloat(cursor, angle) && readFloat(cursor, scale) && scale > 0.0f;
+			if (ok && object)
+			{
+				error = lineError(name, line, "instances cannot be part of an object");
+				return false;
+			}
+			if (ok)
+			{
+				const SceneObject* instanced = findObject(objectName, objectLength);
+				if (!instanced)
+				{
+					error = lineError(name, line, "unknown object '" + std::string(objectName, objectLength) + "'");
+					return false;
+				}
+
+				Matrix44 transform = Matrix44::translation(position)
+					* Matrix44::rotation(axis, angle * PI / 180.0f)
+					* Matrix44::scale(scale);
+
+				const char* materialName;
+				size_t materialLength = readWord(cursor, materialName);
+				if (materialLength == 0)
+				{
+					instances.push_back(Instance(&instanced->shapes, transform));
+				}
+				else
+				{
+					const SceneMaterial* material = findMaterial(materialName, materialLength);
+					if (!material)
+					{
+						error = lineError(name, line, "unknown material '" + std::string(materialName, materialLength) + "'");
+						return false;
+					}
+					instances.push_back(Instance(&instanced->shapes, transform, material->id));
+				}
+			}
+		}
+		else if (isKeyword(word, length, "material"))
+		{
+			const char* materialName;
+			size_t materialLength = readWord(cursor, materialName);
+			const char* kind;
+			size_t kindLength = readWord(cursor, kind);
+
+			Material material;
+			if (isKeyword(kind, kindLength, "diffuse"))
+			{
+				Color color;
+				ok = readColor(cursor, color);
+				material = Material::makeDiffuse(color);
+				if (ok && !atLineEnd(cursor))
+				{
+					ok = readFloat(cursor, material.reflectivity)
+						&& material.reflectivity >= 0.0f && material.reflectivity <= 1.0f;
+				}
+			}
+			else if (isKeyword(kind, kindLength, "mirror"))
+			{
+				material = Material::makeMirror();
+			}
+			else if (isKeyword(kind, kindLength, "glass"))
+			{
+				float ior = 1.3f;
+				ok = atLineEnd(cursor) || (readFloat(cursor, ior) && ior >= 1.0f);
+				material = Material::makeGlass(ior);
+			}
+			else if (isKeyword(kind, kindLength, "checker"))
+			{
+				CheckerTexture texture = { Color::fromSRGB8(0, 200, 200), Color::fromSRGB8(200, 200, 200), 1.0f };
+				if (!atLineEnd(cursor))
+				{
+					ok = readColor(cursor, texture.dark) && readColor(cursor, texture.light)
+						&& (atLineEnd(cursor) || (readFloat(cursor, texture.cellSize) && texture.cellSize > 0.0f));
+				}
+				if (ok)
+					material = Material::makeTextured(materialTable.addTexture(texture));
+			}
+			else
+			{
+				ok = false;
+			}
+
+			if (ok && findMaterial(materialName, materialLength))
+			{
+				error = lineError(name, line, "material '" + std::string(materialName, materialLength) + "' is already defined");
+				return false;
+			}
+			if (ok && materialTable.size() == MATERIAL_MAX_COUNT)
+			{
+				error = lineError(name, line, "too many materials");
+				return false;
+			}
+			if (ok)
+			{
+				SceneMaterial entry;
+				entry.name.assign(materialName, materialLength);
+				entry.id = materialTable.add(material);
+				materials.push_back(entry);
+			}
+		}
+		else if (isKeyword(word, length, "light"))
+		{
+			Point position;
+			ok = readVector(cursor, position);
+			if (ok && !lights.empty())
+			{
+				error = lineError(name, line, "only one light is supported");
+				return false;
+			}
+			if (ok)
+				lights.push_back(Light(position));
+		}
+		else if (isKeyword(word, length, "camera"))
+		{
+			ok = readVector(cursor, camera.position) && readVector(cursor, camera.target)
+				&& readVector(cursor, camera.up) && readFloat(cursor, camera.fov);
+			if (ok && hasCamera)
+			{
+				error = lineError(name, line, "the camera is already defined");
+				return false;
+			}
+			hasCamera = true;
+		}
+		else
+		{
+			error = lineError(name, line, "unknown statement '" + std::string(word, length) + "'");
+			return false;
+		}
+
+		if (!ok || !readLineEnd(cursor))
+		{
+			skipLine(cursor);
+			error = lineError(name, line, "malformed " + std::string(word, length) + " statement");
+			return false;
+		}
+	}
+
+	if (object)
+	{
+		error = lineError(name, objectLine, "the object has no end");
+		return false;
+	}
+	if (isMeshEmpty())
+	{
+		error = lineError(name, meshLine, "the mesh has no triangles");
+		return false;
+	}
+	if (!hasCamera)
+	{
+		error = name + ": the scene has no camera";
+		return false;
+	}
+	if (lights.empty())
+	{
+		error = name + ": the scene has no light";
+		return false;
+	}
+
+	// The arrays are complete, so pointers into them stay valid
+	shapes.reserve((int)(planes.size() + spheres.size() + meshes.size() + instances.size()));
+	for (size_t i = 0; i < planes.size(); i++)
+		shapes.addShape(&planes[i]);
+	for (size_t i = 0; i < spheres.size(); i++)
+		shapes.addShape(&spheres[i]);
+	std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].build(&pool);
+		shapes.addShape(&meshes[i]);
+	}
+	for (size_t i = 0; i < instances.size(); i++)
+		shapes.addShape(&instances[i]);
+	shapes.build(&pool);
+	buildTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+	return true;
+}
+
+PerspectiveCamera Scene::makeCamera(float aspectRatio) const
+{
+	return PerspectiveCamera(camera.position, camera.target, camera.up,
+		camera.fov * PI / 180.0f, aspectRatio);
+}
+
+const Light& Scene::getLight() const
+{
+	return lights.front();
+}
+
+const ShapeSet& Scene::getShapes() const
+{
+	return shapes;
+}
+
+const MaterialTable& Scene::getMaterials() const
+{
+	return materialTable;
+}
+
+int Scene::getPlaneCount() const
+{
+	return (int)planes.size();
+}
+
+int Scene::getSphereCount() const
+{
+	return (int)spheres.size();
+}
+
+int Scene::getMeshCount() const
+{
+	return (int)meshes.size();
+}
+
+int Scene::getObjectCount() const
+{
+	return (int)objects.size();
+}
+
+int Scene::getInstanceCount() const
+{
+	return (int)instances.size();
+}
+
+Sphere& Scene::getSphere(int index)
+{
+	return spheres[index];
+}
+
+Mesh& Scene::getMesh(int index)
+{
+	return meshes[index];
+}
+
+Instance& Scene::getInstance(int index)
+{
+	return instances[index];
+}
+
+SceneObject& Scene::getObject(int index)
+{
+	return *objects[index];
+}
+
+bool Scene::update()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Meshes first, the shape sets read their new bounds, and objects
+	// before the instances of them
+	bool rebuilt = false;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		SceneObject& object = *objects[i];
+		for (size_t j = 0; j < object.meshes.size(); j++)
+		{
+			if (object.meshes[j].update(&pool))
+				rebuilt = true;
+		}
+		if (object.shapes.update(&pool))
+			rebuilt = true;
+	}
+	for (size_t i = 0; i < instances.size(); i++)
+		instances[i].updateBounds();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].update(&pool))
+			rebuilt = true;
+	}
+	if (shapes.update(&pool))
+		rebuilt = true;
+	compact();
+
+	buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return rebuilt;
+}
+
+int Scene::getTriangleCount() const
+{
+	int count = 0;
+	for (size_t i = 0; i < meshes.size(); i++)
+		count += meshes[i].getTriangleCount();
+	return count;
+}
+
+SceneCacheStatus Scene::getCacheStatus() const
+{
+	return cacheStatus;
+}
+
+double Scene::getBuildTime() const
+{
+	return buildTime;
+}
+
+size_t Scene::getBVHMemory() const
+{
+	size_t bytes = shapes.getBVHMemory();
+	for (size_t i = 0; i < meshes.size(); i++)
+		bytes += meshes[i].getBVH().memoryUsage();
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		bytes += objects[i]->shapes.getBVHMemory();
+		for (size_t j = 0; j < objects[i]->meshes.size(); j++)
+			bytes += objects[i]->meshes[j].getBVH().memoryUsage();
+	}
+	return bytes;
+}
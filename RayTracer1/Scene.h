@@ -0,0 +1,233 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Camera.h"
+#include "Color.h"
+#include "MappedFile.h"
+#include "Material.h"
+#include "Shape.h"
+#include "ThreadPool.h"
+
+// Scene files are plain text, one statement per line. Words are separated
+// by blanks and everything after a '#' is a comment. Colours are 8-bit
+// sRGB like in Color::fromSRGB8, the field of view is in degrees.
+//
+//   camera   <px py pz> <tx ty tz> <ux uy uz> <fov>   position, target, up
+//   light    <x y z>
+//   material <name> diffuse <r g b> [reflectivity]
+//   material <name> mirror
+//   material <name> glass [ior]
+//   material <name> checker [<r g b> <r g b> [size]]
+//   plane    <px py pz> <nx ny nz> <material>
+//   sphere   <cx cy cz> <radius> <material>
+//   mesh     <material> [file]
+//   vertex   <x y z>
+//   triangle <i j k>
+//   object   <name>
+//   end
+//   instance <object> <tx ty tz> <ax ay az> <angle> <scale> [material]
+//
+// A scene needs exactly one camera and one light. Materials must be
+// defined before the shapes that use them and apply to every kind of
+// shape. A diffuse material with a reflectivity reflects that fraction
+// like a mirror. Glass has an index of refraction of 1.3 unless one is
+// given. A checker material colours squares of size 1 on the x-z plane,
+// by default cyan and grey. A mesh with a file is read from an
+// .obj or .ply file (see MeshLoader.h), relative paths start in the scene
+// file's directory. Without one, vertex and triangle statements add to
+// the mesh, triangles index its vertices from 0.
+//
+// Spheres and meshes between object and end make up a named object rather
+// than shapes of the scene. An instance places a defined object scaled by
+// scale, rotated by angle degrees around the axis and moved by t; all its
+// instances share the object's geometry and hierarchies. With a material
+// the instance draws every shape of the object in it. Objects cannot hold
+// planes or instances, and scenes with objects are not cached.
+struct SceneMaterial
+{
+	std::string name;
+
+	// Entry of the scene's MaterialTable
+	MaterialId id;
+};
+
+struct CameraSettings
+{
+	Point position;
+
+	Point target;
+
+	Vector up;
+
+	float fov;
+};
+
+// Geometry that instance statements place, possibly many times
+struct SceneObject
+{
+	std::string name;
+
+	std::vector<Sphere> spheres;
+
+	std::vector<Mesh> meshes;
+
+	// Bottom level hierarchy of the instances
+	ShapeSet shapes;
+};
+
+enum SceneCacheStatus
+{
+	// No cache path was given, or the scene has objects
+	SCENE_CACHE_UNUSED,
+
+	// The scene was mapped from an up to date cache
+	SCENE_CACHE_LOADED,
+
+	// The scene was parsed and the cache (re)written
+	SCENE_CACHE_WRITTEN,
+
+	// The scene was parsed but the cache could not be written
+	SCENE_CACHE_WRITE_FAILED
+};
+
+// Owns everything a scene file describes. Shapes of one kind are stored
+// by value in a single array and the ShapeSet refers to them, so loading
+// a large scene performs a handful of allocations instead of one per
+// primitive.
+class Scene
+{
+protected:
+
+	// Mesh files are parsed on it
+	ThreadPool& pool;
+
+	CameraSettings camera;
+
+	std::vector<Light> lights;
+
+	// Names of the materials in materialTable
+	std::vector<SceneMaterial> materials;
+
+	MaterialTable materialTable;
+
+	std::vector<Plane> planes;
+
+	std::vector<Sphere> spheres;
+
+	std::vector<Mesh> meshes;
+
+	// Paths of the mesh files read, a cache is stale once one changes
+	std::vector<std::string> meshFiles;
+
+	// Held by pointer since the instances point at their shape sets
+	std::vector<std::unique_ptr<SceneObject>> objects;
+
+	std::vector<Instance> instances;
+
+	ShapeSet shapes;
+
+	bool hasCamera;
+
+	// Keeps the arrays of a scene loaded from a cache mapped
+	std::unique_ptr<MappedFile> cacheFile;
+
+	SceneCacheStatus cacheStatus;
+
+	// Seconds spent building the hierarchies, 0 for a scene from the
+	// cache, or refitting them in the last update()
+	double buildTime;
+
+	const SceneMaterial* findMaterial(const char* name, size_t length) const;
+
+	const SceneObject* findObject(const char* name, size_t length) const;
+
+	// parse() without compact(), so a cache can still be written
+	bool parseText(const char* text, size_t size, const std::string& name, std::string& error);
+
+	// Drops the binary hierarchies when compressed ones are in use
+	void compact();
+
+	void clear();
+
+	friend bool readSceneCache(const std::string& path, uint64_t sourceHash, Scene& scene);
+
+	friend bool writeSceneCache(const std::string& path, uint64_t sourceHash, const Scene& scene);
+
+public:
+
+	explicit Scene(ThreadPool& pool);
+
+	// The ShapeSet points into the shape arrays
+	Scene(const Scene&) = delete;
+
+	Scene& operator =(const Scene&) = delete;
+
+	// Reads and parses a scene file and builds the acceleration structures.
+	// On failure error holds "path:line: message". With a cachePath the
+	// scene is mapped from that cache when it matches the file's contents,
+	// otherwise the cache is written after parsing (see SceneCache.h).
+	bool load(const std::string& path, std::string& error,
+		const std::string& cachePath = std::string());
+
+	// Same for a scene held in memory. name is used in error messages and
+	// mesh file paths are relative to its directory.
+	bool parse(const char* text, size_t size, const std::string& name, std::string& error);
+
+	PerspectiveCamera makeCamera(float aspectRatio) const;
+
+	const Light& getLight() const;
+
+	const ShapeSet& getShapes() const;
+
+	// Indexed by the material ids of the shapes
+	const MaterialTable& getMaterials() const;
+
+	int getPlaneCount() const;
+
+	int getSphereCount() const;
+
+	int getMeshCount() const;
+
+	int getObjectCount() const;
+
+	int getInstanceCount() const;
+
+	// Shapes to animate, e.g. with Sphere::setCentre or by moving the
+	// vertices of a mesh; update() has to follow before the next render.
+	// A scene from the cache numbers its spheres in hierarchy order rather
+	// than file order, and its meshes have no vertices.
+	Sphere& getSphere(int index);
+
+	Mesh& getMesh(int index);
+
+	// Moved with Instance::setTransform, or changed through the shapes of
+	// its object
+	Instance& getInstance(int index);
+
+	SceneObject& getObject(int index);
+
+	// Refits the hierarchies to the moved shapes, or rebuilds those that
+	// refitting made too slow (see BVH::update), objects before the
+	// instances of them. Returns true if any was rebuilt. Compressed
+	// hierarchies keep no binary tree and are always rebuilt.
+	bool update();
+
+	// Triangles of all meshes outside of objects
+	int getTriangleCount() const;
+
+	// What load() did with the cache
+	SceneCacheStatus getCacheStatus() const;
+
+	// Seconds of the load spent building the acceleration structures, or
+	// of the last update()
+	double getBuildTime() const;
+
+	// Bytes taken by the hierarchies of all shapes and objects
+	size_t getBVHMemory() const;
+};
+
+#endif // SCENE_H
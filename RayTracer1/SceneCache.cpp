@@ -0,0 +1,700 @@
+#include "SceneCache.h"
+#include "Scene.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char magic[8] = { 'R', 'T', 'S', 'C', 'A', 'C', 'H', 'E' };
+
+	// Reads back differently on machines of the other byte order
+	const uint32_t byteOrderMark = 0x01020304u;
+
+	// Sections start on cache line boundaries, which mmap preserves
+	const uint64_t sectionAlignment = 64;
+
+	// The SoA arrays and material indices are stored in this order
+	enum SphereSection
+	{
+		SECTION_X,
+		SECTION_Y,
+		SECTION_Z,
+		SECTION_R2,
+		SECTION_MATERIAL,
+		SPHERE_SECTION_COUNT
+	};
+
+	// Same for the TriangleArrays of a mesh
+	enum TriangleSection
+	{
+		SECTION_V0X,
+		SECTION_V0Y,
+		SECTION_V0Z,
+		SECTION_E1X,
+		SECTION_E1Y,
+		SECTION_E1Z,
+		SECTION_E2X,
+		SECTION_E2Y,
+		SECTION_E2Z,
+		TRIANGLE_SECTION_COUNT
+	};
+
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint64_t sourceHash;
+
+		// Parameters the stored layout depends on
+		uint32_t nodeSize;
+		uint32_t soaWidth;
+		uint32_t triangleWidth;
+		uint32_t maxLeafSize;
+		uint32_t binCount;
+
+		// Position, target, up and field of view
+		float camera[10];
+		float light[3];
+
+		// Materials after MATERIAL_NONE, which every table starts with
+		uint32_t materialCount;
+		uint32_t textureCount;
+		uint32_t planeCount;
+		uint32_t sphereCount;
+		uint32_t nodeCount;
+		uint32_t meshCount;
+		uint32_t dependencyCount;
+		uint32_t reserved;
+		uint64_t dependencySize;
+
+		// CacheDependency records of the mesh files
+		uint64_t dependencyOffset;
+		uint64_t materialOffset;
+		uint64_t textureOffset;
+		uint64_t planeOffset;
+		uint64_t sphereOffsets[SPHERE_SECTION_COUNT];
+		uint64_t nodeOffset;
+
+		// Table of CacheMesh entries, their sections follow it
+		uint64_t meshOffset;
+		uint64_t fileSize;
+	};
+
+	struct CacheMaterial
+	{
+		float diffuse[3];
+		float reflectivity;
+		float ior;
+		int32_t texture;
+	};
+
+	struct CacheTexture
+	{
+		float dark[3];
+		float light[3];
+		float cellSize;
+	};
+
+	// Planes, spheres and meshes store MaterialIds as uint32_t
+	struct CachePlane
+	{
+		float position[3];
+		float normal[3];
+		uint32_t material;
+	};
+
+	// Followed by pathLength bytes of path, padded to 8 bytes
+	struct CacheDependency
+	{
+		uint64_t size;
+		int64_t modified;
+		uint32_t pathLength;
+		uint32_t reserved;
+	};
+
+	struct CacheMesh
+	{
+		uint32_t material;
+		uint32_t triangleCount;
+		uint32_t nodeCount;
+		uint32_t reserved;
+
+		uint64_t triangleOffsets[TRIANGLE_SECTION_COUNT];
+		uint64_t nodeOffset;
+	};
+
+	static_assert(std::is_trivially_copyable<BVHNode>::value, "BVH nodes are stored as raw bytes");
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+	}
+
+	uint64_t dependencyRecordSize(uint64_t pathLength)
+	{
+		return (sizeof(CacheDependency) + pathLength + 7) & ~(uint64_t)7;
+	}
+
+	bool fileStamp(const std::string& path, CacheDependency& stamp)
+	{
+		struct stat status;
+		if (stat(path.c_str(), &status) != 0)
+			return false;
+		stamp.size = (uint64_t)status.st_size;
+		stamp.modified = (int64_t)status.st_mtime;
+		return true;
+	}
+
+	// True if every file recorded in the dependency section is unchanged
+	bool dependenciesCurrent(const unsigned char* data, const CacheHeader& header)
+	{
+		uint64_t position = 0;
+		for (uint32_t i = 0; i < header.dependencyCount; i++)
+		{
+			CacheDependency recorded;
+			if (header.dependencySize - position < sizeof(recorded))
+				return false;
+			std::memcpy(&recorded, data + header.dependencyOffset + position, sizeof(recorded));
+			if (recorded.pathLength > header.dependencySize - position - sizeof(recorded))
+				return false;
+
+			const char* path = (const char*)data + header.dependencyOffset + position + sizeof(recorded);
+			CacheDependency current;
+			if (!fileStamp(std::string(path, recorded.pathLength), current)
+				|| current.size != recorded.size
+				|| current.modified != recorded.modified)
+			{
+				return false;
+			}
+			position += dependencyRecordSize(recorded.pathLength);
+		}
+		return position == header.dependencySize;
+	}
+
+	void setLayout(CacheHeader& header)
+	{
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.version = SCENE_CACHE_VERSION;
+		header.byteOrder = byteOrderMark;
+		header.nodeSize = sizeof(BVHNode);
+		header.soaWidth = SPHERE_SOA_WIDTH;
+		header.triangleWidth = TRIANGLE_SOA_WIDTH;
+		header.maxLeafSize = BVH_MAX_LEAF_SIZE;
+		header.binCount = BVH_BIN_COUNT;
+	}
+
+	// Places the sections one after another and fills in the offsets. The
+	// sections of the meshes are only placed for the entries in meshes,
+	// whose counts must be set.
+	void setOffsets(CacheHeader& header, std::vector<CacheMesh>& meshes)
+	{
+		uint64_t padded = (uint64_t)header.sphereCount + SPHERE_SOA_WIDTH;
+
+		uint64_t offset = align(sizeof(CacheHeader));
+		header.dependencyOffset = offset;
+		offset = align(offset + header.dependencySize);
+		header.materialOffset = offset;
+		offset = align(offset + header.materialCount * sizeof(CacheMaterial));
+		header.textureOffset = offset;
+		offset = align(offset + header.textureCount * sizeof(CacheTexture));
+		header.planeOffset = offset;
+		offset = align(offset + header.planeCount * sizeof(CachePlane));
+		for (int i = 0; i < SPHERE_SECTION_COUNT; i++)
+		{
+			header.sphereOffsets[i] = offset;
+			offset = align(offset + padded * sizeof(float));
+		}
+		header.nodeOffset = offset;
+		offset = align(offset + header.nodeCount * sizeof(BVHNode));
+		header.meshOffset = offset;
+		offset += header.meshCount * sizeof(CacheMesh);
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			CacheMesh& mesh = meshes[i];
+			uint64_t paddedTriangles = (uint64_t)mesh.triangleCount + TRIANGLE_SOA_WIDTH;
+			for (int j = 0; j < TRIANGLE_SECTION_COUNT; j++)
+			{
+				offset = align(offset);
+				mesh.triangleOffsets[j] = offset;
+				offset += paddedTriangles * sizeof(float);
+			}
+			offset = align(offset);
+			mesh.nodeOffset = offset;
+			offset += mesh.nodeCount * sizeof(BVHNode);
+		}
+		header.fileSize = offset;
+	}
+
+	TriangleArrays triangleArrays(const unsigned char* data, const CacheMesh& mesh)
+	{
+		const uint64_t* offsets = mesh.triangleOffsets;
+		TriangleArrays arrays = {
+			(const float*)(data + offsets[SECTION_V0X]),
+			(const float*)(data + offsets[SECTION_V0Y]),
+			(const float*)(data + offsets[SECTION_V0Z]),
+			(const float*)(data + offsets[SECTION_E1X]),
+			(const float*)(data + offsets[SECTION_E1Y]),
+			(const float*)(data + offsets[SECTION_E1Z]),
+			(const float*)(data + offsets[SECTION_E2X]),
+			(const float*)(data + offsets[SECTION_E2Y]),
+			(const float*)(data + offsets[SECTION_E2Z])
+		};
+		return arrays;
+	}
+
+	// True if the nodes form a single tree, children after their parents,
+	// whose leaves lie within primitiveCount primitives and which the
+	// traversal stacks can hold. Mapped nodes are traversed as they are, so
+	// a damaged file must not get past this.
+	bool validTree(const BVHNode* nodes, uint32_t nodeCount, uint32_t primitiveCount)
+	{
+		// Levels from the root down to each node, 0 until a parent names it
+		std::vector<unsigned char> level(nodeCount, 0);
+		if (nodeCount > 0)
+			level[0] = 1;
+		for (uint32_t i = 0; i < nodeCount; i++)
+		{
+			const BVHNode& node = nodes[i];
+			if (level[i] == 0)
+				return false;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				// Also false for NaN
+				if (!(component(node.bounds.min, axis) <= component(node.bounds.max, axis)))
+					return false;
+			}
+
+			if (node.isLeaf())
+			{
+				if (node.count > BVH_MAX_LEAF_SIZE || node.offset < 0
+					|| (uint64_t)node.offset + (uint64_t)node.count > primitiveCount)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			// The first child follows directly, each node has one parent
+			uint32_t second = (uint32_t)node.offset;
+			if (node.count < 0 || node.offset < 0 || second <= i + 1 || second >= nodeCount
+				|| level[i + 1] != 0 || level[second] != 0 || level[i] >= BVH_STACK_SIZE)
+			{
+				return false;
+			}
+			level[i + 1] = (unsigned char)(level[i] + 1);
+			level[second] = (unsigned char)(level[i] + 1);
+		}
+		return true;
+	}
+
+	// Opens a new file next to path, named after the process and a counter
+	// so that concurrent writers never share one. "x" fails rather than
+	// reuse an existing file, e.g. one a crashed run left behind.
+	FILE* createTemporary(const std::string& path, std::string& temporary)
+	{
+		static std::atomic<unsigned> counter(0);
+#ifdef _WIN32
+		int process = _getpid();
+#else
+		int process = (int)getpid();
+#endif
+		for (int attempt = 0; attempt < 100; attempt++)
+		{
+			temporary = path + "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+			FILE* file = std::fopen(temporary.c_str(), "wbx");
+			if (file || errno != EEXIST)
+				return file;
+		}
+		return NULL;
+	}
+
+	// Pads from position up to offset and writes size bytes there
+	bool writeSection(FILE* file, uint64_t& position, uint64_t offset, const void* data, size_t size)
+	{
+		static const char zeros[sectionAlignment] = { 0 };
+		if (offset - position > sectionAlignment
+			|| std::fwrite(zeros, 1, (size_t)(offset - position), file) != offset - position)
+		{
+			return false;
+		}
+		position = offset + size;
+		return size == 0 || std::fwrite(data, 1, size, file) == size;
+	}
+}
+
+uint64_t hashSceneText(const char* text, size_t size)
+{
+	// Eight bytes per multiply, enough to notice any edit of the source
+	const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+	uint64_t hash = (uint64_t)size * multiplier;
+
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, text + i, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t tail = 0;
+	std::memcpy(&tail, text + i, size - i);
+	hash = (hash ^ tail) * multiplier;
+
+	hash ^= hash >> 32;
+	hash *= 0xd6e8feb86659fd93ull;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+bool readSceneCache(const std::string& path, uint64_t sourceHash, Scene& scene)
+{
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(path) || file->getSize() < sizeof(CacheHeader))
+		return false;
+
+	const unsigned char* data = file->getData();
+	CacheHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	CacheHeader expected;
+	std::memset(&expected, 0, sizeof(expected));
+	setLayout(expected);
+	if (std::memcmp(header.magic, expected.magic, sizeof(magic)) != 0
+		|| header.version != expected.version
+		|| header.byteOrder != expected.byteOrder
+		|| header.nodeSize != expected.nodeSize
+		|| header.soaWidth != expected.soaWidth
+		|| header.triangleWidth != expected.triangleWidth
+		|| header.maxLeafSize != expected.maxLeafSize
+		|| header.binCount != expected.binCount
+		|| header.sourceHash != sourceHash)
+	{
+		return false;
+	}
+
+	// The offsets follow from the counts, anything else is a damaged file.
+	// The mesh table has to be read before the mesh sections can be placed.
+	expected.materialCount = header.materialCount;
+	expected.textureCount = header.textureCount;
+	expected.planeCount = header.planeCount;
+	expected.sphereCount = header.sphereCount;
+	expected.nodeCount = header.nodeCount;
+	expected.meshCount = header.meshCount;
+	expected.dependencyCount = header.dependencyCount;
+	expected.dependencySize = header.dependencySize;
+	if (header.dependencySize > file->getSize()
+		|| header.materialCount >= MATERIAL_MAX_COUNT
+		|| header.textureCount > file->getSize() / sizeof(CacheTexture))
+	{
+		return false;
+	}
+	std::vector<CacheMesh> meshes;
+	setOffsets(expected, meshes);
+	if (header.meshCount > file->getSize() / sizeof(CacheMesh)
+		|| expected.meshOffset + header.meshCount * sizeof(CacheMesh) > file->getSize())
+	{
+		return false;
+	}
+
+	const CacheMesh* meshTable = (const CacheMesh*)(data + expected.meshOffset);
+	meshes.assign(meshTable, meshTable + header.meshCount);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].material > header.materialCount
+			|| meshes[i].triangleCount > 0x7fffffffu - TRIANGLE_SOA_WIDTH
+			|| meshes[i].nodeCount > 0x7fffffffu)
+		{
+			return false;
+		}
+	}
+	setOffsets(expected, meshes);
+	if (std::memcmp(&header.dependencyOffset, &expected.dependencyOffset,
+			sizeof(CacheHeader) - offsetof(CacheHeader, dependencyOffset)) != 0
+		|| (!meshes.empty() && std::memcmp(meshTable, meshes.data(), meshes.size() * sizeof(CacheMesh)) != 0)
+		|| header.fileSize != file->getSize()
+		|| header.sphereCount > 0x7fffffffu - SPHERE_SOA_WIDTH
+		|| header.nodeCount > 0x7fffffffu)
+	{
+		return false;
+	}
+
+	if (!dependenciesCurrent(data, header))
+		return false;
+
+	const CacheMaterial* materials = (const CacheMaterial*)(data + header.materialOffset);
+	const CacheTexture* textures = (const CacheTexture*)(data + header.textureOffset);
+	const CachePlane* planes = (const CachePlane*)(data + header.planeOffset);
+	const uint32_t* sphereMaterials = (const uint32_t*)(data + header.sphereOffsets[SECTION_MATERIAL]);
+	for (uint32_t i = 0; i < header.materialCount; i++)
+	{
+		if (materials[i].texture < -1 || materials[i].texture >= (int32_t)header.textureCount)
+			return false;
+	}
+	for (uint32_t i = 0; i < header.planeCount; i++)
+	{
+		if (planes[i].material > header.materialCount)
+			return false;
+	}
+	for (uint32_t i = 0; i < header.sphereCount; i++)
+	{
+		if (sphereMaterials[i] > header.materialCount)
+			return false;
+	}
+	if (!validTree((const BVHNode*)(data + header.nodeOffset), header.nodeCount, header.sphereCount))
+		return false;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (!validTree((const BVHNode*)(data + meshes[i].nodeOffset), meshes[i].nodeCount, meshes[i].triangleCount))
+			return false;
+	}
+
+	// Shading still goes through Sphere objects, they are the only copy
+	scene.clear();
+	const float* c = header.camera;
+	scene.camera.position = Point(c[0], c[1], c[2]);
+	scene.camera.target = Point(c[3], c[4], c[5]);
+	scene.camera.up = Vector(c[6], c[7], c[8]);
+	scene.camera.fov = c[9];
+	scene.hasCamera = true;
+	scene.lights.push_back(Light(Point(header.light[0], header.light[1], header.light[2])));
+
+	// The names are only needed while parsing
+	for (uint32_t i = 0; i < header.textureCount; i++)
+	{
+		const CacheTexture& stored = textures[i];
+		CheckerTexture texture = {
+			Color(stored.dark[0], stored.dark[1], stored.dark[2]),
+			Color(stored.light[0], stored.light[1], stored.light[2]),
+			stored.cellSize
+		};
+		scene.materialTable.addTexture(texture);
+	}
+	for (uint32_t i = 0; i < header.materialCount; i++)
+	{
+		const CacheMaterial& stored = materials[i];
+		Material material;
+		material.diffuse = Color(stored.diffuse[0], stored.diffuse[1], stored.diffuse[2]);
+		material.reflectivity = stored.reflectivity;
+		material.ior = stored.ior;
+		material.texture = stored.texture;
+		scene.materialTable.add(material);
+	}
+
+	scene.planes.reserve(header.planeCount);
+	for (uint32_t i = 0; i < header.planeCount; i++)
+	{
+		const CachePlane& plane = planes[i];
+		scene.planes.push_back(Plane(Point(plane.position[0], plane.position[1], plane.position[2]),
+			Vector(plane.normal[0], plane.normal[1], plane.normal[2]), (MaterialId)plane.material));
+	}
+
+	SphereArrays arrays = {
+		(const float*)(data + header.sphereOffsets[SECTION_X]),
+		(const float*)(data + header.sphereOffsets[SECTION_Y]),
+		(const float*)(data + header.sphereOffsets[SECTION_Z]),
+		(const float*)(data + header.sphereOffsets[SECTION_R2])
+	};
+	scene.spheres.reserve(header.sphereCount);
+	for (uint32_t i = 0; i < header.sphereCount; i++)
+	{
+		scene.spheres.push_back(Sphere(Point(arrays.x[i], arrays.y[i], arrays.z[i]),
+			std::sqrt(arrays.r2[i]), (MaterialId)sphereMaterials[i]));
+	}
+
+	// Meshes use their triangles and nodes in place
+	scene.meshes.reserve(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		scene.meshes.push_back(Mesh((MaterialId)meshes[i].material));
+		scene.meshes.back().attach(triangleArrays(data, meshes[i]), (int)meshes[i].triangleCount,
+			(const BVHNode*)(data + meshes[i].nodeOffset), (int)meshes[i].nodeCount);
+	}
+
+	for (uint64_t position = 0; position < header.dependencySize; )
+	{
+		CacheDependency recorded;
+		std::memcpy(&recorded, data + header.dependencyOffset + position, sizeof(recorded));
+		const char* path = (const char*)data + header.dependencyOffset + position + sizeof(recorded);
+		scene.meshFiles.push_back(std::string(path, recorded.pathLength));
+		position += dependencyRecordSize(recorded.pathLength);
+	}
+
+	for (size_t i = 0; i < scene.planes.size(); i++)
+		scene.shapes.addShape(&scene.planes[i]);
+	for (size_t i = 0; i < scene.meshes.size(); i++)
+		scene.shapes.addShape(&scene.meshes[i]);
+	scene.shapes.build(&scene.pool);
+	scene.shapes.attachSpheres(scene.spheres.data(), arrays, (int)header.sphereCount,
+		(const BVHNode*)(data + header.nodeOffset), (int)header.nodeCount);
+
+	scene.cacheFile = std::move(file);
+	return true;
+}
+
+bool writeSceneCache(const std::string& path, uint64_t sourceHash, const Scene& scene)
+{
+	const ShapeSet& shapes = scene.shapes;
+	const SphereSoA& spheres = shapes.getSpheres();
+	const std::vector<const Sphere*>& sphereShapes = shapes.getSphereShapes();
+	const BVH& bvh = shapes.getSphereBVH();
+
+	CacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	setLayout(header);
+	header.sourceHash = sourceHash;
+
+	const CameraSettings& camera = scene.camera;
+	float values[10] = {
+		camera.position.x, camera.position.y, camera.position.z,
+		camera.target.x, camera.target.y, camera.target.z,
+		camera.up.x, camera.up.y, camera.up.z, camera.fov
+	};
+	std::memcpy(header.camera, values, sizeof(values));
+	const Point& light = scene.getLight().position;
+	header.light[0] = light.x;
+	header.light[1] = light.y;
+	header.light[2] = light.z;
+
+	const MaterialTable& table = scene.materialTable;
+	header.materialCount = (uint32_t)(table.size() - 1);
+	header.textureCount = (uint32_t)table.getTextureCount();
+	header.planeCount = (uint32_t)scene.planes.size();
+	header.sphereCount = (uint32_t)spheres.size();
+	header.nodeCount = (uint32_t)bvh.nodeCount();
+	header.meshCount = (uint32_t)scene.meshes.size();
+
+	// The mesh files as they are now, the scene was just read from them
+	std::vector<unsigned char> dependencies;
+	for (size_t i = 0; i < scene.meshFiles.size(); i++)
+	{
+		const std::string& path = scene.meshFiles[i];
+		CacheDependency stamp;
+		std::memset(&stamp, 0, sizeof(stamp));
+		if (!fileStamp(path, stamp))
+			return false;
+		stamp.pathLength = (uint32_t)path.size();
+
+		size_t position = dependencies.size();
+		dependencies.resize(position + dependencyRecordSize(path.size()), 0);
+		std::memcpy(&dependencies[position], &stamp, sizeof(stamp));
+		std::memcpy(&dependencies[position + sizeof(stamp)], path.data(), path.size());
+	}
+	header.dependencyCount = (uint32_t)scene.meshFiles.size();
+	header.dependencySize = dependencies.size();
+
+	std::vector<CacheMesh> meshes(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount; i++)
+	{
+		std::memset(&meshes[i], 0, sizeof(CacheMesh));
+		meshes[i].material = scene.meshes[i].material;
+		meshes[i].triangleCount = (uint32_t)scene.meshes[i].getTriangleCount();
+		meshes[i].nodeCount = (uint32_t)scene.meshes[i].getBVH().nodeCount();
+	}
+	setOffsets(header, meshes);
+
+	std::vector<CacheMaterial> materials(header.materialCount);
+	for (uint32_t i = 0; i < header.materialCount; i++)
+	{
+		const Material& material = table[(MaterialId)(i + 1)];
+		materials[i].diffuse[0] = material.diffuse.r;
+		materials[i].diffuse[1] = material.diffuse.g;
+		materials[i].diffuse[2] = material.diffuse.b;
+		materials[i].reflectivity = material.reflectivity;
+		materials[i].ior = material.ior;
+		materials[i].texture = material.texture;
+	}
+
+	std::vector<CacheTexture> textures(header.textureCount);
+	for (uint32_t i = 0; i < header.textureCount; i++)
+	{
+		const CheckerTexture& texture = table.getTexture((int)i);
+		float values[7] = { texture.dark.r, texture.dark.g, texture.dark.b,
+			texture.light.r, texture.light.g, texture.light.b, texture.cellSize };
+		std::memcpy(&textures[i], values, sizeof(values));
+	}
+
+	std::vector<CachePlane> planes(header.planeCount);
+	for (uint32_t i = 0; i < header.planeCount; i++)
+	{
+		const Plane& plane = scene.planes[i];
+		const Point& position = plane.getPosition();
+		const Vector& normal = plane.getNormal();
+		float values[6] = { position.x, position.y, position.z, normal.x, normal.y, normal.z };
+		std::memcpy(planes[i].position, values, sizeof(planes[i].position));
+		std::memcpy(planes[i].normal, values + 3, sizeof(planes[i].normal));
+		planes[i].material = plane.material;
+	}
+
+	// Material of each sphere in hierarchy order
+	std::vector<uint32_t> sphereMaterials(header.sphereCount + SPHERE_SOA_WIDTH, 0);
+	for (uint32_t i = 0; i < header.sphereCount; i++)
+		sphereMaterials[i] = sphereShapes[i]->material;
+
+	std::string temporary;
+	FILE* file = createTemporary(path, temporary);
+	if (!file)
+		return false;
+
+	SphereArrays arrays = spheres.arrays();
+	size_t arraySize = (header.sphereCount + SPHERE_SOA_WIDTH) * sizeof(float);
+	uint64_t position = 0;
+	bool ok = writeSection(file, position, 0, &header, sizeof(header))
+		&& writeSection(file, position, header.dependencyOffset, dependencies.data(), dependencies.size())
+		&& writeSection(file, position, header.materialOffset, materials.data(), materials.size() * sizeof(CacheMaterial))
+		&& writeSection(file, position, header.textureOffset, textures.data(), textures.size() * sizeof(CacheTexture))
+		&& writeSection(file, position, header.planeOffset, planes.data(), planes.size() * sizeof(CachePlane))
+		&& writeSection(file, position, header.sphereOffsets[SECTION_X], arrays.x, arraySize)
+		&& writeSection(file, position, header.sphereOffsets[SECTION_Y], arrays.y, arraySize)
+		&& writeSection(file, position, header.sphereOffsets[SECTION_Z], arrays.z, arraySize)
+		&& writeSection(file, position, header.sphereOffsets[SECTION_R2], arrays.r2, arraySize)
+		&& writeSection(file, position, header.sphereOffsets[SECTION_MATERIAL], sphereMaterials.data(), arraySize)
+		&& writeSection(file, position, header.nodeOffset, bvh.getNodes(), header.nodeCount * sizeof(BVHNode))
+		&& writeSection(file, position, header.meshOffset, meshes.data(), meshes.size() * sizeof(CacheMesh));
+
+	for (uint32_t i = 0; ok && i < header.meshCount; i++)
+	{
+		const Mesh& mesh = scene.meshes[i];
+		TriangleArrays triangles = mesh.getTriangles().arrays();
+		const float* sections[TRIANGLE_SECTION_COUNT] = {
+			triangles.v0x, triangles.v0y, triangles.v0z,
+			triangles.e1x, triangles.e1y, triangles.e1z,
+			triangles.e2x, triangles.e2y, triangles.e2z
+		};
+		size_t triangleSize = (meshes[i].triangleCount + TRIANGLE_SOA_WIDTH) * sizeof(float);
+		for (int j = 0; ok && j < TRIANGLE_SECTION_COUNT; j++)
+			ok = writeSection(file, position, meshes[i].triangleOffsets[j], sections[j], triangleSize);
+		ok = ok && writeSection(file, position, meshes[i].nodeOffset, mesh.getBVH().getNodes(),
+			meshes[i].nodeCount * sizeof(BVHNode));
+	}
+	ok = std::fclose(file) == 0 && ok;
+
+	// POSIX rename() replaces the old cache in one step, so readers always
+	// find a whole file; Windows refuses to replace it
+	if (ok)
+	{
+#ifdef _WIN32
+		std::remove(path.c_str());
+#endif
+		ok = std::rename(temporary.c_str(), path.c_str()) == 0;
+	}
+	if (!ok)
+		std::remove(temporary.c_str());
+	return ok;
+}
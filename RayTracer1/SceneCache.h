@@ -0,0 +1,36 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Bumped whenever the file layout, the parser's output or the BVH build
+// changes, so caches written by other versions are ignored
+#define SCENE_CACHE_VERSION 4
+
+class Scene;
+
+// A scene cache holds a parsed scene in the layout the renderer uses:
+// the spheres' and every mesh's SoA arrays in hierarchy order and the
+// finished BVH nodes, each 64-byte aligned. It is mapped and used in place, so loading costs
+// a header check and page faults instead of parsing and a BVH build. The
+// file is only valid on machines with the same byte order and struct
+// layout, which the header records. Mesh files the scene reads are
+// recorded by path, size and modification time; a change to any of them
+// makes the cache stale just like an edit of the scene text.
+
+// 64-bit hash of the scene text that a cache is keyed by
+uint64_t hashSceneText(const char* text, size_t size);
+
+// Maps the cache at path into scene if it was written by this version for
+// a source with the given hash. Returns false, leaving scene untouched,
+// for missing, stale or damaged files.
+bool readSceneCache(const std::string& path, uint64_t sourceHash, Scene& scene);
+
+// Writes the cache for a scene that was parsed from a source with the
+// given hash. The file is written next to path and renamed into place, so
+// concurrent readers never see half of it.
+bool writeSceneCache(const std::string& path, uint64_t sourceHash, const Scene& scene);
+
+#endif // SCENECACHE_H
@@ -1,10 +1,123 @@
 #include "Shape.h"
+#include "ThreadPool.h"
 
-Ray Shape::makeRay(Intersection& intersection, Light light_source)
+#include <functional>
+
+// Shortest range of primitives a pool hands to one worker
+static const int parallelGrain = 1 << 16;
+
+// body(range, begin, end, worker) over [0, count), on all workers of the
+// pool if there is one
+static void forRanges(ThreadPool* pool, int count,
+	const std::function<void(int range, int begin, int end, unsigned worker)>& body)
+{
+	if (pool)
+		pool->parallelRanges(count, parallelGrain, body);
+	else
+		body(0, 0, count, 0);
+}
+
+// Brings a hierarchy over shapes stored in its leaf order up to date after
+// they moved, and puts them in the new leaf order if it was rebuilt
+template <typename T>
+static bool updateShapes(BVH& bvh, std::vector<const T*>& leafOrder, ThreadPool* pool)
+{
+	int count = (int)leafOrder.size();
+	if (count == 0)
+		return false;
+
+	// The shapes in the order the tree was built over, which is the leaf
+	// order itself once the indices are gone
+	const std::vector<int>& indices = bvh.getIndices();
+	std::vector<const T*> built(count);
+	std::vector<AABB> bounds(count);
+	forRanges(pool, count, [&](int range, int begin, int end, unsigned worker)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			int index = indices.empty() ? i : indices[i];
+			built[index] = leafOrder[i];
+			bounds[index] = leafOrder[i]->bounds();
+		}
+	});
+
+	if (!bvh.update(bounds, pool))
+		return false;
+
+	const std::vector<int>& order = bvh.getIndices();
+	for (int i = 0; i < count; i++)
+		leafOrder[i] = built[order[i]];
+	return true;
+}
+
+// Distance along the ray to the plane, 0 when the ray runs parallel to it
+static inline float planeDistance(const Point& position, const Vector& normal, const Ray& ray)
+{
+	// First, check if we intersect
+	float dDotN = dot(ray.direction, normal);
+
+	if (dDotN == 0.0f)
+	{
+		// We just assume the ray is not embedded in the plane
+		return 0.0f;
+	}
+
+	// Find point of intersection
+	return dot(position - ray.origin, normal) / dDotN;
+}
+
+// Closest hit among shapes of one class in the leaf order of their
+// hierarchy. T::intersect is called directly, not through the vtable.
+template <typename T>
+static bool intersectTyped(const BVH& bvh, const std::vector<const T*>& shapes, Intersection& intersection)
+{
+	return bvh.intersect(intersection.ray, intersection.t, [&](int first, int count)
+	{
+		bool hit = false;
+		for (int i = first; i < first + count; i++)
+		{
+			if (shapes[i]->T::intersect(intersection))
+				hit = true;
+		}
+		return hit;
+	});
+}
+
+template <typename T>
+static bool occludedTyped(const BVH& bvh, const std::vector<const T*>& shapes, const Ray& ray)
+{
+	return bvh.occluded(ray, [&](int first, int count)
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			if (shapes[i]->T::doesIntersect(ray))
+				return true;
+		}
+		return false;
+	});
+}
+
+Ray Shape::makeRay(const Intersection& intersection, const Light& light_source) const
 {
-	Vector direction = light_source.position - intersection.position();//?
+	Point position = intersection.position();
+	Vector direction = light_source.position - position;
 
-	return Ray((intersection.position() ), direction.normalized());
+	// Occluders beyond the light must not cast shadows
+	float distance = direction.normalize();
+
+	return Ray(position, direction, distance);
+}
+
+void Shape::intersectBatch(Intersection* intersections, int count, bool* results) const
+{
+	for (int i = 0; i < count; i++)
+		results[i] = intersect(intersections[i]);
+}
+
+void Shape::occluded(const Ray* rays, int count, bool* results) const
+{
+	for (int i = 0; i < count; i++)
+		results[i] = doesIntersect(rays[i]);
 }
 
 
@@ -12,7 +125,7 @@ Ray Shape::makeRay(Intersection& intersection, Light light_source)
 //Shapeset
 ShapeSet::ShapeSet()
 {
-	
+	this->material = MATERIAL_NONE;
 }
 
 ShapeSet::~ShapeSet()
@@ -25,95 +138,427 @@ void ShapeSet::addShape(Shape* shape)
 	shapes.push_back(shape);
 }
 
-bool ShapeSet::intersect(Intersection& intersection)
+void ShapeSet::reserve(int capacity)
 {
-	bool doesIntersect = false;
+	shapes.reserve(capacity);
+}
 
-	for (std::vector<Shape*>::iterator iter = shapes.begin();
-		iter != shapes.end();
+void ShapeSet::clear()
+{
+	shapes.clear();
+	build();
+}
+
+// Builds the hierarchy over shapes of one class and stores them in its
+// leaf order, so a leaf is a contiguous range
+template <typename T>
+static void buildTyped(BVH& bvh, std::vector<const T*>& leafOrder, const std::vector<const T*>& shapes,
+	const std::vector<AABB>& bounds, ThreadPool* pool)
+{
+	bvh.build(bounds, pool);
+	const std::vector<int>& indices = bvh.getIndices();
+	leafOrder.clear();
+	leafOrder.reserve(indices.size());
+	for (std::vector<int>::const_iterator iter = indices.begin();
+		iter != indices.end();
 		++iter)
 	{
-		Shape* curShape = *iter;
-		if (curShape->intersect(intersection))
-			doesIntersect = true;
+		leafOrder.push_back(shapes[*iter]);
 	}
-
-	return doesIntersect;
 }
 
-bool ShapeSet::doesIntersect(const Ray& ray)
+void ShapeSet::build(ThreadPool* pool)
 {
-	for (std::vector<Shape*>::iterator iter = shapes.begin();
+	planes.clear();
+	planeShapes.clear();
+	unbounded.clear();
+	spheres.clear();
+	sphereShapes.clear();
+
+	std::vector<const Sphere*> sphereList;
+	std::vector<AABB> sphereBounds;
+	std::vector<const Mesh*> meshList;
+	std::vector<AABB> meshBounds;
+	std::vector<const Instance*> instanceList;
+	std::vector<AABB> instanceBounds;
+	std::vector<const Shape*> finite;
+	std::vector<AABB> finiteBounds;
+
+	for (std::vector<Shape*>::const_iterator iter = shapes.begin();
 		iter != shapes.end();
 		++iter)
 	{
 		Shape* curShape = *iter;
-		if (curShape->doesIntersect(ray))
-			return true;
+		AABB box = curShape->bounds();
+		const Sphere* sphere = dynamic_cast<const Sphere*>(curShape);
+		const Plane* plane = dynamic_cast<const Plane*>(curShape);
+		if (sphere)
+		{
+			sphereList.push_back(sphere);
+			sphereBounds.push_back(box);
+		}
+		else if (plane)
+		{
+			PlaneRecord record = { plane->getPosition(), plane->getNormal() };
+			planes.push_back(record);
+			planeShapes.push_back(plane);
+		}
+		else if (!box.isFinite())
+		{
+			unbounded.push_back(curShape);
+		}
+		else if (const Mesh* mesh = dynamic_cast<const Mesh*>(curShape))
+		{
+			meshList.push_back(mesh);
+			meshBounds.push_back(box);
+		}
+		else if (const Instance* instance = dynamic_cast<const Instance*>(curShape))
+		{
+			instanceList.push_back(instance);
+			instanceBounds.push_back(box);
+		}
+		else
+		{
+			finite.push_back(curShape);
+			finiteBounds.push_back(box);
+		}
 	}
 
-	return false;
+	buildTyped(meshBVH, meshShapes, meshList, meshBounds, pool);
+	buildTyped(instanceBVH, instanceShapes, instanceList, instanceBounds, pool);
+	buildTyped(bvh, bounded, finite, finiteBounds, pool);
+	sphereBVH.build(sphereBounds, pool);
+
+	const std::vector<int>& sphereIndices = sphereBVH.getIndices();
+	spheres.reserve((int)sphereIndices.size());
+	for (std::vector<int>::const_iterator iter = sphereIndices.begin();
+		iter != sphereIndices.end();
+		++iter)
+	{
+		const Sphere* sphere = sphereList[*iter];
+		spheres.add(sphere->getCentre(), sphere->getRadius());
+		sphereShapes.push_back(sphere);
+	}
 }
 
-void ShapeSet::setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source)
+void ShapeSet::attachSpheres(Sphere* shapes, const SphereArrays& arrays, int count,
+	const BVHNode* nodes, int nodeCount)
 {
-	for (std::vector<Shape*>::iterator iter = shapes.begin();
-		iter != shapes.end();
-		++iter)
+	sphereShapes.clear();
+	sphereShapes.reserve(count);
+	this->shapes.reserve(this->shapes.size() + count);
+	for (int i = 0; i < count; i++)
 	{
-		Shape* curShape = *iter;
-	    curShape->setColor(intersection, scene, shadow, light_source);
+		this->shapes.push_back(&shapes[i]);
+		sphereShapes.push_back(&shapes[i]);
 	}
+
+	spheres.attach(arrays, count);
+	sphereBVH.attach(nodes, nodeCount);
 }
 
-Ray ShapeSet::returnNormal(Intersection& intersection)
+const SphereSoA& ShapeSet::getSpheres() const
 {
-	for (std::vector<Shape*>::iterator iter = shapes.begin();
-		iter != shapes.end();
-		++iter)
+	return spheres;
+}
+
+const std::vector<const Sphere*>& ShapeSet::getSphereShapes() const
+{
+	return sphereShapes;
+}
+
+const BVH& ShapeSet::getSphereBVH() const
+{
+	return sphereBVH;
+}
+
+void ShapeSet::compact()
+{
+	meshBVH.compact();
+	instanceBVH.compact();
+	bvh.compact();
+	sphereBVH.compact();
+}
+
+size_t ShapeSet::getBVHMemory() const
+{
+	return meshBVH.memoryUsage() + instanceBVH.memoryUsage() + bvh.memoryUsage() + sphereBVH.memoryUsage();
+}
+
+bool ShapeSet::update(ThreadPool* pool)
+{
+	bool rebuilt = updateShapes(meshBVH, meshShapes, pool);
+	if (updateShapes(instanceBVH, instanceShapes, pool))
+		rebuilt = true;
+	if (updateShapes(bvh, bounded, pool))
+		rebuilt = true;
+
+	int count = (int)sphereShapes.size();
+	if (updateShapes(sphereBVH, sphereShapes, pool))
 	{
-		Shape* curShape = *iter;
-		return curShape->returnNormal(intersection);
+		rebuilt = true;
+		spheres.clear();
+		spheres.reserve(count);
+		for (int i = 0; i < count; i++)
+			spheres.add(sphereShapes[i]->getCentre(), sphereShapes[i]->getRadius());
 	}
+	else
+	{
+		forRanges(pool, count, [&](int range, int begin, int end, unsigned worker)
+		{
+			for (int i = begin; i < end; i++)
+				spheres.set(i, sphereShapes[i]->getCentre(), sphereShapes[i]->getRadius());
+		});
+	}
+	return rebuilt;
 }
 
-Ray ShapeSet::makeReflectedRay(Intersection& intersection)
+bool ShapeSet::intersectOthers(Intersection& intersection) const
 {
-	for (std::vector<Shape*>::iterator iter = shapes.begin();
-		iter != shapes.end();
+	bool doesIntersect = false;
+
+	for (size_t i = 0; i < planes.size(); i++)
+	{
+		float t = planeDistance(planes[i].position, planes[i].normal, intersection.ray);
+		if (t > RAY_T_MIN && t < intersection.t)
+		{
+			intersection.t = t;
+			intersection.material = planeShapes[i]->material;
+			intersection.pShape = planeShapes[i];
+			doesIntersect = true;
+		}
+	}
+
+	for (std::vector<const Shape*>::const_iterator iter = unbounded.begin();
+		iter != unbounded.end();
 		++iter)
 	{
-		Shape* curShape = *iter;
-		return curShape->makeReflectedRay(intersection);
+		const Shape* curShape = *iter;
+		if (curShape->intersect(intersection))
+			doesIntersect = true;
 	}
+
+	// Most scenes lack some of the types, whose empty batches are skipped
+	if (!meshShapes.empty() && intersectTyped(meshBVH, meshShapes, intersection))
+		doesIntersect = true;
+	if (!instanceShapes.empty() && intersectTyped(instanceBVH, instanceShapes, intersection))
+		doesIntersect = true;
+
+	if (!bounded.empty() && bvh.intersect(intersection.ray, intersection.t, [&](int first, int count)
+	{
+		bool hit = false;
+		for (int i = first; i < first + count; i++)
+		{
+			if (bounded[i]->intersect(intersection))
+				hit = true;
+		}
+		return hit;
+	}))
+	{
+		doesIntersect = true;
+	}
+
+	return doesIntersect;
 }
 
-Ray ShapeSet::makeRefractionRay(Intersection& intersection)
+bool ShapeSet::intersectSpheres(Intersection& intersection) const
 {
-	for (std::vector<Shape*>::iterator iter = shapes.begin();
-		iter != shapes.end();
+	return sphereBVH.intersect(intersection.ray, intersection.t, [&](int first, int count)
+	{
+		int nearest = spheres.intersect(intersection.ray, first, count, intersection.t);
+		if (nearest < 0)
+			return false;
+		intersection.material = sphereShapes[nearest]->material;
+		intersection.pShape = sphereShapes[nearest];
+		return true;
+	});
+}
+
+bool ShapeSet::doesIntersectOthers(const Ray& ray) const
+{
+	for (size_t i = 0; i < planes.size(); i++)
+	{
+		float t = planeDistance(planes[i].position, planes[i].normal, ray);
+		if (t > RAY_T_MIN && t < ray.tMax)
+			return true;
+	}
+
+	for (std::vector<const Shape*>::const_iterator iter = unbounded.begin();
+		iter != unbounded.end();
 		++iter)
 	{
-		Shape* curShape = *iter;
-		return curShape->makeRefractionRay(intersection);
+		const Shape* curShape = *iter;
+		if (curShape->doesIntersect(ray))
+			return true;
+	}
+
+	if (!meshShapes.empty() && occludedTyped(meshBVH, meshShapes, ray))
+		return true;
+	if (!instanceShapes.empty() && occludedTyped(instanceBVH, instanceShapes, ray))
+		return true;
+	if (bounded.empty())
+		return false;
+
+	return bvh.occluded(ray, [&](int first, int count)
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			if (bounded[i]->doesIntersect(ray))
+				return true;
+		}
+		return false;
+	});
+}
+
+bool ShapeSet::doesIntersectSpheres(const Ray& ray) const
+{
+	return sphereBVH.occluded(ray, [&](int first, int count)
+	{
+		return spheres.occluded(ray, first, count);
+	});
+}
+
+bool ShapeSet::intersect(Intersection& intersection) const
+{
+	bool hitOthers = intersectOthers(intersection);
+	bool hitSpheres = intersectSpheres(intersection);
+	return hitOthers || hitSpheres;
+}
+
+void ShapeSet::intersectBatch(Intersection* intersections, int count, bool* results) const
+{
+	for (int begin = 0; begin < count; begin += RAY_PACKET_SIZE)
+	{
+		int size = std::min(RAY_PACKET_SIZE, count - begin);
+		Intersection* batch = intersections + begin;
+		bool* batchResults = results + begin;
+
+		// The few shapes outside the sphere hierarchy go ray by ray and
+		// leave the packet with a tighter tMax
+		Ray rays[RAY_PACKET_SIZE];
+		for (int i = 0; i < size; i++)
+		{
+			batchResults[i] = intersectOthers(batch[i]);
+			rays[i] = batch[i].ray;
+			rays[i].tMax = batch[i].t;
+		}
+
+		RayPacket packet;
+		packet.load(rays, size);
+		if (!packet.isCoherent() || !sphereBVH.hasBinaryNodes())
+		{
+			for (int i = 0; i < size; i++)
+			{
+				if (intersectSpheres(batch[i]))
+					batchResults[i] = true;
+			}
+			continue;
+		}
+
+		int nearest[RAY_PACKET_SIZE];
+		std::fill(nearest, nearest + RAY_PACKET_SIZE, -1);
+		sphereBVH.intersect(packet, packet.active, [&](int first, int leafCount, unsigned mask)
+		{
+			spheres.intersect(packet, mask, first, leafCount, nearest);
+		});
+
+		for (int i = 0; i < size; i++)
+		{
+			if (nearest[i] >= 0)
+			{
+				batch[i].t = packet.tMax[i];
+				batch[i].material = sphereShapes[nearest[i]]->material;
+				batch[i].pShape = sphereShapes[nearest[i]];
+				batchResults[i] = true;
+			}
+		}
 	}
 }
 
-sf::Color ShapeSet::Trace(Ray& ray, Shape* scene, Light light_source)
+bool ShapeSet::doesIntersect(const Ray& ray) const
+{
+	return doesIntersectOthers(ray) || doesIntersectSpheres(ray);
+}
+
+void ShapeSet::occluded(const Ray* rays, int count, bool* results) const
 {
-	Intersection intersection(ray);
-	if (scene->intersect(intersection))
+	for (int begin = 0; begin < count; begin += RAY_PACKET_SIZE)
 	{
-		return intersection.pShape->Trace(ray, scene, light_source);
+		int size = std::min(RAY_PACKET_SIZE, count - begin);
+		bool* batchResults = results + begin;
+
+		unsigned open = 0;
+		for (int i = 0; i < size; i++)
+		{
+			batchResults[i] = doesIntersectOthers(rays[begin + i]);
+			if (!batchResults[i])
+				open |= 1u << i;
+		}
+		if (open == 0)
+			continue;
+
+		RayPacket packet;
+		packet.load(rays + begin, size);
+		if (!packet.isCoherent() || !sphereBVH.hasBinaryNodes())
+		{
+			for (int i = 0; i < size; i++)
+			{
+				if (!batchResults[i])
+					batchResults[i] = doesIntersectSpheres(rays[begin + i]);
+			}
+			continue;
+		}
+
+		unsigned blocked = sphereBVH.occluded(packet, open, [&](int first, int leafCount, unsigned mask)
+		{
+			return spheres.occluded(packet, mask, first, leafCount);
+		});
+
+		for (int i = 0; i < size; i++)
+		{
+			if (blocked & (1u << i))
+				batchResults[i] = true;
+		}
 	}
-	else return sf::Color::Black;
+}
+
+AABB ShapeSet::bounds() const
+{
+	if (!planes.empty() || !unbounded.empty())
+		return AABB::infinite();
+
+	AABB box = meshBVH.bounds();
+	box.extend(instanceBVH.bounds());
+	box.extend(bvh.bounds());
+	box.extend(sphereBVH.bounds());
+	return box;
+}
+
+float ShapeSet::lighting(const Intersection& intersection, const Ray& shadow) const
+{
+	return intersection.pShape->lighting(intersection, shadow);
+}
+
+Ray ShapeSet::returnNormal(const Intersection& intersection) const
+{
+	return intersection.pShape->returnNormal(intersection);
+}
+
+Ray ShapeSet::makeReflectedRay(const Intersection& intersection) const
+{
+	return intersection.pShape->makeReflectedRay(intersection);
+}
+
+Ray ShapeSet::makeRefractionRay(const Intersection& intersection, float ior) const
+{
+	return intersection.pShape->makeRefractionRay(intersection, ior);
 }
 
 
 
 
 //Plane
-Plane::Plane(const Point& position, const Vector& normal, int material)
+Plane::Plane(const Point& position, const Vector& normal, MaterialId material)
 	: position(position),
 	normal(normal)
 {	
@@ -125,20 +570,19 @@ Plane::~Plane()
 
 }
 
-bool Plane::intersect(Intersection& intersection)
+const Point& Plane::getPosition() const
 {
-	// First, check if we intersect
-	float dDotN = dot(intersection.ray.direction, normal);
+	return position;
+}
 
-	if (dDotN == 0.0f)
-	{
-		// We just assume the ray is not embedded in the plane
-		return false;
-	}
+const Vector& Plane::getNormal() const
+{
+	return normal;
+}
 
-	// Find point of intersection
-	float t = dot(position - intersection.ray.origin, normal)
-		/ dDotN;
+bool Plane::intersect(Intersection& intersection) const
+{
+	float t = planeDistance(position, normal, intersection.ray);
 
 	if (t <= RAY_T_MIN || t >= intersection.t)
 	{
@@ -146,25 +590,15 @@ bool Plane::intersect(Intersection& intersection)
 		return false;
 	}
 	intersection.t = t;
+	intersection.material = material;
 	intersection.pShape = this;
-	intersection.color = color;
 
 	return true;
 }
 
-bool Plane::doesIntersect(const Ray& ray)
+bool Plane::doesIntersect(const Ray& ray) const
 {
-	// First, check if we intersect
-	float dDotN = dot(ray.direction, normal);
-
-	if (dDotN == 0.0f)
-	{
-		// We just assume the ray is not embedded in the plane
-		return false;
-	}
-
-	// Find point of intersection
-	float t = dot(position - ray.origin, normal) / dDotN;
+	float t = planeDistance(position, normal, ray);
 
 	if (t <= RAY_T_MIN || t >= ray.tMax)
 	{
@@ -175,91 +609,46 @@ bool Plane::doesIntersect(const Ray& ray)
 	return true;
 }
 
-Ray Plane::returnNormal(Intersection& intersection)
+AABB Plane::bounds() const
+{
+	return AABB::infinite();
+}
+
+Ray Plane::returnNormal(const Intersection& intersection) const
 {
 	Ray normal = Ray(intersection.position(), this->normal.normalized());
 	return normal;
 }
 
-Ray Plane::makeReflectedRay(Intersection& intersection)
+Ray Plane::makeReflectedRay(const Intersection& intersection) const
 {
 	Vector reflected = intersection.ray.direction.normalized() - (2 * (dot(intersection.ray.direction.normalized(), normal.normalized()) * normal.normalized()));
 	return Ray(intersection.position(), reflected.normalized());
 }
 
-Ray Plane::makeRefractionRay(Intersection& intersection)
+Ray Plane::makeRefractionRay(const Intersection& intersection, float ior) const
 {
 	float c1 = -dot(normal, intersection.ray.direction);
-	float n1 = 1;
-	float n2 = 1.3;
-	float n = n1 / n2;
+	float n = 1.0f / ior;
 	float c2 = sqrt(1 - n * n * (1 - c1 * c1));
 	Vector refracted = (n * intersection.ray.direction) + (n * c1 - c2) * normal;
 	return Ray(intersection.position(), refracted.normalized());
 }
 
-void Plane::setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source)
-{
-		color = scene->Trace(intersection.ray, scene, light_source);
-
-		Ray normal = this->returnNormal(intersection);
-		float index = -dot(normal.direction, shadow.ray.direction);
-		this->color.r = color.r * index;
-		this->color.g = color.g * index;
-		this->color.b = color.b * index;
-	
-}
-
-sf::Color Plane::Trace(Ray& ray, Shape* scene, Light light_source)
+float Plane::lighting(const Intersection& intersection, const Ray& shadow) const
 {
-	    Intersection intersection(ray);
-		if (scene->intersect(intersection))
-		{
-			if (intersection.pShape->material == 1)
-			{
-				int X = round(intersection.position().x / 1.0f);
-				int Z = round(intersection.position().z / 1.0f);
-
-				if (X % 2 == 0)
-				{
-					if (Z % 2 == 0)
-					{
-						color = sf::Color(0, 200, 200);
-					}
-					else
-					{
-						color = sf::Color(200, 200, 200);
-					}
-
-				}
-				else
-				{
-
-					if (Z % 2 == 0)
-					{
-						color = sf::Color(200, 200, 200);
-					}
-					else
-					{
-						color = sf::Color(0, 200, 200);
-					}
-				}
-				return color;
-			}
-		}
-		else return sf::Color::Green;
-	
+	// The floor is drawn with its unlit texture colour
+	return 1.0f;
 }
 
 
 
 
 //Sphere
-Sphere::Sphere(const Point& centre, float radius,sf::Color color, int material)
+Sphere::Sphere(const Point& centre, float radius, MaterialId material)
 	: centre(centre),
 	radius(radius)
 {
-	this->color = color;
 	this->material = material;
 }
 
@@ -267,7 +656,22 @@ Sphere::~Sphere()
 {
 }
 
-bool Sphere::intersect(Intersection& intersection)
+const Point& Sphere::getCentre() const
+{
+	return centre;
+}
+
+void Sphere::setCentre(const Point& centre)
+{
+	this->centre = centre;
+}
+
+float Sphere::getRadius() const
+{
+	return radius;
+}
+
+bool Sphere::intersect(Intersection& intersection) const
 {
 	// Transform ray so we can consider origin-centred sphere
 	Ray localRay = intersection.ray;
@@ -306,13 +710,13 @@ bool Sphere::intersect(Intersection& intersection)
 	}
 
 	// Finish populating intersection
+	intersection.material = material;
 	intersection.pShape = this;
-	intersection.color = color;
 
 	return true;
 }
 
-bool Sphere::doesIntersect(const Ray& ray)
+bool Sphere::doesIntersect(const Ray& ray) const
 {
 	// Transform ray so we can consider origin-centred sphere
 	Ray localRay = ray;
@@ -343,134 +747,378 @@ bool Sphere::doesIntersect(const Ray& ray)
 	return false;
 }
 
-Ray Sphere::makeReflectedRay(Intersection& intersection)
+AABB Sphere::bounds() const
+{
+	return AABB(centre - Vector(radius), centre + Vector(radius));
+}
+
+Ray Sphere::makeReflectedRay(const Intersection& intersection) const
 {
 	Ray normal = this->returnNormal(intersection);
 	Vector reflected = intersection.ray.direction.normalized() - (2 * (dot(intersection.ray.direction.normalized(), normal.direction.normalized()) * normal.direction.normalized()));
 	return Ray(intersection.position(), reflected.normalized());
 }
 
-Ray Sphere::makeRefractionRay(Intersection& intersection)
+Ray Sphere::makeRefractionRay(const Intersection& intersection, float ior) const
 {
 	Vector direction = this->centre - intersection.position();
 	Ray normal = Ray(intersection.position(), direction.normalized());
 	float c1 = -dot(normal.direction, intersection.ray.direction);
-	float n1 = 1.0f;
-	float n2 = 1.3f;
-	float n = n1 / n2;
+	float n = 1.0f / ior;
 	float c2 = sqrt(1 - (n * n) * (1 - (c1 * c1)));
 	Vector refracted = (n * intersection.ray.direction) + (n * c1 - c2) * this->returnNormal(intersection).direction;
 	return Ray(intersection.position(), refracted.normalized());
 }
 
-Ray Sphere::returnNormal(Intersection& intersection)
+Ray Sphere::returnNormal(const Intersection& intersection) const
 {
 	Vector direction = this->centre - intersection.position();
 	Ray normal = Ray(intersection.position(), direction.normalized());
 	return normal;
 }
 
-void Sphere::setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source)
+float Sphere::lighting(const Intersection& intersection, const Ray& shadow) const
 {
-	if (this->material == 1)
-	{
-		color = scene->Trace(intersection.ray, scene, light_source);
-		
-		Ray normal = this->returnNormal(intersection);
-		float index = -dot(normal.direction, shadow.ray.direction);
-		this->color.r = color.r * index;
-		this->color.g = color.g * index;
-		this->color.b = color.b * index;
-	}
-	else if (this->material == 2)
+	Ray normal = this->returnNormal(intersection);
+	return -dot(normal.direction, shadow.direction);
+}
+
+
+
+//Mesh
+Mesh::Mesh(MaterialId material)
+{
+	this->material = material;
+}
+
+void Mesh::reserve(int vertexCount, int triangleCount)
+{
+	vertices.reserve(vertexCount);
+	indices.reserve(triangleCount * 3);
+}
+
+int Mesh::addVertex(const Point& position)
+{
+	vertices.push_back(position);
+	return (int)vertices.size() - 1;
+}
+
+void Mesh::addTriangle(int a, int b, int c)
+{
+	indices.push_back(a);
+	indices.push_back(b);
+	indices.push_back(c);
+}
+
+void Mesh::resize(int vertexCount, int triangleCount)
+{
+	vertices.resize(vertexCount);
+	indices.resize(triangleCount * 3);
+}
+
+Point* Mesh::getVertexData()
+{
+	return vertices.data();
+}
+
+int* Mesh::getIndexData()
+{
+	return indices.data();
+}
+
+std::vector<AABB> Mesh::triangleBounds(ThreadPool* pool) const
+{
+	int count = (int)indices.size() / 3;
+	std::vector<AABB> bounds(count);
+	forRanges(pool, count, [&](int range, int begin, int end, unsigned worker)
 	{
-		Ray reflected_ray = this->makeReflectedRay(intersection);
-		Intersection reflected(reflected_ray);
-		if (scene->intersect(reflected))
-		{
-			color = scene->Trace(reflected_ray, scene, light_source);
-		}
-		else
+		for (int i = begin; i < end; i++)
 		{
-			color = sf::Color(20, 20, 20);
+			bounds[i].extend(vertices[indices[3 * i]]);
+			bounds[i].extend(vertices[indices[3 * i + 1]]);
+			bounds[i].extend(vertices[indices[3 * i + 2]]);
 		}
-		
-		Ray normal = this->returnNormal(intersection);
-		float index = -dot(normal.direction, shadow.ray.direction);
-		this->color.r = color.r * index;
-		this->color.g = color.g * index;
-		this->color.b = color.b * index;
+	});
+	return bounds;
+}
+
+void Mesh::build(ThreadPool* pool)
+{
+	int count = (int)indices.size() / 3;
+	bvh.build(triangleBounds(pool), pool);
+
+	// Store the triangles in leaf order so a leaf is a contiguous range
+	const std::vector<int>& order = bvh.getIndices();
+	triangles.clear();
+	triangles.reserve(count);
+	for (std::vector<int>::const_iterator iter = order.begin();
+		iter != order.end();
+		++iter)
+	{
+		const int* triangle = &indices[3 * *iter];
+		triangles.add(vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]]);
 	}
-	else if (this->material == 3)
+}
+
+void Mesh::attach(const TriangleArrays& arrays, int triangleCount, const BVHNode* nodes, int nodeCount)
+{
+	vertices.clear();
+	indices.clear();
+	triangles.attach(arrays, triangleCount);
+	bvh.attach(nodes, nodeCount);
+}
+
+bool Mesh::update(ThreadPool* pool)
+{
+	// Meshes from a scene cache keep no vertices
+	if (indices.empty())
+		return false;
+
+	bool rebuilt = bvh.update(triangleBounds(pool), pool);
+
+	// Same triangles in the possibly new leaf order, at their new positions
+	const std::vector<int>& order = bvh.getIndices();
+	forRanges(pool, (int)order.size(), [&](int range, int begin, int end, unsigned worker)
 	{
-		Ray refraction_ray = this->makeRefractionRay(intersection);
-		Intersection reflected(refraction_ray);
-		if (scene->intersect(reflected))
-		{
-			color = scene->Trace(refraction_ray, scene, light_source);
-		}
-		else
+		for (int i = begin; i < end; i++)
 		{
-			color = sf::Color(20, 20, 20);
+			const int* triangle = &indices[3 * order[i]];
+			triangles.set(i, vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]]);
 		}
-	
-		Ray normal = this->returnNormal(intersection);
-		float index = -dot(normal.direction, shadow.ray.direction);
-		this->color.r = color.r * index;
-		this->color.g = color.g * index;
-		this->color.b = color.b * index;
-	}
-	else
+	});
+	return rebuilt;
+}
+
+const std::vector<Point>& Mesh::getVertices() const
+{
+	return vertices;
+}
+
+const std::vector<int>& Mesh::getIndices() const
+{
+	return indices;
+}
+
+const TriangleSoA& Mesh::getTriangles() const
+{
+	return triangles;
+}
+
+const BVH& Mesh::getBVH() const
+{
+	return bvh;
+}
+
+void Mesh::compact()
+{
+	bvh.compact();
+}
+
+int Mesh::getTriangleCount() const
+{
+	return triangles.size();
+}
+
+bool Mesh::intersect(Intersection& intersection) const
+{
+	return bvh.intersect(intersection.ray, intersection.t, [&](int first, int count)
 	{
-		color = sf::Color::Green;
-	}
-	
+		int nearest = triangles.intersect(intersection.ray, first, count, intersection.t);
+		if (nearest < 0)
+			return false;
+		intersection.material = material;
+		intersection.pShape = this;
+		intersection.primitive = nearest;
+		return true;
+	});
 }
 
-sf::Color Sphere::Trace(Ray& ray, Shape* scene, Light light_source)
+bool Mesh::doesIntersect(const Ray& ray) const
 {
-	Intersection intersection(ray);
-	if (this->intersect(intersection))
+	return bvh.occluded(ray, [&](int first, int count)
 	{
-		//Ray shadow_ray = scene->makeRay(intersection, light_source);
-		//Intersection shadow(shadow_ray);
-		
-			if (intersection.pShape->material == 1)
-			{
-				/*if (scene->intersect(shadow))
-				{
-					return sf::Color::Black;
-				}
-				else
-				{
-					Vector direction = this->centre - intersection.position();
-					Ray normal = Ray(intersection.position(), direction.normalized());
-					float index = -dot(normal.direction, shadow.ray.direction);
-					this->color.r = sf::Color(255, 0, 0).r * index;
-					this->color.g = sf::Color(255, 0, 0).g * index;
-					this->color.b = sf::Color(255, 0, 0).b * index;
-					return color;
-				}*/
-				return sf::Color::Red;
-			}
+		return triangles.occluded(ray, first, count);
+	});
+}
 
-			if (intersection.pShape->material == 2)
-			{
-				Ray reflected_ray = scene->makeReflectedRay(intersection);
+AABB Mesh::bounds() const
+{
+	// An empty box is not finite, so an empty mesh ends up unbounded and
+	// is never hit
+	return bvh.bounds();
+}
 
-				return scene->Trace(reflected_ray, scene, light_source);
-			}
+Vector Mesh::facingNormal(const Intersection& intersection) const
+{
+	Vector normal = triangles.normal(intersection.primitive).normalized();
+	if (dot(normal, intersection.ray.direction) > 0.0f)
+		normal = -normal;
+	return normal;
+}
 
-			if (intersection.pShape->material == 3)
-			{
-				Ray refracted_ray = scene->makeRefractionRay(intersection);
-				return scene->Trace(refracted_ray, scene, light_source);
-			}
-			else return sf::Color::Green;
+Ray Mesh::returnNormal(const Intersection& intersection) const
+{
+	return Ray(intersection.position(), facingNormal(intersection));
+}
+
+Ray Mesh::makeReflectedRay(const Intersection& intersection) const
+{
+	Vector normal = facingNormal(intersection);
+	Vector direction = intersection.ray.direction.normalized();
+	Vector reflected = direction - 2 * dot(direction, normal) * normal;
+	return Ray(intersection.position(), reflected.normalized());
+}
+
+Ray Mesh::makeRefractionRay(const Intersection& intersection, float ior) const
+{
+	// Every surface is entered from air, like the planes and spheres
+	Vector normal = facingNormal(intersection);
+	Vector direction = intersection.ray.direction.normalized();
+	float c1 = -dot(normal, direction);
+	float n = 1.0f / ior;
+	float c2 = std::sqrt(1 - n * n * (1 - c1 * c1));
+	Vector refracted = (n * direction) + (n * c1 - c2) * normal;
+	return Ray(intersection.position(), refracted.normalized());
+}
+
+float Mesh::lighting(const Intersection& intersection, const Ray& shadow) const
+{
+	// Faces turned away from the light get none of it
+	float lit = dot(facingNormal(intersection), shadow.direction);
+	return lit > 0.0f ? lit : 0.0f;
+}
+
+
+
+//Instance
+Instance::Instance(const Shape* object, const Matrix44& objectToWorld)
+	: object(object),
+	overridesMaterial(false)
+{
+	this->material = MATERIAL_NONE;
+	setTransform(objectToWorld);
+}
+
+Instance::Instance(const Shape* object, const Matrix44& objectToWorld, MaterialId material)
+	: object(object),
+	overridesMaterial(true)
+{
+	this->material = material;
+	setTransform(objectToWorld);
+}
+
+Instance::~Instance()
+{
+}
+
+const Shape* Instance::getObject() const
+{
+	return object;
+}
+
+const Matrix44& Instance::getTransform() const
+{
+	return objectToWorld;
+}
+
+void Instance::setTransform(const Matrix44& objectToWorld)
+{
+	this->objectToWorld = objectToWorld;
+	worldToObject = objectToWorld.inverse();
+	updateBounds();
+}
+
+void Instance::updateBounds()
+{
+	AABB box = object->bounds();
+	if (!box.isFinite())
+	{
+		worldBounds = box;
+		return;
 	}
-		
-	
-	else return sf::Color::Green;
+
+	// Box around the transformed corners of the object's box
+	Point corners[8];
+	for (int corner = 0; corner < 8; corner++)
+	{
+		corners[corner] = Point((corner & 1) ? box.max.x : box.min.x,
+			(corner & 2) ? box.max.y : box.min.y,
+			(corner & 4) ? box.max.z : box.min.z);
+	}
+	objectToWorld.transform(corners, corners, 8);
+
+	worldBounds = AABB();
+	for (int corner = 0; corner < 8; corner++)
+		worldBounds.extend(corners[corner]);
+}
+
+Ray Instance::toObject(const Ray& ray) const
+{
+	return Ray(worldToObject.transform(ray.origin), worldToObject.transformDirection(ray.direction), ray.tMax);
+}
+
+Ray Instance::toWorld(const Ray& ray) const
+{
+	return Ray(objectToWorld.transform(ray.origin), objectToWorld.transformDirection(ray.direction).normalized());
+}
+
+Intersection Instance::objectHit(const Intersection& intersection) const
+{
+	Intersection hit(toObject(intersection.ray));
+	float scale = hit.ray.direction.normalize();
+	hit.t = intersection.t * scale;
+	hit.ray.tMax = RAY_T_MAX;
+	hit.primitive = intersection.primitive;
+	hit.material = intersection.material;
+	hit.pShape = intersection.pInstanced;
+	return hit;
+}
+
+bool Instance::intersect(Intersection& intersection) const
+{
+	Intersection hit(toObject(intersection.ray));
+	hit.t = intersection.t;
+	if (!object->intersect(hit))
+		return false;
+
+	intersection.t = hit.t;
+	intersection.primitive = hit.primitive;
+	intersection.material = overridesMaterial ? material : hit.material;
+	intersection.pShape = this;
+	intersection.pInstanced = hit.pShape;
+	return true;
+}
+
+bool Instance::doesIntersect(const Ray& ray) const
+{
+	return object->doesIntersect(toObject(ray));
+}
+
+AABB Instance::bounds() const
+{
+	return worldBounds;
+}
+
+float Instance::lighting(const Intersection& intersection, const Ray& shadow) const
+{
+	Ray objectShadow = toObject(shadow);
+	objectShadow.direction.normalize();
+	return intersection.pInstanced->lighting(objectHit(intersection), objectShadow);
+}
+
+Ray Instance::returnNormal(const Intersection& intersection) const
+{
+	return toWorld(intersection.pInstanced->returnNormal(objectHit(intersection)));
+}
+
+Ray Instance::makeReflectedRay(const Intersection& intersection) const
+{
+	return toWorld(intersection.pInstanced->makeReflectedRay(objectHit(intersection)));
+}
+
+Ray Instance::makeRefractionRay(const Intersection& intersection, float ior) const
+{
+	return toWorld(intersection.pInstanced->makeRefractionRay(objectHit(intersection), ior));
 }
 
 
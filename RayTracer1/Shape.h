@@ -3,12 +3,16 @@
 
 #include <vector>
 #include <cmath>
-#include <SFML\Graphics.hpp>
-#include <SFML\Window.hpp>
 #include "Vector3.h"
 #include "Vector2.h"
 //#include "Maths.h"
-#include "ray.h"
+#include "Ray.h"
+#include "Color.h"
+#include "AABB.h"
+#include "Matrix44.h"
+#include "BVH.h"
+#include "SphereSoA.h"
+#include "TriangleSoA.h"
 
 class Light
 {
@@ -24,35 +28,106 @@ class Shape
 {
 public:
 
-	sf::Color color;
+	// Entry of the scene's MaterialTable the shape is drawn with
+	MaterialId material;
 
-	int material;
-
-	Ray makeRay(Intersection& intersection, Light light_source);
+	// Shadow ray from the hit point, ending at the light
+	Ray makeRay(const Intersection& intersection, const Light& light_source) const;
 
 	virtual ~Shape() { }
 
-	virtual bool intersect(Intersection& intersection) = 0;
+	virtual bool intersect(Intersection& intersection) const = 0;
+
+	// Batched intersect, e.g. for the primary rays of a tile; results[i]
+	// tells whether intersections[i] found a hit
+	virtual void intersectBatch(Intersection* intersections, int count, bool* results) const;
+
+	// Any hit between RAY_T_MIN and ray.tMax, stops at the first one found
+	virtual bool doesIntersect(const Ray& ray) const = 0;
+
+	// Batched doesIntersect, e.g. for all shadow rays of a tile
+	virtual void occluded(const Ray* rays, int count, bool* results) const;
 
-	virtual bool doesIntersect(const Ray& ray) = 0;
+	// Bounds of the shape, AABB::infinite() if it has none
+	virtual AABB bounds() const = 0;
 
-	virtual void setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source) = 0;
+	// Fraction of the light that reaches the eye from a lit primary hit.
+	// Shading only reads the scene, so any number of threads may call it at once.
+	virtual float lighting(const Intersection& intersection, const Ray& shadow) const = 0;
 
-	virtual Ray returnNormal(Intersection& intersection) = 0;
+	virtual Ray returnNormal(const Intersection& intersection) const = 0;
 
-	virtual Ray makeReflectedRay(Intersection& intersection) = 0;
+	virtual Ray makeReflectedRay(const Intersection& intersection) const = 0;
+
+	// Ray entering or leaving a surface whose inside has the given index
+	// of refraction
+	virtual Ray makeRefractionRay(const Intersection& intersection, float ior) const = 0;
+
+};
 
-	virtual Ray makeRefractionRay(Intersection& intersection) = 0;
+class Plane;
+class Sphere;
+class Mesh;
+class Instance;
 
-	virtual sf::Color Trace(Ray& ray, Shape* scene, Light light_source) = 0;
+// Plane data kept by value, see ShapeSet
+struct PlaneRecord
+{
+	Point position;
 
+	Vector normal;
 };
 
+// Flat collection of shapes. build() sorts them by type into contiguous
+// arrays with one hierarchy per type, so rays are tested against a whole
+// batch of one type with direct calls; only shapes of other classes go
+// through the virtual functions.
 class ShapeSet : public Shape
 {
 protected:
 
 	std::vector<Shape*> shapes;
+
+	// Planes are tested in one loop; planeShapes[i] is the shape stored at
+	// planes[i]
+	std::vector<PlaneRecord> planes;
+
+	std::vector<const Plane*> planeShapes;
+
+	// Shapes of other classes that cannot be bounded, tested against every
+	// ray
+	std::vector<const Shape*> unbounded;
+
+	// Meshes and instances in the leaf order of their hierarchies
+	std::vector<const Mesh*> meshShapes;
+
+	BVH meshBVH;
+
+	std::vector<const Instance*> instanceShapes;
+
+	BVH instanceBVH;
+
+	// Bounded shapes of other classes, in BVH leaf order
+	std::vector<const Shape*> bounded;
+
+	BVH bvh;
+
+	// Spheres get their own hierarchy whose leaves are tested by the SIMD
+	// kernels; sphereShapes[i] is the shape stored at spheres index i
+	SphereSoA spheres;
+
+	std::vector<const Sphere*> sphereShapes;
+
+	BVH sphereBVH;
+
+	// Everything but the spheres
+	bool intersectOthers(Intersection& intersection) const;
+
+	bool intersectSpheres(Intersection& intersection) const;
+
+	bool doesIntersectOthers(const Ray& ray) const;
+
+	bool doesIntersectSpheres(const Ray& ray) const;
 	
 public:
 
@@ -62,19 +137,62 @@ public:
 
 	void addShape(Shape* shape);
 
-	virtual bool intersect(Intersection& intersection);
+	void reserve(int capacity);
+
+	// Removes all shapes, build() has to be called again
+	void clear();
 
-	virtual bool doesIntersect(const Ray& ray);
+	// Builds the acceleration structure, call after the last addShape. A
+	// pool builds the hierarchies on all of its workers.
+	void build(ThreadPool* pool = NULL);
 
-	virtual void setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source);
+	// Adds count spheres together with their finished hierarchy, e.g. from
+	// a scene cache, instead of building it. Call after build(). shapes[i]
+	// belongs to entry i of the arrays, which are used in place and, like
+	// the nodes, must outlive the set.
+	void attachSpheres(Sphere* shapes, const SphereArrays& arrays, int count,
+		const BVHNode* nodes, int nodeCount);
 
-	virtual Ray returnNormal(Intersection& intersection);
+	// Spheres in hierarchy order, getSphereShapes()[i] is entry i
+	const SphereSoA& getSpheres() const;
 
-	virtual Ray makeReflectedRay(Intersection& intersection);
+	const std::vector<const Sphere*>& getSphereShapes() const;
 
-	virtual Ray makeRefractionRay(Intersection& intersection);
+	const BVH& getSphereBVH() const;
 
-	virtual sf::Color Trace(Ray& ray, Shape* scene, Light light_source);
+	// Releases the build data of the hierarchies, see BVH::compact().
+	// Ray packets are then traced ray by ray.
+	void compact();
+
+	// Bytes taken by the hierarchies
+	size_t getBVHMemory() const;
+
+	// Call after bounded shapes moved, e.g. through Sphere::setCentre or
+	// Mesh::update, and before the next ray is traced. Refits the
+	// hierarchies, rebuilding one that BVH::update() finds has become too
+	// slow. Returns true if any was rebuilt.
+	bool update(ThreadPool* pool = NULL);
+
+	virtual bool intersect(Intersection& intersection) const;
+
+	// Coherent groups of rays traverse the spheres as packets
+	virtual void intersectBatch(Intersection* intersections, int count, bool* results) const;
+
+	virtual bool doesIntersect(const Ray& ray) const;
+
+	virtual void occluded(const Ray* rays, int count, bool* results) const;
+
+	// Taken from the hierarchies, so it needs build() and is padded like
+	// their nodes
+	virtual AABB bounds() const;
+
+	virtual float lighting(const Intersection& intersection, const Ray& shadow) const;
+
+	virtual Ray returnNormal(const Intersection& intersection) const;
+
+	virtual Ray makeReflectedRay(const Intersection& intersection) const;
+
+	virtual Ray makeRefractionRay(const Intersection& intersection, float ior) const;
 	
 };
 
@@ -88,23 +206,27 @@ protected:
 	
 public:
 
-	Plane(const Point& position, const Vector& normal, int material);
+	Plane(const Point& position, const Vector& normal, MaterialId material);
 
 	virtual ~Plane();
 
-	virtual bool intersect(Intersection& intersection);
+	const Point& getPosition() const;
 
-	virtual bool doesIntersect(const Ray& ray);
+	const Vector& getNormal() const;
 
-	virtual void setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source);
+	virtual bool intersect(Intersection& intersection) const;
 
-	virtual Ray returnNormal(Intersection& intersection);
+	virtual bool doesIntersect(const Ray& ray) const;
 
-	virtual Ray makeReflectedRay(Intersection& intersection);
+	virtual AABB bounds() const;
 
-	virtual Ray makeRefractionRay(Intersection& intersection);
+	virtual float lighting(const Intersection& intersection, const Ray& shadow) const;
 
-	virtual sf::Color Trace(Ray& ray, Shape* scene, Light light_source);
+	virtual Ray returnNormal(const Intersection& intersection) const;
+
+	virtual Ray makeReflectedRay(const Intersection& intersection) const;
+
+	virtual Ray makeRefractionRay(const Intersection& intersection, float ior) const;
 	
 };
 
@@ -118,23 +240,185 @@ protected:
 
 public:
 
-	Sphere(const Point& centre, float radius, sf::Color color, int material);
+	Sphere(const Point& centre, float radius, MaterialId material);
 
 	virtual ~Sphere();
 
-	virtual bool intersect(Intersection& intersection);
+	const Point& getCentre() const;
+
+	// The ShapeSet holding the sphere needs an update() afterwards
+	void setCentre(const Point& centre);
+
+	float getRadius() const;
+
+	virtual bool intersect(Intersection& intersection) const;
+
+	virtual bool doesIntersect(const Ray& ray) const;
+
+	virtual AABB bounds() const;
+
+	virtual Ray makeReflectedRay(const Intersection& intersection) const;
+
+	virtual float lighting(const Intersection& intersection, const Ray& shadow) const;
+
+	virtual Ray returnNormal(const Intersection& intersection) const;
+
+	virtual Ray makeRefractionRay(const Intersection& intersection, float ior) const;
+
+};
+
+// Indexed triangle mesh. The triangles are kept in their own hierarchy
+// and tested by the SIMD kernels of TriangleSoA, so the whole mesh is a
+// single bounded shape to a ShapeSet. Intersection::primitive is the
+// index of the hit triangle in getTriangles().
+class Mesh : public Shape
+{
+protected:
+
+	std::vector<Point> vertices;
+
+	// Three vertex indices per triangle
+	std::vector<int> indices;
+
+	// Triangles in hierarchy order
+	TriangleSoA triangles;
+
+	BVH bvh;
+
+	// Unit geometric normal of the hit triangle, facing the incoming ray
+	Vector facingNormal(const Intersection& intersection) const;
+
+	std::vector<AABB> triangleBounds(ThreadPool* pool) const;
+
+public:
+
+	explicit Mesh(MaterialId material);
+
+	void reserve(int vertexCount, int triangleCount);
+
+	// Returns the index of the new vertex
+	int addVertex(const Point& position);
+
+	// Indices of vertices that were already added
+	void addTriangle(int a, int b, int c);
+
+	// Sets the number of vertices and triangles so a loader can fill both
+	// lists in place, e.g. from several threads at once
+	void resize(int vertexCount, int triangleCount);
+
+	Point* getVertexData();
+
+	int* getIndexData();
+
+	// Builds the triangle arrays and the hierarchy, call after the last
+	// addTriangle. A pool builds them on all of its workers.
+	void build(ThreadPool* pool = NULL);
+
+	// Uses finished triangle arrays and nodes, e.g. from a scene cache,
+	// instead of building them. Both are used in place and must outlive
+	// the mesh; the vertex and index lists stay empty.
+	void attach(const TriangleArrays& arrays, int triangleCount, const BVHNode* nodes, int nodeCount);
+
+	// Call after moving vertices through getVertexData(), the triangles
+	// stay the same. Refits the hierarchy, or rebuilds it like BVH::update.
+	// Returns true if it rebuilt. An attached mesh has no vertices to move.
+	bool update(ThreadPool* pool = NULL);
+
+	const std::vector<Point>& getVertices() const;
+
+	const std::vector<int>& getIndices() const;
+
+	const TriangleSoA& getTriangles() const;
+
+	const BVH& getBVH() const;
+
+	// Releases the build data of the hierarchy, see BVH::compact()
+	void compact();
+
+	int getTriangleCount() const;
+
+	virtual bool intersect(Intersection& intersection) const;
+
+	virtual bool doesIntersect(const Ray& ray) const;
+
+	virtual AABB bounds() const;
+
+	virtual float lighting(const Intersection& intersection, const Ray& shadow) const;
+
+	virtual Ray returnNormal(const Intersection& intersection) const;
+
+	virtual Ray makeReflectedRay(const Intersection& intersection) const;
+
+	virtual Ray makeRefractionRay(const Intersection& intersection, float ior) const;
+
+};
+
+// Places a shared object, usually a built ShapeSet of spheres and meshes,
+// through a transform, so repeating it costs one instance rather than a
+// copy of its geometry and hierarchies. Rays are moved into object space
+// at the instance and traced through the object's own hierarchies; hits
+// report the instance as pShape and the object's shape as pInstanced.
+// Shading is exact for rotations, translations and uniform scales.
+// Objects must not contain instances themselves.
+class Instance : public Shape
+{
+protected:
+
+	const Shape* object;
+
+	Matrix44 objectToWorld;
+
+	Matrix44 worldToObject;
+
+	// Object bounds in world space, see updateBounds()
+	AABB worldBounds;
+
+	// material replaces those of the object's shapes
+	bool overridesMaterial;
+
+	// Same ray in object space, unnormalized so t is the same in both
+	Ray toObject(const Ray& ray) const;
+
+	// Object space ray back in world space, with a unit direction
+	Ray toWorld(const Ray& ray) const;
+
+	// The hit in object space with a unit direction, for shading by the
+	// instanced shape
+	Intersection objectHit(const Intersection& intersection) const;
+
+public:
+
+	Instance(const Shape* object, const Matrix44& objectToWorld);
+
+	// Draws every shape of the object with the given material
+	Instance(const Shape* object, const Matrix44& objectToWorld, MaterialId material);
+
+	virtual ~Instance();
+
+	const Shape* getObject() const;
+
+	const Matrix44& getTransform() const;
+
+	// The ShapeSet holding the instance needs an update() afterwards
+	void setTransform(const Matrix44& objectToWorld);
+
+	// Call after the object changed, e.g. with its own update(), and
+	// before the ShapeSet holding the instance is updated
+	void updateBounds();
+
+	virtual bool intersect(Intersection& intersection) const;
 
-	virtual bool doesIntersect(const Ray& ray);
+	virtual bool doesIntersect(const Ray& ray) const;
 
-	virtual Ray makeReflectedRay(Intersection& intersection);
+	virtual AABB bounds() const;
 
-	virtual void setColor(Intersection& intersection, Shape* scene, Intersection& shadow, Light light_source);
+	virtual float lighting(const Intersection& intersection, const Ray& shadow) const;
 
-	virtual Ray returnNormal(Intersection& intersection);
+	virtual Ray returnNormal(const Intersection& intersection) const;
 
-	virtual Ray makeRefractionRay(Intersection& intersection);
+	virtual Ray makeReflectedRay(const Intersection& intersection) const;
 
-	virtual sf::Color Trace(Ray& ray, Shape* scene, Light light_source);
+	virtual Ray makeRefractionRay(const Intersection& intersection, float ior) const;
 
 };
 
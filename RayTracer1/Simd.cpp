@@ -0,0 +1,87 @@
+#include "Simd.h"
+
+#if defined(_MSC_VER) && defined(SIMD_X86)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include <atomic>
+
+namespace
+{
+	std::atomic<int> selectedLevel(-1);
+}
+
+SimdLevel detectSimdLevel()
+{
+#if defined(_MSC_VER) && defined(SIMD_X86)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	if (maxLeaf < 1)
+		return SIMD_SCALAR;
+
+	__cpuid(info, 1);
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!sse41)
+		return SIMD_SCALAR;
+	if (!osxsave || !avx || maxLeaf < 7)
+		return SIMD_SSE4;
+
+	// The OS has to save the YMM (and for AVX-512 the ZMM) registers
+	unsigned long long xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6)
+		return SIMD_SSE4;
+
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	bool avx512f = (info[1] & (1 << 16)) != 0;
+	if (!avx2 || !fma)
+		return SIMD_SSE4;
+	if (avx512f && (xcr0 & 0xe6) == 0xe6)
+		return SIMD_AVX512;
+	return SIMD_AVX2;
+#elif defined(SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return SIMD_SSE4;
+	return SIMD_SCALAR;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel simdLevel()
+{
+	int level = selectedLevel.load(std::memory_order_relaxed);
+	if (level < 0)
+	{
+		level = detectSimdLevel();
+		selectedLevel.store(level, std::memory_order_relaxed);
+	}
+	return (SimdLevel)level;
+}
+
+void setSimdLevel(SimdLevel level)
+{
+	SimdLevel supported = detectSimdLevel();
+	selectedLevel.store(level < supported ? level : supported, std::memory_order_relaxed);
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_SSE4: return "SSE4.1";
+	case SIMD_AVX2: return "AVX2";
+	case SIMD_AVX512: return "AVX-512";
+	default: return "scalar";
+	}
+}
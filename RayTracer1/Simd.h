@@ -0,0 +1,81 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Instruction sets the SIMD kernels are compiled for, in increasing order
+enum SimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE4 = 1,
+	SIMD_AVX2 = 2,
+	SIMD_AVX512 = 3
+};
+
+// The vector kernels use x86 intrinsics, other targets get the scalar path
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86 1
+#endif
+
+// MSVC accepts every intrinsic without architecture flags, GCC and Clang
+// need the instruction set enabled on each function that uses it
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit of a lane mask, mask must not be 0
+inline int lowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Number of set lanes in a lane mask
+inline int bitCount(unsigned mask)
+{
+	int count = 0;
+	for (; mask != 0; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+// Picks the nearest of the lanes set in mask, t holds one distance per
+// lane. Returns -1 if none is closer than tMax, which is shrunk otherwise.
+inline int nearestLane(unsigned mask, const float* t, float& tMax)
+{
+	int nearest = -1;
+	while (mask != 0)
+	{
+		int lane = lowestBit(mask);
+		mask &= mask - 1;
+		if (t[lane] < tMax)
+		{
+			tMax = t[lane];
+			nearest = lane;
+		}
+	}
+	return nearest;
+}
+
+// Best level supported by both the CPU and the operating system
+SimdLevel detectSimdLevel();
+
+// Level the kernels dispatch to, detectSimdLevel() unless overridden
+SimdLevel simdLevel();
+
+// Forces a lower level, e.g. to compare kernels; higher levels than the
+// CPU supports are clamped
+void setSimdLevel(SimdLevel level);
+
+const char* simdLevelName(SimdLevel level);
+
+#endif // SIMD_H
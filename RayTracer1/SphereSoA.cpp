@@ -0,0 +1,735 @@
+#include "SphereSoA.h"
+#include "Simd.h"
+#include <cmath>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Every kernel solves the quadratic with the half-b form:
+// t = (-b -+ sqrt(b*b - a*c)) / a with b = dot(d, o) and c = dot(o, o) - r*r,
+// where o is the ray origin relative to the centre. The near root is used
+// unless it lies behind RAY_T_MIN, matching Sphere::intersect.
+
+namespace
+{
+	int intersectScalar(const SphereArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		float a = ray.direction.length2();
+		float invA = 1.0f / a;
+		int nearest = -1;
+
+		for (int i = first; i < first + count; i++)
+		{
+			float ox = ray.origin.x - s.x[i];
+			float oy = ray.origin.y - s.y[i];
+			float oz = ray.origin.z - s.z[i];
+
+			float b = ray.direction.x * ox + ray.direction.y * oy + ray.direction.z * oz;
+			float c = ox * ox + oy * oy + oz * oz - s.r2[i];
+			float discriminant = b * b - a * c;
+			if (discriminant < 0.0f)
+				continue;
+
+			float root = std::sqrt(discriminant);
+			float t = (-b - root) * invA;
+			if (t <= RAY_T_MIN)
+				t = (-b + root) * invA;
+
+			if (t > RAY_T_MIN && t < tMax)
+			{
+				tMax = t;
+				nearest = i;
+			}
+		}
+
+		return nearest;
+	}
+
+	bool occludedScalar(const SphereArrays& s, const Ray& ray, int first, int count)
+	{
+		float tMax = ray.tMax;
+		return intersectScalar(s, ray, first, count, tMax) >= 0;
+	}
+
+#ifdef SIMD_X86
+
+	struct LanesSSE4
+	{
+		__m128 ox, oy, oz, dx, dy, dz, a, invA;
+	};
+
+	SIMD_TARGET("sse4.1")
+	void broadcastSSE4(const Ray& ray, LanesSSE4& lanes)
+	{
+		float a = ray.direction.length2();
+		lanes.ox = _mm_set1_ps(ray.origin.x);
+		lanes.oy = _mm_set1_ps(ray.origin.y);
+		lanes.oz = _mm_set1_ps(ray.origin.z);
+		lanes.dx = _mm_set1_ps(ray.direction.x);
+		lanes.dy = _mm_set1_ps(ray.direction.y);
+		lanes.dz = _mm_set1_ps(ray.direction.z);
+		lanes.a = _mm_set1_ps(a);
+		lanes.invA = _mm_set1_ps(1.0f / a);
+	}
+
+	// Lane-wise quadratic for origins (ox, oy, oz) relative to the centres,
+	// mask holds the lanes hit in (RAY_T_MIN, tMax)
+	SIMD_TARGET("sse4.1")
+	inline __m128 solveSSE4(__m128 ox, __m128 oy, __m128 oz, __m128 r2, const LanesSSE4& ray,
+		__m128 tMax, __m128& mask)
+	{
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ray.dx, ox), _mm_mul_ps(ray.dy, oy)), _mm_mul_ps(ray.dz, oz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)), r2);
+		__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(ray.a, c));
+
+		__m128 zero = _mm_setzero_ps();
+		__m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+		__m128 minusB = _mm_sub_ps(zero, b);
+		__m128 tMin = _mm_set1_ps(RAY_T_MIN);
+		__m128 tNear = _mm_mul_ps(_mm_sub_ps(minusB, root), ray.invA);
+		__m128 tFar = _mm_mul_ps(_mm_add_ps(minusB, root), ray.invA);
+		__m128 t = _mm_blendv_ps(tFar, tNear, _mm_cmpgt_ps(tNear, tMin));
+
+		mask = _mm_and_ps(_mm_cmpge_ps(discriminant, zero),
+			_mm_and_ps(_mm_cmpgt_ps(t, tMin), _mm_cmplt_ps(t, tMax)));
+		return t;
+	}
+
+	// One ray against the spheres i .. i + 3
+	SIMD_TARGET("sse4.1")
+	inline __m128 hitSSE4(const SphereArrays& s, int i, const LanesSSE4& ray, __m128 tMax, __m128& mask)
+	{
+		return solveSSE4(_mm_sub_ps(ray.ox, _mm_loadu_ps(s.x + i)),
+			_mm_sub_ps(ray.oy, _mm_loadu_ps(s.y + i)),
+			_mm_sub_ps(ray.oz, _mm_loadu_ps(s.z + i)),
+			_mm_loadu_ps(s.r2 + i), ray, tMax, mask);
+	}
+
+	SIMD_TARGET("sse4.1")
+	int intersectSSE4(const SphereArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		LanesSSE4 lanes;
+		broadcastSSE4(ray, lanes);
+
+		int nearest = -1;
+		alignas(16) float t[4];
+		for (int i = first; i < first + count; i += 4)
+		{
+			__m128 mask;
+			_mm_store_ps(t, hitSSE4(s, i, lanes, _mm_set1_ps(tMax), mask));
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 4 ? 0xfu : (1u << remaining) - 1u;
+			int lane = nearestLane((unsigned)_mm_movemask_ps(mask) & tail, t, tMax);
+			if (lane >= 0)
+				nearest = i + lane;
+		}
+		return nearest;
+	}
+
+	SIMD_TARGET("sse4.1")
+	bool occludedSSE4(const SphereArrays& s, const Ray& ray, int first, int count)
+	{
+		LanesSSE4 lanes;
+		broadcastSSE4(ray, lanes);
+
+		__m128 tMax = _mm_set1_ps(ray.tMax);
+		for (int i = first; i < first + count; i += 4)
+		{
+			__m128 mask;
+			hitSSE4(s, i, lanes, tMax, mask);
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 4 ? 0xfu : (1u << remaining) - 1u;
+			if ((unsigned)_mm_movemask_ps(mask) & tail)
+				return true;
+		}
+		return false;
+	}
+
+	SIMD_TARGET("sse4.1")
+	void loadSSE4(const RayPacket& packet, int base, LanesSSE4& lanes)
+	{
+		lanes.ox = _mm_load_ps(packet.originX + base);
+		lanes.oy = _mm_load_ps(packet.originY + base);
+		lanes.oz = _mm_load_ps(packet.originZ + base);
+		lanes.dx = _mm_load_ps(packet.directionX + base);
+		lanes.dy = _mm_load_ps(packet.directionY + base);
+		lanes.dz = _mm_load_ps(packet.directionZ + base);
+		lanes.a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lanes.dx, lanes.dx), _mm_mul_ps(lanes.dy, lanes.dy)),
+			_mm_mul_ps(lanes.dz, lanes.dz));
+		lanes.invA = _mm_div_ps(_mm_set1_ps(1.0f), lanes.a);
+	}
+
+	// Vector lanes set for the bits of a 4 lane mask
+	SIMD_TARGET("sse4.1")
+	inline __m128 laneMaskSSE4(unsigned bits)
+	{
+		return _mm_castsi128_ps(_mm_cmpgt_epi32(
+			_mm_and_si128(_mm_set1_epi32((int)bits), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+	}
+
+	// Packet kernels put the rays in the vector lanes and broadcast one
+	// sphere at a time
+	SIMD_TARGET("sse4.1")
+	void intersectPacketSSE4(const SphereArrays& s, RayPacket& packet, unsigned active,
+		int first, int count, int* nearest)
+	{
+		for (int base = 0; base < RAY_PACKET_SIZE; base += 4)
+		{
+			unsigned bits = (active >> base) & 0xfu;
+			if (bits == 0)
+				continue;
+
+			LanesSSE4 lanes;
+			loadSSE4(packet, base, lanes);
+			__m128 live = laneMaskSSE4(bits);
+			__m128 tMax = _mm_load_ps(packet.tMax + base);
+			__m128 best = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(nearest + base)));
+
+			for (int i = first; i < first + count; i++)
+			{
+				__m128 mask;
+				__m128 t = solveSSE4(_mm_sub_ps(lanes.ox, _mm_set1_ps(s.x[i])),
+					_mm_sub_ps(lanes.oy, _mm_set1_ps(s.y[i])),
+					_mm_sub_ps(lanes.oz, _mm_set1_ps(s.z[i])),
+					_mm_set1_ps(s.r2[i]), lanes, tMax, mask);
+				mask = _mm_and_ps(mask, live);
+				tMax = _mm_blendv_ps(tMax, t, mask);
+				best = _mm_blendv_ps(best, _mm_castsi128_ps(_mm_set1_epi32(i)), mask);
+			}
+
+			_mm_store_ps(packet.tMax + base, tMax);
+			_mm_storeu_si128((__m128i*)(nearest + base), _mm_castps_si128(best));
+		}
+	}
+
+	SIMD_TARGET("sse4.1")
+	unsigned occludedPacketSSE4(const SphereArrays& s, const RayPacket& packet, unsigned active,
+		int first, int count)
+	{
+		unsigned blocked = 0;
+		for (int base = 0; base < RAY_PACKET_SIZE; base += 4)
+		{
+			unsigned bits = (active >> base) & 0xfu;
+			if (bits == 0)
+				continue;
+
+			LanesSSE4 lanes;
+			loadSSE4(packet, base, lanes);
+			__m128 tMax = _mm_load_ps(packet.tMax + base);
+
+			unsigned hit = 0;
+			for (int i = first; i < first + count && hit != bits; i++)
+			{
+				__m128 mask;
+				solveSSE4(_mm_sub_ps(lanes.ox, _mm_set1_ps(s.x[i])),
+					_mm_sub_ps(lanes.oy, _mm_set1_ps(s.y[i])),
+					_mm_sub_ps(lanes.oz, _mm_set1_ps(s.z[i])),
+					_mm_set1_ps(s.r2[i]), lanes, tMax, mask);
+				hit |= (unsigned)_mm_movemask_ps(mask) & bits;
+			}
+			blocked |= hit << base;
+		}
+		return blocked;
+	}
+
+	struct LanesAVX2
+	{
+		__m256 ox, oy, oz, dx, dy, dz, a, invA;
+	};
+
+	SIMD_TARGET("avx2,fma")
+	void broadcastAVX2(const Ray& ray, LanesAVX2& lanes)
+	{
+		float a = ray.direction.length2();
+		lanes.ox = _mm256_set1_ps(ray.origin.x);
+		lanes.oy = _mm256_set1_ps(ray.origin.y);
+		lanes.oz = _mm256_set1_ps(ray.origin.z);
+		lanes.dx = _mm256_set1_ps(ray.direction.x);
+		lanes.dy = _mm256_set1_ps(ray.direction.y);
+		lanes.dz = _mm256_set1_ps(ray.direction.z);
+		lanes.a = _mm256_set1_ps(a);
+		lanes.invA = _mm256_set1_ps(1.0f / a);
+	}
+
+	SIMD_TARGET("avx2,fma")
+	inline __m256 solveAVX2(__m256 ox, __m256 oy, __m256 oz, __m256 r2, const LanesAVX2& ray,
+		__m256 tMax, __m256& mask)
+	{
+		__m256 b = _mm256_fmadd_ps(ray.dz, oz, _mm256_fmadd_ps(ray.dy, oy, _mm256_mul_ps(ray.dx, ox)));
+		__m256 c = _mm256_fmadd_ps(oz, oz, _mm256_fmadd_ps(oy, oy, _mm256_fmsub_ps(ox, ox, r2)));
+		__m256 discriminant = _mm256_fmsub_ps(b, b, _mm256_mul_ps(ray.a, c));
+
+		__m256 zero = _mm256_setzero_ps();
+		__m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+		__m256 minusB = _mm256_sub_ps(zero, b);
+		__m256 tMin = _mm256_set1_ps(RAY_T_MIN);
+		__m256 tNear = _mm256_mul_ps(_mm256_sub_ps(minusB, root), ray.invA);
+		__m256 tFar = _mm256_mul_ps(_mm256_add_ps(minusB, root), ray.invA);
+		__m256 t = _mm256_blendv_ps(tFar, tNear, _mm256_cmp_ps(tNear, tMin, _CMP_GT_OQ));
+
+		mask = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ),
+			_mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GT_OQ), _mm256_cmp_ps(t, tMax, _CMP_LT_OQ)));
+		return t;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	inline __m256 hitAVX2(const SphereArrays& s, int i, const LanesAVX2& ray, __m256 tMax, __m256& mask)
+	{
+		return solveAVX2(_mm256_sub_ps(ray.ox, _mm256_loadu_ps(s.x + i)),
+			_mm256_sub_ps(ray.oy, _mm256_loadu_ps(s.y + i)),
+			_mm256_sub_ps(ray.oz, _mm256_loadu_ps(s.z + i)),
+			_mm256_loadu_ps(s.r2 + i), ray, tMax, mask);
+	}
+
+	SIMD_TARGET("avx2,fma")
+	int intersectAVX2(const SphereArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		LanesAVX2 lanes;
+		broadcastAVX2(ray, lanes);
+
+		int nearest = -1;
+		alignas(32) float t[8];
+		for (int i = first; i < first + count; i += 8)
+		{
+			__m256 mask;
+			_mm256_store_ps(t, hitAVX2(s, i, lanes, _mm256_set1_ps(tMax), mask));
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 8 ? 0xffu : (1u << remaining) - 1u;
+			int lane = nearestLane((unsigned)_mm256_movemask_ps(mask) & tail, t, tMax);
+			if (lane >= 0)
+				nearest = i + lane;
+		}
+		return nearest;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	bool occludedAVX2(const SphereArrays& s, const Ray& ray, int first, int count)
+	{
+		LanesAVX2 lanes;
+		broadcastAVX2(ray, lanes);
+
+		__m256 tMax = _mm256_set1_ps(ray.tMax);
+		for (int i = first; i < first + count; i += 8)
+		{
+			__m256 mask;
+			hitAVX2(s, i, lanes, tMax, mask);
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 8 ? 0xffu : (1u << remaining) - 1u;
+			if ((unsigned)_mm256_movemask_ps(mask) & tail)
+				return true;
+		}
+		return false;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	void loadAVX2(const RayPacket& packet, int base, LanesAVX2& lanes)
+	{
+		lanes.ox = _mm256_load_ps(packet.originX + base);
+		lanes.oy = _mm256_load_ps(packet.originY + base);
+		lanes.oz = _mm256_load_ps(packet.originZ + base);
+		lanes.dx = _mm256_load_ps(packet.directionX + base);
+		lanes.dy = _mm256_load_ps(packet.directionY + base);
+		lanes.dz = _mm256_load_ps(packet.directionZ + base);
+		lanes.a = _mm256_fmadd_ps(lanes.dz, lanes.dz,
+			_mm256_fmadd_ps(lanes.dy, lanes.dy, _mm256_mul_ps(lanes.dx, lanes.dx)));
+		lanes.invA = _mm256_div_ps(_mm256_set1_ps(1.0f), lanes.a);
+	}
+
+	SIMD_TARGET("avx2,fma")
+	inline __m256 laneMaskAVX2(unsigned bits)
+	{
+		return _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+			_mm256_and_si256(_mm256_set1_epi32((int)bits), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)),
+			_mm256_setzero_si256()));
+	}
+
+	SIMD_TARGET("avx2,fma")
+	void intersectPacketAVX2(const SphereArrays& s, RayPacket& packet, unsigned active,
+		int first, int count, int* nearest)
+	{
+		for (int base = 0; base < RAY_PACKET_SIZE; base += 8)
+		{
+			unsigned bits = (active >> base) & 0xffu;
+			if (bits == 0)
+				continue;
+
+			LanesAVX2 lanes;
+			loadAVX2(packet, base, lanes);
+			__m256 live = laneMaskAVX2(bits);
+			__m256 tMax = _mm256_load_ps(packet.tMax + base);
+			__m256 best = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(nearest + base)));
+
+			for (int i = first; i < first + count; i++)
+			{
+				__m256 mask;
+				__m256 t = solveAVX2(_mm256_sub_ps(lanes.ox, _mm256_set1_ps(s.x[i])),
+					_mm256_sub_ps(lanes.oy, _mm256_set1_ps(s.y[i])),
+					_mm256_sub_ps(lanes.oz, _mm256_set1_ps(s.z[i])),
+					_mm256_set1_ps(s.r2[i]), lanes, tMax, mask);
+				mask = _mm256_and_ps(mask, live);
+				tMax = _mm256_blendv_ps(tMax, t, mask);
+				best = _mm256_blendv_ps(best, _mm256_castsi256_ps(_mm256_set1_epi32(i)), mask);
+			}
+
+			_mm256_store_ps(packet.tMax + base, tMax);
+			_mm256_storeu_si256((__m256i*)(nearest + base), _mm256_castps_si256(best));
+		}
+	}
+
+	SIMD_TARGET("avx2,fma")
+	unsigned occludedPacketAVX2(const SphereArrays& s, const RayPacket& packet, unsigned active,
+		int first, int count)
+	{
+		unsigned blocked = 0;
+		for (int base = 0; base < RAY_PACKET_SIZE; base += 8)
+		{
+			unsigned bits = (active >> base) & 0xffu;
+			if (bits == 0)
+				continue;
+
+			LanesAVX2 lanes;
+			loadAVX2(packet, base, lanes);
+			__m256 tMax = _mm256_load_ps(packet.tMax + base);
+
+			unsigned hit = 0;
+			for (int i = first; i < first + count && hit != bits; i++)
+			{
+				__m256 mask;
+				solveAVX2(_mm256_sub_ps(lanes.ox, _mm256_set1_ps(s.x[i])),
+					_mm256_sub_ps(lanes.oy, _mm256_set1_ps(s.y[i])),
+					_mm256_sub_ps(lanes.oz, _mm256_set1_ps(s.z[i])),
+					_mm256_set1_ps(s.r2[i]), lanes, tMax, mask);
+				hit |= (unsigned)_mm256_movemask_ps(mask) & bits;
+			}
+			blocked |= hit << base;
+		}
+		return blocked;
+	}
+
+	struct LanesAVX512
+	{
+		__m512 ox, oy, oz, dx, dy, dz, a, invA;
+	};
+
+	SIMD_TARGET("avx512f")
+	void broadcastAVX512(const Ray& ray, LanesAVX512& lanes)
+	{
+		float a = ray.direction.length2();
+		lanes.ox = _mm512_set1_ps(ray.origin.x);
+		lanes.oy = _mm512_set1_ps(ray.origin.y);
+		lanes.oz = _mm512_set1_ps(ray.origin.z);
+		lanes.dx = _mm512_set1_ps(ray.direction.x);
+		lanes.dy = _mm512_set1_ps(ray.direction.y);
+		lanes.dz = _mm512_set1_ps(ray.direction.z);
+		lanes.a = _mm512_set1_ps(a);
+		lanes.invA = _mm512_set1_ps(1.0f / a);
+	}
+
+	// Lanes outside of live are masked out in the compares instead of afterwards
+	SIMD_TARGET("avx512f")
+	inline __m512 solveAVX512(__m512 ox, __m512 oy, __m512 oz, __m512 r2, const LanesAVX512& ray,
+		__m512 tMax, __mmask16 live, __mmask16& mask)
+	{
+		__m512 b = _mm512_fmadd_ps(ray.dz, oz, _mm512_fmadd_ps(ray.dy, oy, _mm512_mul_ps(ray.dx, ox)));
+		__m512 c = _mm512_fmadd_ps(oz, oz, _mm512_fmadd_ps(oy, oy, _mm512_fmsub_ps(ox, ox, r2)));
+		__m512 discriminant = _mm512_fmsub_ps(b, b, _mm512_mul_ps(ray.a, c));
+
+		__m512 zero = _mm512_setzero_ps();
+		__mmask16 real = _mm512_mask_cmp_ps_mask(live, discriminant, zero, _CMP_GE_OQ);
+		__m512 root = _mm512_sqrt_ps(_mm512_max_ps(discriminant, zero));
+		__m512 minusB = _mm512_sub_ps(zero, b);
+		__m512 tMin = _mm512_set1_ps(RAY_T_MIN);
+		__m512 tNear = _mm512_mul_ps(_mm512_sub_ps(minusB, root), ray.invA);
+		__m512 tFar = _mm512_mul_ps(_mm512_add_ps(minusB, root), ray.invA);
+		__m512 t = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(tNear, tMin, _CMP_GT_OQ), tFar, tNear);
+
+		mask = _mm512_mask_cmp_ps_mask(_mm512_mask_cmp_ps_mask(real, t, tMin, _CMP_GT_OQ), t, tMax, _CMP_LT_OQ);
+		return t;
+	}
+
+	SIMD_TARGET("avx512f")
+	inline __m512 hitAVX512(const SphereArrays& s, int i, const LanesAVX512& ray, __m512 tMax,
+		__mmask16 tail, __mmask16& mask)
+	{
+		return solveAVX512(_mm512_sub_ps(ray.ox, _mm512_loadu_ps(s.x + i)),
+			_mm512_sub_ps(ray.oy, _mm512_loadu_ps(s.y + i)),
+			_mm512_sub_ps(ray.oz, _mm512_loadu_ps(s.z + i)),
+			_mm512_loadu_ps(s.r2 + i), ray, tMax, tail, mask);
+	}
+
+	SIMD_TARGET("avx512f")
+	int intersectAVX512(const SphereArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		LanesAVX512 lanes;
+		broadcastAVX512(ray, lanes);
+
+		int nearest = -1;
+		alignas(64) float t[16];
+		for (int i = first; i < first + count; i += 16)
+		{
+			int remaining = first + count - i;
+			__mmask16 tail = (__mmask16)(remaining >= 16 ? 0xffffu : (1u << remaining) - 1u);
+			__mmask16 mask;
+			_mm512_store_ps(t, hitAVX512(s, i, lanes, _mm512_set1_ps(tMax), tail, mask));
+			int lane = nearestLane((unsigned)mask, t, tMax);
+			if (lane >= 0)
+				nearest = i + lane;
+		}
+		return nearest;
+	}
+
+	SIMD_TARGET("avx512f")
+	bool occludedAVX512(const SphereArrays& s, const Ray& ray, int first, int count)
+	{
+		LanesAVX512 lanes;
+		broadcastAVX512(ray, lanes);
+
+		__m512 tMax = _mm512_set1_ps(ray.tMax);
+		for (int i = first; i < first + count; i += 16)
+		{
+			int remaining = first + count - i;
+			__mmask16 tail = (__mmask16)(remaining >= 16 ? 0xffffu : (1u << remaining) - 1u);
+			__mmask16 mask;
+			hitAVX512(s, i, lanes, tMax, tail, mask);
+			if (mask)
+				return true;
+		}
+		return false;
+	}
+
+	SIMD_TARGET("avx512f")
+	void loadAVX512(const RayPacket& packet, LanesAVX512& lanes)
+	{
+		lanes.ox = _mm512_load_ps(packet.originX);
+		lanes.oy = _mm512_load_ps(packet.originY);
+		lanes.oz = _mm512_load_ps(packet.originZ);
+		lanes.dx = _mm512_load_ps(packet.directionX);
+		lanes.dy = _mm512_load_ps(packet.directionY);
+		lanes.dz = _mm512_load_ps(packet.directionZ);
+		lanes.a = _mm512_fmadd_ps(lanes.dz, lanes.dz,
+			_mm512_fmadd_ps(lanes.dy, lanes.dy, _mm512_mul_ps(lanes.dx, lanes.dx)));
+		lanes.invA = _mm512_div_ps(_mm512_set1_ps(1.0f), lanes.a);
+	}
+
+	SIMD_TARGET("avx512f")
+	void intersectPacketAVX512(const SphereArrays& s, RayPacket& packet, unsigned active,
+		int first, int count, int* nearest)
+	{
+		LanesAVX512 lanes;
+		loadAVX512(packet, lanes);
+		__m512 tMax = _mm512_load_ps(packet.tMax);
+		__m512i best = _mm512_loadu_si512(nearest);
+
+		for (int i = first; i < first + count; i++)
+		{
+			__mmask16 mask;
+			__m512 t = solveAVX512(_mm512_sub_ps(lanes.ox, _mm512_set1_ps(s.x[i])),
+				_mm512_sub_ps(lanes.oy, _mm512_set1_ps(s.y[i])),
+				_mm512_sub_ps(lanes.oz, _mm512_set1_ps(s.z[i])),
+				_mm512_set1_ps(s.r2[i]), lanes, tMax, (__mmask16)active, mask);
+			tMax = _mm512_mask_mov_ps(tMax, mask, t);
+			best = _mm512_mask_mov_epi32(best, mask, _mm512_set1_epi32(i));
+		}
+
+		_mm512_store_ps(packet.tMax, tMax);
+		_mm512_storeu_si512(nearest, best);
+	}
+
+	SIMD_TARGET("avx512f")
+	unsigned occludedPacketAVX512(const SphereArrays& s, const RayPacket& packet, unsigned active,
+		int first, int count)
+	{
+		LanesAVX512 lanes;
+		loadAVX512(packet, lanes);
+		__m512 tMax = _mm512_load_ps(packet.tMax);
+
+		// Lanes drop out of the tests once they are blocked
+		unsigned open = active;
+		for (int i = first; i < first + count && open != 0; i++)
+		{
+			__mmask16 mask;
+			solveAVX512(_mm512_sub_ps(lanes.ox, _mm512_set1_ps(s.x[i])),
+				_mm512_sub_ps(lanes.oy, _mm512_set1_ps(s.y[i])),
+				_mm512_sub_ps(lanes.oz, _mm512_set1_ps(s.z[i])),
+				_mm512_set1_ps(s.r2[i]), lanes, tMax, (__mmask16)open, mask);
+			open &= ~(unsigned)mask;
+		}
+		return active & ~open;
+	}
+
+#endif // SIMD_X86
+}
+
+SphereSoA::SphereSoA()
+	: count(0)
+{
+	clear();
+}
+
+void SphereSoA::clear()
+{
+	count = 0;
+	attached = SphereArrays();
+	centreX.assign(SPHERE_SOA_WIDTH, 0.0f);
+	centreY.assign(SPHERE_SOA_WIDTH, 0.0f);
+	centreZ.assign(SPHERE_SOA_WIDTH, 0.0f);
+
+	// A negative squared radius makes the discriminant negative for any ray
+	radius2.assign(SPHERE_SOA_WIDTH, -1.0f);
+}
+
+void SphereSoA::reserve(int capacity)
+{
+	centreX.reserve(capacity + SPHERE_SOA_WIDTH);
+	centreY.reserve(capacity + SPHERE_SOA_WIDTH);
+	centreZ.reserve(capacity + SPHERE_SOA_WIDTH);
+	radius2.reserve(capacity + SPHERE_SOA_WIDTH);
+}
+
+void SphereSoA::add(const Point& centre, float radius)
+{
+	// Overwrite the first padding entry and append a new one behind it
+	set(count, centre, radius);
+
+	centreX.push_back(0.0f);
+	centreY.push_back(0.0f);
+	centreZ.push_back(0.0f);
+	radius2.push_back(-1.0f);
+
+	count++;
+}
+
+void SphereSoA::set(int index, const Point& centre, float radius)
+{
+	centreX[index] = centre.x;
+	centreY[index] = centre.y;
+	centreZ[index] = centre.z;
+	radius2[index] = radius * radius;
+}
+
+void SphereSoA::attach(const SphereArrays& arrays, int count)
+{
+	clear();
+	this->count = count;
+	attached = arrays;
+}
+
+SphereArrays SphereSoA::arrays() const
+{
+	if (attached.x)
+		return attached;
+
+	SphereArrays arrays = { &centreX[0], &centreY[0], &centreZ[0], &radius2[0] };
+	return arrays;
+}
+
+int SphereSoA::size() const
+{
+	return count;
+}
+
+Point SphereSoA::centre(int index) const
+{
+	SphereArrays spheres = arrays();
+	return Point(spheres.x[index], spheres.y[index], spheres.z[index]);
+}
+
+float SphereSoA::radius(int index) const
+{
+	return std::sqrt(arrays().r2[index]);
+}
+
+int SphereSoA::intersect(const Ray& ray, int first, int count, float& tMax) const
+{
+	SphereArrays arrays = this->arrays();
+
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512: return intersectAVX512(arrays, ray, first, count, tMax);
+	case SIMD_AVX2: return intersectAVX2(arrays, ray, first, count, tMax);
+	case SIMD_SSE4: return intersectSSE4(arrays, ray, first, count, tMax);
+#endif
+	default: return intersectScalar(arrays, ray, first, count, tMax);
+	}
+}
+
+bool SphereSoA::occluded(const Ray& ray, int first, int count) const
+{
+	SphereArrays arrays = this->arrays();
+
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512: return occludedAVX512(arrays, ray, first, count);
+	case SIMD_AVX2: return occludedAVX2(arrays, ray, first, count);
+	case SIMD_SSE4: return occludedSSE4(arrays, ray, first, count);
+#endif
+	default: return occludedScalar(arrays, ray, first, count);
+	}
+}
+
+void SphereSoA::intersect(RayPacket& packet, unsigned active, int first, int count, int* nearest) const
+{
+	SimdLevel level = simdLevel();
+
+	// Too few rays left to fill the vector lanes, each one is better off
+	// testing several spheres at once
+	if (level == SIMD_SCALAR || bitCount(active) < RAY_PACKET_MIN_ACTIVE)
+	{
+		for (unsigned bits = active; bits != 0; bits &= bits - 1)
+		{
+			int lane = lowestBit(bits);
+			int index = intersect(packet.ray(lane), first, count, packet.tMax[lane]);
+			if (index >= 0)
+				nearest[lane] = index;
+		}
+		return;
+	}
+
+#ifdef SIMD_X86
+	SphereArrays arrays = this->arrays();
+#endif
+
+	switch (level)
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512: intersectPacketAVX512(arrays, packet, active, first, count, nearest); break;
+	case SIMD_AVX2: intersectPacketAVX2(arrays, packet, active, first, count, nearest); break;
+	case SIMD_SSE4: intersectPacketSSE4(arrays, packet, active, first, count, nearest); break;
+#endif
+	default: break;
+	}
+}
+
+unsigned SphereSoA::occluded(const RayPacket& packet, unsigned active, int first, int count) const
+{
+	SimdLevel level = simdLevel();
+
+	if (level == SIMD_SCALAR || bitCount(active) < RAY_PACKET_MIN_ACTIVE)
+	{
+		unsigned blocked = 0;
+		for (unsigned bits = active; bits != 0; bits &= bits - 1)
+		{
+			int lane = lowestBit(bits);
+			if (occluded(packet.ray(lane), first, count))
+				blocked |= 1u << lane;
+		}
+		return blocked;
+	}
+
+#ifdef SIMD_X86
+	SphereArrays arrays = this->arrays();
+#endif
+
+	switch (level)
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512: return occludedPacketAVX512(arrays, packet, active, first, count);
+	case SIMD_AVX2: return occludedPacketAVX2(arrays, packet, active, first, count);
+	case SIMD_SSE4: return occludedPacketSSE4(arrays, packet, active, first, count);
+#endif
+	default: return 0;
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef SPHERESOA_H
+#define SPHERESOA_H
+
+#include <vector>
+#include "Vector3.h"
+#include "Ray.h"
+#include "RayPacket.h"
+
+// Widest kernel (AVX-512) reads this many spheres at once
+#define SPHERE_SOA_WIDTH 16
+
+// Pointers to the four arrays of a SphereSoA, each holding size() +
+// SPHERE_SOA_WIDTH entries
+struct SphereArrays
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* r2;
+};
+
+// Spheres stored structure-of-arrays: one array per centre coordinate and
+// one of squared radii, so a single ray is tested against 4, 8 or 16
+// spheres per instruction. The arrays end in SPHERE_SOA_WIDTH padding
+// entries that never hit, which keeps vector loads past the last sphere
+// in bounds.
+class SphereSoA
+{
+protected:
+
+	std::vector<float> centreX;
+	std::vector<float> centreY;
+	std::vector<float> centreZ;
+	std::vector<float> radius2;
+
+	int count;
+
+	// Arrays owned by someone else, see attach(); x is NULL while the
+	// vectors above are in use
+	SphereArrays attached;
+
+public:
+
+	SphereSoA();
+
+	void clear();
+
+	void reserve(int capacity);
+
+	void add(const Point& centre, float radius);
+
+	// Replaces sphere index of the ones added, not of attached arrays
+	void set(int index, const Point& centre, float radius);
+
+	// Uses count spheres from existing arrays, e.g. a mapped scene cache,
+	// in place of copying them. The arrays must include the padding
+	// entries and outlive this object or the next clear(), which has to
+	// come before any further add().
+	void attach(const SphereArrays& arrays, int count);
+
+	SphereArrays arrays() const;
+
+	int size() const;
+
+	Point centre(int index) const;
+
+	float radius(int index) const;
+
+	// Nearest hit with t in (RAY_T_MIN, tMax) among the spheres
+	// [first, first + count). Returns the sphere's index and shrinks tMax,
+	// or -1 when none of them is hit.
+	int intersect(const Ray& ray, int first, int count, float& tMax) const;
+
+	// True if any of the spheres [first, first + count) is hit with t in
+	// (RAY_T_MIN, ray.tMax)
+	bool occluded(const Ray& ray, int first, int count) const;
+
+	// Packet versions for the lanes in active: nearest[lane] receives the
+	// index of a closer sphere and packet.tMax[lane] its distance
+	void intersect(RayPacket& packet, unsigned active, int first, int count, int* nearest) const;
+
+	// Returns the lanes in active that one of the spheres blocks
+	unsigned occluded(const RayPacket& packet, unsigned active, int first, int count) const;
+};
+
+#endif // SPHERESOA_H
@@ -0,0 +1,109 @@
+#include "TextCursor.h"
+
+#include <cmath>
+
+bool readFloat(TextCursor& cursor, float& value)
+{
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	skipBlanks(cursor);
+	const char* p = cursor.pos;
+	const char* end = cursor.end;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	// Digits beyond the 18th only move the exponent
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	for (; p < end && isDigit(*p); p++, digits++)
+	{
+		if (mantissa < 100000000000000000ull)
+			mantissa = mantissa * 10 + (*p - '0');
+		else
+			exponent++;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && isDigit(*p); p++, digits++)
+		{
+			if (mantissa < 100000000000000000ull)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (digits == 0)
+		return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = *p++ == '-';
+		if (p == end || !isDigit(*p))
+			return false;
+
+		int power = 0;
+		for (; p < end && isDigit(*p); p++)
+		{
+			if (power < 10000)
+				power = power * 10 + (*p - '0');
+		}
+		exponent += negativeExponent ? -power : power;
+	}
+
+	cursor.pos = p;
+	if (!isWordEnd(cursor))
+		return false;
+
+	double result = (double)mantissa;
+	if (mantissa != 0)
+	{
+		for (; exponent > 22 && result < 1e300; exponent -= 22)
+			result *= 1e22;
+		for (; exponent < -22 && result > 1e-300; exponent += 22)
+			result /= 1e22;
+		if (exponent > 22)
+			result = HUGE_VAL;
+		else if (exponent < -22)
+			result = 0.0;
+		else if (exponent >= 0)
+			result *= powers[exponent];
+		else
+			result /= powers[-exponent];
+	}
+
+	value = (float)(negative ? -result : result);
+	return std::isfinite(value);
+}
+
+bool readInt(TextCursor& cursor, int& value)
+{
+	skipBlanks(cursor);
+	const char* p = cursor.pos;
+	bool negative = false;
+	if (p < cursor.end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p == cursor.end || !isDigit(*p))
+		return false;
+
+	long long result = 0;
+	for (; p < cursor.end && isDigit(*p); p++)
+	{
+		result = result * 10 + (*p - '0');
+		if (result > 0x7fffffff)
+			return false;
+	}
+
+	cursor.pos = p;
+	value = (int)(negative ? -result : result);
+	return isWordEnd(cursor);
+}
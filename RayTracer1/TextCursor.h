@@ -0,0 +1,86 @@
+#ifndef TEXTCURSOR_H
+#define TEXTCURSOR_H
+
+#include <cstddef>
+#include <cstring>
+
+// Reads the text in place: words are pointer ranges into the buffer and
+// numbers are converted straight from them, nothing is allocated per token
+struct TextCursor
+{
+	const char* pos;
+	const char* end;
+	int line;
+};
+
+inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline bool isWordEnd(const TextCursor& cursor)
+{
+	return cursor.pos == cursor.end || isBlank(*cursor.pos)
+		|| *cursor.pos == '\n' || *cursor.pos == '#';
+}
+
+// Skips blanks and a trailing comment, but not the line break
+inline void skipBlanks(TextCursor& cursor)
+{
+	while (cursor.pos < cursor.end && isBlank(*cursor.pos))
+		cursor.pos++;
+	if (cursor.pos < cursor.end && *cursor.pos == '#')
+	{
+		const char* lineEnd = (const char*)std::memchr(cursor.pos, '\n', cursor.end - cursor.pos);
+		cursor.pos = lineEnd ? lineEnd : cursor.end;
+	}
+}
+
+// Next word of the current line, length 0 at the end of the line
+inline size_t readWord(TextCursor& cursor, const char*& word)
+{
+	skipBlanks(cursor);
+	word = cursor.pos;
+	while (!isWordEnd(cursor))
+		cursor.pos++;
+	return cursor.pos - word;
+}
+
+inline bool isKeyword(const char* word, size_t length, const char* keyword)
+{
+	return std::strlen(keyword) == length && std::memcmp(word, keyword, length) == 0;
+}
+
+// Consumes the line break, false if anything but a comment is left
+inline bool readLineEnd(TextCursor& cursor)
+{
+	skipBlanks(cursor);
+	if (cursor.pos == cursor.end)
+		return true;
+	if (*cursor.pos != '\n')
+		return false;
+	cursor.pos++;
+	cursor.line++;
+	return true;
+}
+
+inline void skipLine(TextCursor& cursor)
+{
+	const char* lineEnd = (const char*)std::memchr(cursor.pos, '\n', cursor.end - cursor.pos);
+	cursor.pos = lineEnd ? lineEnd : cursor.end;
+}
+
+// Decimal number with optional sign, fraction and exponent. The digits
+// are gathered in an integer and scaled once by an exact power of ten,
+// which is within an ulp of strtof and several times faster.
+bool readFloat(TextCursor& cursor, float& value);
+
+// Decimal integer with optional sign that fits in an int
+bool readInt(TextCursor& cursor, int& value);
+
+#endif // TEXTCURSOR_H
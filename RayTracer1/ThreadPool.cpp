@@ -0,0 +1,207 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Lets run() find the deque belonging to the calling worker
+	thread_local const ThreadPool* tlsPool = NULL;
+	thread_local unsigned tlsWorker = 0;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount)
+	: queued(0),
+	stopping(false)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	// One deque per worker plus one shared by threads outside the pool
+	for (unsigned i = 0; i <= threadCount; i++)
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+	for (unsigned i = 0; i < threadCount; i++)
+		threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::vector<std::thread>::iterator iter = threads.begin();
+		iter != threads.end();
+		++iter)
+	{
+		iter->join();
+	}
+}
+
+unsigned ThreadPool::size() const
+{
+	return (unsigned)threads.size();
+}
+
+unsigned ThreadPool::currentWorker() const
+{
+	if (tlsPool == this)
+		return tlsWorker;
+	return size();
+}
+
+void ThreadPool::push(unsigned queue, Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+		queues[queue]->tasks.push_back(std::move(task));
+	}
+
+	// Taking the sleep mutex orders the increment against a worker that is
+	// about to check the counter and go to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::pop(unsigned queue, Task& task)
+{
+	std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+	if (queues[queue]->tasks.empty())
+		return false;
+
+	task = std::move(queues[queue]->tasks.back());
+	queues[queue]->tasks.pop_back();
+	queued--;
+	return true;
+}
+
+bool ThreadPool::steal(unsigned thief, Task& task)
+{
+	unsigned count = (unsigned)queues.size();
+	for (unsigned i = 1; i < count; i++)
+	{
+		Queue& victim = *queues[(thief + i) % count];
+
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty())
+			continue;
+
+		// Take the oldest task, the owner keeps working on the newest
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		queued--;
+		return true;
+	}
+
+	return false;
+}
+
+bool ThreadPool::tryRunTask(unsigned worker)
+{
+	Task task;
+	if (!pop(worker, task) && !steal(worker, task))
+		return false;
+
+	task(worker);
+	return true;
+}
+
+void ThreadPool::workerLoop(unsigned worker)
+{
+	tlsPool = this;
+	tlsWorker = worker;
+
+	while (true)
+	{
+		if (tryRunTask(worker))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+		if (stopping)
+			return;
+	}
+}
+
+void ThreadPool::run(TaskGroup& group, Task task)
+{
+	group.pending++;
+
+	TaskGroup* pGroup = &group;
+	push(currentWorker(), [pGroup, task](unsigned worker)
+	{
+		task(worker);
+		pGroup->pending--;
+	});
+}
+
+void ThreadPool::wait(TaskGroup& group)
+{
+	unsigned worker = currentWorker();
+
+	while (group.pending > 0)
+	{
+		if (!tryRunTask(worker))
+			std::this_thread::yield();
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int index, unsigned worker)>& body)
+{
+	if (count <= 0)
+		return;
+
+	TaskGroup group;
+	group.pending += count;
+
+	// Deal the indices out in contiguous blocks so every worker starts on
+	// its own region; stealing evens out whatever imbalance is left
+	const std::function<void(int, unsigned)>* pBody = &body;
+	TaskGroup* pGroup = &group;
+	unsigned workers = size();
+	for (int i = 0; i < count; i++)
+	{
+		unsigned queue = (unsigned)((long long)i * workers / count);
+		push(queue, [pBody, pGroup, i](unsigned worker)
+		{
+			(*pBody)(i, worker);
+			pGroup->pending--;
+		});
+	}
+
+	wait(group);
+}
+
+int ThreadPool::rangeCount(int count, int minSize) const
+{
+	// Four ranges per worker leave room for stealing to balance them
+	return std::max(1, std::min((int)size() * 4, count / std::max(minSize, 1)));
+}
+
+void ThreadPool::parallelRanges(int count, int minSize,
+	const std::function<void(int range, int begin, int end, unsigned worker)>& body)
+{
+	if (count <= 0)
+		return;
+
+	int ranges = rangeCount(count, minSize);
+	if (ranges == 1)
+	{
+		body(0, 0, count, currentWorker());
+		return;
+	}
+
+	parallelFor(ranges, [&](int index, unsigned worker)
+	{
+		int begin = (int)((long long)count * index / ranges);
+		int end = (int)((long long)count * (index + 1) / ranges);
+		body(index, begin, end, worker);
+	});
+}
@@ -0,0 +1,86 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the tasks of one batch that are still running
+struct TaskGroup
+{
+	std::atomic<int> pending;
+
+	TaskGroup() : pending(0) { }
+};
+
+// Persistent pool of worker threads. Every worker owns a deque of tasks:
+// it pops new work from the back of its own deque and, once that is empty,
+// steals the oldest task from the front of another worker's deque.
+class ThreadPool
+{
+public:
+	typedef std::function<void(unsigned worker)> Task;
+
+	// threadCount == 0 uses std::thread::hardware_concurrency()
+	ThreadPool(unsigned threadCount = 0);
+
+	~ThreadPool();
+
+	unsigned size() const;
+
+	// Queues a task on the calling worker's deque (or the caller's own
+	// deque when called from outside the pool)
+	void run(TaskGroup& group, Task task);
+
+	// Blocks until every task of the group has finished, executing queued
+	// tasks in the meantime so nested waits cannot deadlock
+	void wait(TaskGroup& group);
+
+	// Runs body(index, worker) for every index in [0, count). Indices are
+	// handed out to the workers in contiguous blocks and balanced by stealing.
+	void parallelFor(int count, const std::function<void(int index, unsigned worker)>& body);
+
+	// Number of ranges parallelRanges() splits count indices into: a few
+	// per worker, none shorter than minSize unless count is
+	int rangeCount(int count, int minSize) const;
+
+	// Runs body(range, begin, end, worker) for each of the
+	// rangeCount(count, minSize) contiguous ranges of [0, count)
+	void parallelRanges(int count, int minSize,
+		const std::function<void(int range, int begin, int end, unsigned worker)>& body);
+
+	// Index of the worker running the calling thread, size() for outsiders
+	unsigned currentWorker() const;
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void push(unsigned queue, Task task);
+
+	bool pop(unsigned queue, Task& task);
+
+	bool steal(unsigned thief, Task& task);
+
+	bool tryRunTask(unsigned worker);
+
+	void workerLoop(unsigned worker);
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::atomic<int> queued;
+	std::atomic<bool> stopping;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,386 @@
+#include "TriangleSoA.h"
+#include "Simd.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Every kernel runs the Möller-Trumbore test: with p = cross(d, e2),
+// det = dot(e1, p), s = o - v0 and q = cross(s, e1) the barycentrics are
+// u = dot(s, p) / det and v = dot(d, q) / det, and t = dot(e2, q) / det.
+// Rays parallel to a triangle, and the zero-edge padding, have det == 0.
+
+namespace
+{
+	int intersectScalar(const TriangleArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		const Vector& d = ray.direction;
+		int nearest = -1;
+
+		for (int i = first; i < first + count; i++)
+		{
+			float px = d.y * s.e2z[i] - d.z * s.e2y[i];
+			float py = d.z * s.e2x[i] - d.x * s.e2z[i];
+			float pz = d.x * s.e2y[i] - d.y * s.e2x[i];
+			float det = s.e1x[i] * px + s.e1y[i] * py + s.e1z[i] * pz;
+			if (det == 0.0f)
+				continue;
+			float invDet = 1.0f / det;
+
+			float sx = ray.origin.x - s.v0x[i];
+			float sy = ray.origin.y - s.v0y[i];
+			float sz = ray.origin.z - s.v0z[i];
+			float u = (sx * px + sy * py + sz * pz) * invDet;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+
+			float qx = sy * s.e1z[i] - sz * s.e1y[i];
+			float qy = sz * s.e1x[i] - sx * s.e1z[i];
+			float qz = sx * s.e1y[i] - sy * s.e1x[i];
+			float v = (d.x * qx + d.y * qy + d.z * qz) * invDet;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+
+			float t = (s.e2x[i] * qx + s.e2y[i] * qy + s.e2z[i] * qz) * invDet;
+			if (t > RAY_T_MIN && t < tMax)
+			{
+				tMax = t;
+				nearest = i;
+			}
+		}
+
+		return nearest;
+	}
+
+	bool occludedScalar(const TriangleArrays& s, const Ray& ray, int first, int count)
+	{
+		float tMax = ray.tMax;
+		return intersectScalar(s, ray, first, count, tMax) >= 0;
+	}
+
+#ifdef SIMD_X86
+
+	struct LanesSSE4
+	{
+		__m128 ox, oy, oz, dx, dy, dz;
+	};
+
+	SIMD_TARGET("sse4.1")
+	void broadcastSSE4(const Ray& ray, LanesSSE4& lanes)
+	{
+		lanes.ox = _mm_set1_ps(ray.origin.x);
+		lanes.oy = _mm_set1_ps(ray.origin.y);
+		lanes.oz = _mm_set1_ps(ray.origin.z);
+		lanes.dx = _mm_set1_ps(ray.direction.x);
+		lanes.dy = _mm_set1_ps(ray.direction.y);
+		lanes.dz = _mm_set1_ps(ray.direction.z);
+	}
+
+	// One ray against the triangles i .. i + 3, mask holds the lanes hit in
+	// (RAY_T_MIN, tMax)
+	SIMD_TARGET("sse4.1")
+	inline __m128 hitSSE4(const TriangleArrays& s, int i, const LanesSSE4& ray, __m128 tMax, __m128& mask)
+	{
+		__m128 e1x = _mm_loadu_ps(s.e1x + i);
+		__m128 e1y = _mm_loadu_ps(s.e1y + i);
+		__m128 e1z = _mm_loadu_ps(s.e1z + i);
+		__m128 e2x = _mm_loadu_ps(s.e2x + i);
+		__m128 e2y = _mm_loadu_ps(s.e2y + i);
+		__m128 e2z = _mm_loadu_ps(s.e2z + i);
+
+		__m128 px = _mm_sub_ps(_mm_mul_ps(ray.dy, e2z), _mm_mul_ps(ray.dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(ray.dz, e2x), _mm_mul_ps(ray.dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(ray.dx, e2y), _mm_mul_ps(ray.dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+		__m128 sx = _mm_sub_ps(ray.ox, _mm_loadu_ps(s.v0x + i));
+		__m128 sy = _mm_sub_ps(ray.oy, _mm_loadu_ps(s.v0y + i));
+		__m128 sz = _mm_sub_ps(ray.oz, _mm_loadu_ps(s.v0z + i));
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+			_mm_mul_ps(sz, pz)), invDet);
+
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ray.dx, qx), _mm_mul_ps(ray.dy, qy)),
+			_mm_mul_ps(ray.dz, qz)), invDet);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+			_mm_mul_ps(e2z, qz)), invDet);
+
+		__m128 zero = _mm_setzero_ps();
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+			_mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+		mask = _mm_and_ps(_mm_and_ps(_mm_cmpneq_ps(det, zero), inside),
+			_mm_and_ps(_mm_cmpgt_ps(t, _mm_set1_ps(RAY_T_MIN)), _mm_cmplt_ps(t, tMax)));
+		return t;
+	}
+
+	SIMD_TARGET("sse4.1")
+	int intersectSSE4(const TriangleArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		LanesSSE4 lanes;
+		broadcastSSE4(ray, lanes);
+
+		int nearest = -1;
+		alignas(16) float t[4];
+		for (int i = first; i < first + count; i += 4)
+		{
+			__m128 mask;
+			_mm_store_ps(t, hitSSE4(s, i, lanes, _mm_set1_ps(tMax), mask));
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 4 ? 0xfu : (1u << remaining) - 1u;
+			int lane = nearestLane((unsigned)_mm_movemask_ps(mask) & tail, t, tMax);
+			if (lane >= 0)
+				nearest = i + lane;
+		}
+		return nearest;
+	}
+
+	SIMD_TARGET("sse4.1")
+	bool occludedSSE4(const TriangleArrays& s, const Ray& ray, int first, int count)
+	{
+		LanesSSE4 lanes;
+		broadcastSSE4(ray, lanes);
+
+		__m128 tMax = _mm_set1_ps(ray.tMax);
+		for (int i = first; i < first + count; i += 4)
+		{
+			__m128 mask;
+			hitSSE4(s, i, lanes, tMax, mask);
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 4 ? 0xfu : (1u << remaining) - 1u;
+			if ((unsigned)_mm_movemask_ps(mask) & tail)
+				return true;
+		}
+		return false;
+	}
+
+	struct LanesAVX2
+	{
+		__m256 ox, oy, oz, dx, dy, dz;
+	};
+
+	SIMD_TARGET("avx2,fma")
+	void broadcastAVX2(const Ray& ray, LanesAVX2& lanes)
+	{
+		lanes.ox = _mm256_set1_ps(ray.origin.x);
+		lanes.oy = _mm256_set1_ps(ray.origin.y);
+		lanes.oz = _mm256_set1_ps(ray.origin.z);
+		lanes.dx = _mm256_set1_ps(ray.direction.x);
+		lanes.dy = _mm256_set1_ps(ray.direction.y);
+		lanes.dz = _mm256_set1_ps(ray.direction.z);
+	}
+
+	// A whole BVH leaf of up to eight triangles per call
+	SIMD_TARGET("avx2,fma")
+	inline __m256 hitAVX2(const TriangleArrays& s, int i, const LanesAVX2& ray, __m256 tMax, __m256& mask)
+	{
+		__m256 e1x = _mm256_loadu_ps(s.e1x + i);
+		__m256 e1y = _mm256_loadu_ps(s.e1y + i);
+		__m256 e1z = _mm256_loadu_ps(s.e1z + i);
+		__m256 e2x = _mm256_loadu_ps(s.e2x + i);
+		__m256 e2y = _mm256_loadu_ps(s.e2y + i);
+		__m256 e2z = _mm256_loadu_ps(s.e2z + i);
+
+		__m256 px = _mm256_fmsub_ps(ray.dy, e2z, _mm256_mul_ps(ray.dz, e2y));
+		__m256 py = _mm256_fmsub_ps(ray.dz, e2x, _mm256_mul_ps(ray.dx, e2z));
+		__m256 pz = _mm256_fmsub_ps(ray.dx, e2y, _mm256_mul_ps(ray.dy, e2x));
+		__m256 det = _mm256_fmadd_ps(e1z, pz, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1x, px)));
+		__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+		__m256 sx = _mm256_sub_ps(ray.ox, _mm256_loadu_ps(s.v0x + i));
+		__m256 sy = _mm256_sub_ps(ray.oy, _mm256_loadu_ps(s.v0y + i));
+		__m256 sz = _mm256_sub_ps(ray.oz, _mm256_loadu_ps(s.v0z + i));
+		__m256 u = _mm256_mul_ps(_mm256_fmadd_ps(sz, pz, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sx, px))), invDet);
+
+		__m256 qx = _mm256_fmsub_ps(sy, e1z, _mm256_mul_ps(sz, e1y));
+		__m256 qy = _mm256_fmsub_ps(sz, e1x, _mm256_mul_ps(sx, e1z));
+		__m256 qz = _mm256_fmsub_ps(sx, e1y, _mm256_mul_ps(sy, e1x));
+		__m256 v = _mm256_mul_ps(_mm256_fmadd_ps(ray.dz, qz, _mm256_fmadd_ps(ray.dy, qy,
+			_mm256_mul_ps(ray.dx, qx))), invDet);
+		__m256 t = _mm256_mul_ps(_mm256_fmadd_ps(e2z, qz, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2x, qx))), invDet);
+
+		__m256 zero = _mm256_setzero_ps();
+		__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ),
+			_mm256_cmp_ps(v, zero, _CMP_GE_OQ)),
+			_mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+		mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_OQ), inside),
+			_mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(RAY_T_MIN), _CMP_GT_OQ),
+				_mm256_cmp_ps(t, tMax, _CMP_LT_OQ)));
+		return t;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	int intersectAVX2(const TriangleArrays& s, const Ray& ray, int first, int count, float& tMax)
+	{
+		LanesAVX2 lanes;
+		broadcastAVX2(ray, lanes);
+
+		int nearest = -1;
+		alignas(32) float t[8];
+		for (int i = first; i < first + count; i += 8)
+		{
+			__m256 mask;
+			_mm256_store_ps(t, hitAVX2(s, i, lanes, _mm256_set1_ps(tMax), mask));
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 8 ? 0xffu : (1u << remaining) - 1u;
+			int lane = nearestLane((unsigned)_mm256_movemask_ps(mask) & tail, t, tMax);
+			if (lane >= 0)
+				nearest = i + lane;
+		}
+		return nearest;
+	}
+
+	SIMD_TARGET("avx2,fma")
+	bool occludedAVX2(const TriangleArrays& s, const Ray& ray, int first, int count)
+	{
+		LanesAVX2 lanes;
+		broadcastAVX2(ray, lanes);
+
+		__m256 tMax = _mm256_set1_ps(ray.tMax);
+		for (int i = first; i < first + count; i += 8)
+		{
+			__m256 mask;
+			hitAVX2(s, i, lanes, tMax, mask);
+			int remaining = first + count - i;
+			unsigned tail = remaining >= 8 ? 0xffu : (1u << remaining) - 1u;
+			if ((unsigned)_mm256_movemask_ps(mask) & tail)
+				return true;
+		}
+		return false;
+	}
+
+#endif // SIMD_X86
+}
+
+TriangleSoA::TriangleSoA()
+	: count(0)
+{
+	clear();
+}
+
+void TriangleSoA::clear()
+{
+	count = 0;
+	attached = TriangleArrays();
+
+	// Zero edges give det == 0, which no kernel counts as a hit
+	v0x.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	v0y.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	v0z.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	e1x.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	e1y.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	e1z.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	e2x.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	e2y.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+	e2z.assign(TRIANGLE_SOA_WIDTH, 0.0f);
+}
+
+void TriangleSoA::reserve(int capacity)
+{
+	v0x.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	v0y.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	v0z.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	e1x.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	e1y.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	e1z.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	e2x.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	e2y.reserve(capacity + TRIANGLE_SOA_WIDTH);
+	e2z.reserve(capacity + TRIANGLE_SOA_WIDTH);
+}
+
+void TriangleSoA::add(const Point& a, const Point& b, const Point& c)
+{
+	// Overwrite the first padding entry and append a new one behind it
+	set(count, a, b, c);
+
+	v0x.push_back(0.0f);
+	v0y.push_back(0.0f);
+	v0z.push_back(0.0f);
+	e1x.push_back(0.0f);
+	e1y.push_back(0.0f);
+	e1z.push_back(0.0f);
+	e2x.push_back(0.0f);
+	e2y.push_back(0.0f);
+	e2z.push_back(0.0f);
+
+	count++;
+}
+
+void TriangleSoA::set(int index, const Point& a, const Point& b, const Point& c)
+{
+	Vector edge1 = b - a;
+	Vector edge2 = c - a;
+
+	v0x[index] = a.x;
+	v0y[index] = a.y;
+	v0z[index] = a.z;
+	e1x[index] = edge1.x;
+	e1y[index] = edge1.y;
+	e1z[index] = edge1.z;
+	e2x[index] = edge2.x;
+	e2y[index] = edge2.y;
+	e2z[index] = edge2.z;
+}
+
+void TriangleSoA::attach(const TriangleArrays& arrays, int count)
+{
+	clear();
+	this->count = count;
+	attached = arrays;
+}
+
+TriangleArrays TriangleSoA::arrays() const
+{
+	if (attached.v0x)
+		return attached;
+
+	TriangleArrays arrays = { &v0x[0], &v0y[0], &v0z[0],
+		&e1x[0], &e1y[0], &e1z[0], &e2x[0], &e2y[0], &e2z[0] };
+	return arrays;
+}
+
+int TriangleSoA::size() const
+{
+	return count;
+}
+
+Vector TriangleSoA::normal(int index) const
+{
+	TriangleArrays triangles = arrays();
+	return cross(Vector(triangles.e1x[index], triangles.e1y[index], triangles.e1z[index]),
+		Vector(triangles.e2x[index], triangles.e2y[index], triangles.e2z[index]));
+}
+
+// Leaves hold at most BVH_MAX_LEAF_SIZE (8) triangles, so the AVX-512 level
+// uses the 8-wide kernels rather than leaving half of each register empty
+int TriangleSoA::intersect(const Ray& ray, int first, int count, float& tMax) const
+{
+	TriangleArrays arrays = this->arrays();
+
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2: return intersectAVX2(arrays, ray, first, count, tMax);
+	case SIMD_SSE4: return intersectSSE4(arrays, ray, first, count, tMax);
+#endif
+	default: return intersectScalar(arrays, ray, first, count, tMax);
+	}
+}
+
+bool TriangleSoA::occluded(const Ray& ray, int first, int count) const
+{
+	TriangleArrays arrays = this->arrays();
+
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2: return occludedAVX2(arrays, ray, first, count);
+	case SIMD_SSE4: return occludedSSE4(arrays, ray, first, count);
+#endif
+	default: return occludedScalar(arrays, ray, first, count);
+	}
+}
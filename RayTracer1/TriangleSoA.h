@@ -0,0 +1,88 @@
+#ifndef TRIANGLESOA_H
+#define TRIANGLESOA_H
+
+#include <vector>
+#include "Vector3.h"
+#include "Ray.h"
+
+// Widest kernel reads this many triangles at once; 16 keeps the padding
+// in step with SphereSoA so a 16-lane kernel can be added later
+#define TRIANGLE_SOA_WIDTH 16
+
+// Pointers to the nine arrays of a TriangleSoA, each holding size() +
+// TRIANGLE_SOA_WIDTH entries
+struct TriangleArrays
+{
+	const float* v0x;
+	const float* v0y;
+	const float* v0z;
+
+	// Edges v1 - v0 and v2 - v0
+	const float* e1x;
+	const float* e1y;
+	const float* e1z;
+	const float* e2x;
+	const float* e2y;
+	const float* e2z;
+};
+
+// Triangles stored structure-of-arrays as a vertex and two edges, which is
+// what the Möller-Trumbore test reads, so one ray is tested against 4 or 8
+// triangles per instruction. The arrays end in TRIANGLE_SOA_WIDTH padding
+// entries with zero edges, which never hit.
+class TriangleSoA
+{
+protected:
+
+	std::vector<float> v0x;
+	std::vector<float> v0y;
+	std::vector<float> v0z;
+	std::vector<float> e1x;
+	std::vector<float> e1y;
+	std::vector<float> e1z;
+	std::vector<float> e2x;
+	std::vector<float> e2y;
+	std::vector<float> e2z;
+
+	int count;
+
+	// Arrays owned by someone else, see attach(); v0x is NULL while the
+	// vectors above are in use
+	TriangleArrays attached;
+
+public:
+
+	TriangleSoA();
+
+	void clear();
+
+	void reserve(int capacity);
+
+	void add(const Point& a, const Point& b, const Point& c);
+
+	// Replaces triangle index of the ones added, not of attached arrays
+	void set(int index, const Point& a, const Point& b, const Point& c);
+
+	// Uses count triangles from existing arrays, e.g. a mapped scene cache,
+	// in place of copying them. The arrays must include the padding
+	// entries and outlive this object or the next clear().
+	void attach(const TriangleArrays& arrays, int count);
+
+	TriangleArrays arrays() const;
+
+	int size() const;
+
+	// Unnormalised geometric normal, cross(e1, e2)
+	Vector normal(int index) const;
+
+	// Nearest hit with t in (RAY_T_MIN, tMax) among the triangles
+	// [first, first + count). Returns the triangle's index and shrinks tMax,
+	// or -1 when none of them is hit.
+	int intersect(const Ray& ray, int first, int count, float& tMax) const;
+
+	// True if any of the triangles [first, first + count) is hit with t in
+	// (RAY_T_MIN, ray.tMax)
+	bool occluded(const Ray& ray, int first, int count) const;
+};
+
+#endif // TRIANGLESOA_H
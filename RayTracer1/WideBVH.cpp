@@ -0,0 +1,506 @@
+#include "WideBVH.h"
+#include "BVH.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// All kernels compute the slab test of AABB::intersect, taking the near
+// and far plane of each axis from the rows the ray's direction selects
+// instead of ordering both distances, so they agree with it exactly.
+
+namespace
+{
+	template <int Width>
+	unsigned intersectChildrenScalar(const WideBVHNode<Width>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		unsigned hit = 0;
+		for (int i = 0; i < Width; i++)
+		{
+			float tEnter = 0.0f;
+			float tExit = tMax;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float t0 = (node.bounds[ray.nearRow[axis]][i] - ray.origin[axis]) * ray.invDirection[axis];
+				float t1 = (node.bounds[ray.farRow[axis]][i] - ray.origin[axis]) * ray.invDirection[axis];
+				tEnter = std::max(tEnter, t0);
+				tExit = std::min(tExit, t1);
+			}
+
+			tNear[i] = tEnter;
+			if (tEnter <= tExit)
+				hit |= 1u << i;
+		}
+		return hit;
+	}
+
+	// Corner q of a compressed box on one axis. The build rounds against
+	// exactly this expression, so the kernels must not fuse it into an FMA.
+	inline float decode(uint8_t q, float origin, float scale)
+	{
+		return (float)q * scale + origin;
+	}
+
+	// Quantizes the box [min, max] of one child along one axis, rounding
+	// outwards until the decoded corners enclose it
+	void quantize(float min, float max, float origin, float scale, uint8_t& qMin, uint8_t& qMax)
+	{
+		int low = 0;
+		int high = 0;
+		if (scale > 0.0f)
+		{
+			low = std::max(0, std::min(255, (int)std::floor((min - origin) / scale)));
+			high = std::max(0, std::min(255, (int)std::ceil((max - origin) / scale)));
+		}
+		while (low > 0 && decode((uint8_t)low, origin, scale) > min)
+			low--;
+		while (high < 255 && decode((uint8_t)high, origin, scale) < max)
+			high++;
+		qMin = (uint8_t)low;
+		qMax = (uint8_t)high;
+	}
+
+	template <int Width>
+	unsigned intersectCompressedScalar(const CompressedBVHNode<Width>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		unsigned hit = 0;
+		for (int i = 0; i < node.childCount; i++)
+		{
+			float tEnter = 0.0f;
+			float tExit = tMax;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float near = decode(node.bounds[ray.nearRow[axis]][i], node.origin[axis], node.scale[axis]);
+				float far = decode(node.bounds[ray.farRow[axis]][i], node.origin[axis], node.scale[axis]);
+				tEnter = std::max(tEnter, (near - ray.origin[axis]) * ray.invDirection[axis]);
+				tExit = std::min(tExit, (far - ray.origin[axis]) * ray.invDirection[axis]);
+			}
+
+			tNear[i] = tEnter;
+			if (tEnter <= tExit)
+				hit |= 1u << i;
+		}
+		return hit;
+	}
+
+#ifdef SIMD_X86
+
+	// Four children starting at column bounds of rows width floats long
+	SIMD_TARGET("sse4.1")
+	inline unsigned intersectFourSSE4(const float* bounds, int width, const WideRay& ray, float tMax, float* tNear)
+	{
+		__m128 tEnter = _mm_setzero_ps();
+		__m128 tExit = _mm_set1_ps(tMax);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 origin = _mm_set1_ps(ray.origin[axis]);
+			__m128 invDirection = _mm_set1_ps(ray.invDirection[axis]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + ray.nearRow[axis] * width), origin), invDirection);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + ray.farRow[axis] * width), origin), invDirection);
+			tEnter = _mm_max_ps(tEnter, t0);
+			tExit = _mm_min_ps(tExit, t1);
+		}
+
+		_mm_storeu_ps(tNear, tEnter);
+		return (unsigned)_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit));
+	}
+
+	SIMD_TARGET("sse4.1")
+	unsigned intersectChildren4SSE4(const WideBVHNode<4>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		return intersectFourSSE4(node.bounds[0], 4, ray, tMax, tNear);
+	}
+
+	SIMD_TARGET("sse4.1")
+	unsigned intersectChildren8SSE4(const WideBVHNode<8>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		return intersectFourSSE4(node.bounds[0], 8, ray, tMax, tNear)
+			| intersectFourSSE4(node.bounds[0] + 4, 8, ray, tMax, tNear + 4) << 4;
+	}
+
+	SIMD_TARGET("avx2")
+	unsigned intersectChildren8AVX2(const WideBVHNode<8>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		const float* bounds = node.bounds[0];
+		__m256 tEnter = _mm256_setzero_ps();
+		__m256 tExit = _mm256_set1_ps(tMax);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+			__m256 invDirection = _mm256_set1_ps(ray.invDirection[axis]);
+			__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + ray.nearRow[axis] * 8), origin), invDirection);
+			__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + ray.farRow[axis] * 8), origin), invDirection);
+			tEnter = _mm256_max_ps(tEnter, t0);
+			tExit = _mm256_min_ps(tExit, t1);
+		}
+
+		_mm256_storeu_ps(tNear, tEnter);
+		return (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ));
+	}
+
+	// Four compressed children starting at column rows of rows width bytes long
+	SIMD_TARGET("sse4.1")
+	inline unsigned intersectCompressedFourSSE4(const float* gridOrigin, const float* gridScale,
+		const uint8_t* rows, int width, const WideRay& ray, float tMax, float* tNear)
+	{
+		__m128 tEnter = _mm_setzero_ps();
+		__m128 tExit = _mm_set1_ps(tMax);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int nearBytes, farBytes;
+			std::memcpy(&nearBytes, rows + ray.nearRow[axis] * width, 4);
+			std::memcpy(&farBytes, rows + ray.farRow[axis] * width, 4);
+
+			__m128 scale = _mm_set1_ps(gridScale[axis]);
+			__m128 offset = _mm_set1_ps(gridOrigin[axis]);
+			__m128 near = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(nearBytes))), scale), offset);
+			__m128 far = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(farBytes))), scale), offset);
+
+			__m128 origin = _mm_set1_ps(ray.origin[axis]);
+			__m128 invDirection = _mm_set1_ps(ray.invDirection[axis]);
+			tEnter = _mm_max_ps(tEnter, _mm_mul_ps(_mm_sub_ps(near, origin), invDirection));
+			tExit = _mm_min_ps(tExit, _mm_mul_ps(_mm_sub_ps(far, origin), invDirection));
+		}
+
+		_mm_storeu_ps(tNear, tEnter);
+		return (unsigned)_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit));
+	}
+
+	SIMD_TARGET("sse4.1")
+	unsigned intersectCompressed4SSE4(const CompressedBVHNode<4>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		unsigned hit = intersectCompressedFourSSE4(node.origin, node.scale, node.bounds[0], 4, ray, tMax, tNear);
+		return hit & ((1u << node.childCount) - 1);
+	}
+
+	SIMD_TARGET("sse4.1")
+	unsigned intersectCompressed8SSE4(const CompressedBVHNode<8>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		unsigned hit = intersectCompressedFourSSE4(node.origin, node.scale, node.bounds[0], 8, ray, tMax, tNear)
+			| intersectCompressedFourSSE4(node.origin, node.scale, node.bounds[0] + 4, 8, ray, tMax, tNear + 4) << 4;
+		return hit & ((1u << node.childCount) - 1);
+	}
+
+	// Plain AVX2 without FMA, see decode()
+	SIMD_TARGET("avx2")
+	unsigned intersectCompressed8AVX2(const CompressedBVHNode<8>& node, const WideRay& ray, float tMax, float* tNear)
+	{
+		__m256 tEnter = _mm256_setzero_ps();
+		__m256 tExit = _mm256_set1_ps(tMax);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128i nearBytes = _mm_loadl_epi64((const __m128i*)node.bounds[ray.nearRow[axis]]);
+			__m128i farBytes = _mm_loadl_epi64((const __m128i*)node.bounds[ray.farRow[axis]]);
+
+			__m256 scale = _mm256_set1_ps(node.scale[axis]);
+			__m256 offset = _mm256_set1_ps(node.origin[axis]);
+			__m256 near = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(nearBytes)), scale), offset);
+			__m256 far = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(farBytes)), scale), offset);
+
+			__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+			__m256 invDirection = _mm256_set1_ps(ray.invDirection[axis]);
+			tEnter = _mm256_max_ps(tEnter, _mm256_mul_ps(_mm256_sub_ps(near, origin), invDirection));
+			tExit = _mm256_min_ps(tExit, _mm256_mul_ps(_mm256_sub_ps(far, origin), invDirection));
+		}
+
+		_mm256_storeu_ps(tNear, tEnter);
+		unsigned hit = (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ));
+		return hit & ((1u << node.childCount) - 1);
+	}
+
+#endif // SIMD_X86
+}
+
+WideRay::WideRay(const Ray& ray)
+{
+	Vector inverse = safeInverse(ray.direction);
+	origin[0] = ray.origin.x;
+	origin[1] = ray.origin.y;
+	origin[2] = ray.origin.z;
+	invDirection[0] = inverse.x;
+	invDirection[1] = inverse.y;
+	invDirection[2] = inverse.z;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		bool negative = invDirection[axis] < 0.0f;
+		nearRow[axis] = 2 * axis + (negative ? 1 : 0);
+		farRow[axis] = 2 * axis + (negative ? 0 : 1);
+	}
+}
+
+template <>
+WideBVHNode<4>::Kernel WideBVHNode<4>::kernel()
+{
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2:
+	case SIMD_SSE4: return intersectChildren4SSE4;
+#endif
+	default: return intersectChildrenScalar<4>;
+	}
+}
+
+template <>
+WideBVHNode<8>::Kernel WideBVHNode<8>::kernel()
+{
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2: return intersectChildren8AVX2;
+	case SIMD_SSE4: return intersectChildren8SSE4;
+#endif
+	default: return intersectChildrenScalar<8>;
+	}
+}
+
+template <>
+CompressedBVHNode<4>::Kernel CompressedBVHNode<4>::kernel()
+{
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2:
+	case SIMD_SSE4: return intersectCompressed4SSE4;
+#endif
+	default: return intersectCompressedScalar<4>;
+	}
+}
+
+template <>
+CompressedBVHNode<8>::Kernel CompressedBVHNode<8>::kernel()
+{
+	switch (simdLevel())
+	{
+#ifdef SIMD_X86
+	case SIMD_AVX512:
+	case SIMD_AVX2: return intersectCompressed8AVX2;
+	case SIMD_SSE4: return intersectCompressed8SSE4;
+#endif
+	default: return intersectCompressedScalar<8>;
+	}
+}
+
+template <int Width>
+void WideBVH<Width>::collapse(const BVHNode* binary, int binaryIndex, int nodeIndex)
+{
+	int children[Width];
+	int childCount = 0;
+	if (binary[binaryIndex].isLeaf())
+	{
+		// Only for a root that is a leaf
+		children[childCount++] = binaryIndex;
+	}
+	else
+	{
+		children[childCount++] = binaryIndex + 1;
+		children[childCount++] = binary[binaryIndex].offset;
+	}
+
+	// Open the largest inner child until the node is full; it is the one
+	// most rays would otherwise have to descend into
+	while (childCount < Width)
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (int i = 0; i < childCount; i++)
+		{
+			const BVHNode& child = binary[children[i]];
+			if (!child.isLeaf() && child.bounds.surfaceArea() > largestArea)
+			{
+				largest = i;
+				largestArea = child.bounds.surfaceArea();
+			}
+		}
+		if (largest < 0)
+			break;
+
+		int opened = children[largest];
+		children[largest] = opened + 1;
+		children[childCount++] = binary[opened].offset;
+	}
+
+	// The child nodes are allocated together, then filled depth first
+	int firstChild = (int)nodes.size();
+	for (int i = 0; i < childCount; i++)
+	{
+		if (!binary[children[i]].isLeaf())
+			nodes.push_back(WideBVHNode<Width>());
+	}
+
+	WideBVHNode<Width>& node = nodes[nodeIndex];
+	int nextChild = firstChild;
+	for (int i = 0; i < Width; i++)
+	{
+		if (i >= childCount)
+		{
+			const float infinity = std::numeric_limits<float>::infinity();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				node.bounds[2 * axis][i] = infinity;
+				node.bounds[2 * axis + 1][i] = -infinity;
+			}
+			node.child[i] = -1;
+			node.count[i] = 0;
+			continue;
+		}
+
+		const BVHNode& child = binary[children[i]];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.bounds[2 * axis][i] = component(child.bounds.min, axis);
+			node.bounds[2 * axis + 1][i] = component(child.bounds.max, axis);
+		}
+		if (child.isLeaf())
+		{
+			node.child[i] = child.offset;
+			node.count[i] = child.count;
+		}
+		else
+		{
+			node.child[i] = nextChild++;
+			node.count[i] = 0;
+		}
+	}
+
+	nextChild = firstChild;
+	for (int i = 0; i < childCount; i++)
+	{
+		if (!binary[children[i]].isLeaf())
+			collapse(binary, children[i], nextChild++);
+	}
+}
+
+template <int Width>
+void WideBVH<Width>::build(const BVHNode* binary, int binaryCount)
+{
+	nodes.clear();
+	if (binaryCount == 0)
+		return;
+
+	// A full node takes the place of Width - 1 of the binary inner nodes
+	nodes.reserve(binaryCount / 2 / (Width - 1) + 1);
+	nodes.push_back(WideBVHNode<Width>());
+	collapse(binary, 0, 0);
+}
+
+template <int Width>
+void WideBVH<Width>::refit(const AABB* primBounds, const int* indices)
+{
+	// Child nodes come after their parents, so sweeping backwards refits
+	// them first
+	for (int i = (int)nodes.size() - 1; i >= 0; i--)
+	{
+		WideBVHNode<Width>& node = nodes[i];
+		for (int j = 0; j < Width && node.child[j] >= 0; j++)
+		{
+			AABB bounds;
+			if (node.count[j] > 0)
+			{
+				for (int k = node.child[j]; k < node.child[j] + node.count[j]; k++)
+					bounds.extend(primBounds[indices[k]]);
+				bounds = bounds.padded(RAY_T_MIN);
+			}
+			else
+			{
+				// Already padded
+				const WideBVHNode<Width>& child = nodes[node.child[j]];
+				for (int k = 0; k < Width && child.child[k] >= 0; k++)
+				{
+					bounds.extend(AABB(Point(child.bounds[0][k], child.bounds[2][k], child.bounds[4][k]),
+						Point(child.bounds[1][k], child.bounds[3][k], child.bounds[5][k])));
+				}
+			}
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				node.bounds[2 * axis][j] = component(bounds.min, axis);
+				node.bounds[2 * axis + 1][j] = component(bounds.max, axis);
+			}
+		}
+	}
+}
+
+template <int Width>
+void WideBVH<Width>::clear()
+{
+	NodeVector().swap(nodes);
+}
+
+template <int Width>
+void CompressedBVH<Width>::build(const WideBVH<Width>& wide)
+{
+	static_assert(BVH_MAX_LEAF_SIZE <= 255, "leaf sizes are stored in a byte");
+
+	nodes.clear();
+	nodes.resize(wide.nodeCount());
+	const WideBVHNode<Width>* source = wide.getNodes();
+	for (int i = 0; i < wide.nodeCount(); i++)
+	{
+		const WideBVHNode<Width>& from = source[i];
+		CompressedBVHNode<Width>& to = nodes[i];
+
+		// Used slots come first, unused ones have no child
+		int childCount = 0;
+		while (childCount < Width && from.child[childCount] >= 0)
+			childCount++;
+		to.childCount = (uint8_t)childCount;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float min = from.bounds[2 * axis][0];
+			float max = from.bounds[2 * axis + 1][0];
+			for (int j = 1; j < childCount; j++)
+			{
+				min = std::min(min, from.bounds[2 * axis][j]);
+				max = std::max(max, from.bounds[2 * axis + 1][j]);
+			}
+
+			// The top of the grid has to reach the top of the node
+			float scale = (max - min) / 255.0f;
+			while (decode(255, min, scale) < max)
+				scale = std::nextafter(scale, std::numeric_limits<float>::infinity());
+			to.origin[axis] = min;
+			to.scale[axis] = scale;
+
+			for (int j = 0; j < Width; j++)
+			{
+				if (j < childCount)
+				{
+					quantize(from.bounds[2 * axis][j], from.bounds[2 * axis + 1][j], min, scale,
+						to.bounds[2 * axis][j], to.bounds[2 * axis + 1][j]);
+				}
+				else
+				{
+					to.bounds[2 * axis][j] = 0;
+					to.bounds[2 * axis + 1][j] = 0;
+				}
+			}
+		}
+
+		for (int j = 0; j < Width; j++)
+		{
+			to.child[j] = from.child[j];
+			to.count[j] = (uint8_t)from.count[j];
+		}
+	}
+}
+
+template <int Width>
+void CompressedBVH<Width>::clear()
+{
+	NodeVector().swap(nodes);
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+template class CompressedBVH<4>;
+template class CompressedBVH<8>;
@@ -0,0 +1,311 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "AABB.h"
+#include "AlignedAllocator.h"
+#include "Ray.h"
+#include "Simd.h"
+
+struct BVHNode;
+
+// Children per node of the widest hierarchy
+#define WIDE_BVH_MAX_WIDTH 8
+
+// Pending children the traversal stack can hold, WIDE_BVH_MAX_WIDTH - 1
+// for each level of a 64 deep tree
+#define WIDE_BVH_STACK_SIZE 512
+
+// A ray as the child box tests read it
+struct WideRay
+{
+	float origin[3];
+
+	float invDirection[3];
+
+	// Rows of the node bounds holding the planes the ray enters and leaves
+	// each slab through, which depends on the sign of its direction
+	int nearRow[3];
+	int farRow[3];
+
+	explicit WideRay(const Ray& ray);
+};
+
+// Node holding the boxes of up to Width children structure-of-arrays, so
+// one ray is tested against all of them at once. A 4-wide node fills two
+// cache lines, an 8-wide one four.
+template <int Width>
+struct alignas(64) WideBVHNode
+{
+	enum { width = Width };
+
+	// Rows minX, maxX, minY, maxY, minZ, maxZ. Unused slots hold an
+	// inverted box that no ray enters.
+	float bounds[6][Width];
+
+	// Leaf children: index of the first primitive in BVH::indices.
+	// Inner children: index of the child node.
+	int child[Width];
+
+	// Primitives of leaf children, 0 for inner children
+	int count[Width];
+
+	// Tests the ray against all child boxes. Writes the entry distances to
+	// tNear and returns the mask of the children entered before tMax.
+	typedef unsigned (*Kernel)(const WideBVHNode& node, const WideRay& ray, float tMax, float* tNear);
+
+	// Kernel of the current SIMD level, looked up once per traversal
+	static Kernel kernel();
+};
+
+// WideBVHNode with every child box stored as 8-bit coordinates on a grid
+// of 255 steps spanning the node's own box, rounded outwards. An 8-wide
+// node takes two cache lines instead of four.
+template <int Width>
+struct alignas(16) CompressedBVHNode
+{
+	enum { width = Width };
+
+	// Child box corners are origin + q * scale on each axis
+	float origin[3];
+	float scale[3];
+
+	// Rows as in WideBVHNode
+	uint8_t bounds[6][Width];
+
+	int child[Width];
+
+	uint8_t count[Width];
+
+	// Slots in use, the first childCount of them
+	uint8_t childCount;
+
+	typedef unsigned (*Kernel)(const CompressedBVHNode& node, const WideRay& ray, float tMax, float* tNear);
+
+	static Kernel kernel();
+};
+
+template <>
+WideBVHNode<4>::Kernel WideBVHNode<4>::kernel();
+
+template <>
+WideBVHNode<8>::Kernel WideBVHNode<8>::kernel();
+
+template <>
+CompressedBVHNode<4>::Kernel CompressedBVHNode<4>::kernel();
+
+template <>
+CompressedBVHNode<8>::Kernel CompressedBVHNode<8>::kernel();
+
+// Closest hit in a tree of wide nodes, with the same contract as
+// BVH::intersect. The children of a node are visited front to back.
+template <typename Node, typename Leaf>
+bool intersectWide(const Node* nodes, const Ray& ray, const float& tMax, Leaf leaf)
+{
+	struct StackEntry
+	{
+		// As in the nodes: a node, or the primitives of a leaf
+		int child;
+		int count;
+
+		float tNear;
+	};
+
+	WideRay wideRay(ray);
+	typename Node::Kernel kernel = Node::kernel();
+	StackEntry stack[WIDE_BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	StackEntry current;
+	current.child = 0;
+	current.count = 0;
+	current.tNear = 0.0f;
+
+	bool hit = false;
+	while (true)
+	{
+		if (current.count > 0)
+		{
+			if (leaf(current.child, current.count))
+				hit = true;
+		}
+		else
+		{
+			const Node& node = nodes[current.child];
+			float tNear[Node::width];
+			unsigned mask = kernel(node, wideRay, tMax, tNear);
+
+			if (mask != 0)
+			{
+				// Sorted far to near; the nearest child is entered right away
+				// and the others are pushed so the nearer ones pop first
+				int order[Node::width];
+				int hits = 0;
+				for (; mask != 0; mask &= mask - 1)
+				{
+					int lane = lowestBit(mask);
+					int i = hits++;
+					while (i > 0 && tNear[order[i - 1]] < tNear[lane])
+					{
+						order[i] = order[i - 1];
+						i--;
+					}
+					order[i] = lane;
+				}
+
+				for (int i = 0; i < hits - 1; i++)
+				{
+					stack[stackSize].child = node.child[order[i]];
+					stack[stackSize].count = node.count[order[i]];
+					stack[stackSize].tNear = tNear[order[i]];
+					stackSize++;
+				}
+				current.child = node.child[order[hits - 1]];
+				current.count = node.count[order[hits - 1]];
+				continue;
+			}
+		}
+
+		// Children may have fallen behind a hit found since they were pushed
+		do
+		{
+			if (stackSize == 0)
+				return hit;
+			current = stack[--stackSize];
+		} while (current.tNear > tMax);
+	}
+}
+
+// Any hit in a tree of wide nodes, with the same contract as BVH::occluded
+template <typename Node, typename Leaf>
+bool occludedWide(const Node* nodes, const Ray& ray, Leaf leaf)
+{
+	WideRay wideRay(ray);
+	typename Node::Kernel kernel = Node::kernel();
+	int stack[WIDE_BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		float tNear[Node::width];
+		unsigned mask = kernel(node, wideRay, ray.tMax, tNear);
+
+		// Leaves are tested right away, any of them may end the search
+		for (; mask != 0; mask &= mask - 1)
+		{
+			int lane = lowestBit(mask);
+			if (node.count[lane] == 0)
+				stack[stackSize++] = node.child[lane];
+			else if (leaf(node.child[lane], node.count[lane]))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// Binary BVH collapsed into Width-ary nodes. The leaves keep their ranges
+// of BVH::indices, so the same leaf callbacks work on either tree.
+template <int Width>
+class WideBVH
+{
+protected:
+
+	typedef std::vector<WideBVHNode<Width>, AlignedAllocator<WideBVHNode<Width>, 64>> NodeVector;
+
+	NodeVector nodes;
+
+	void collapse(const BVHNode* binary, int binaryIndex, int nodeIndex);
+
+public:
+
+	// Every inner binary node is replaced by up to Width of its descendants,
+	// opening the one with the largest surface area first
+	void build(const BVHNode* binary, int binaryCount);
+
+	// Recomputes the child boxes from new primitive bounds, indexed through
+	// BVH::indices, and keeps the tree, like BVH::refit
+	void refit(const AABB* primBounds, const int* indices);
+
+	// Also releases the memory
+	void clear();
+
+	bool isEmpty() const
+	{
+		return nodes.empty();
+	}
+
+	const WideBVHNode<Width>* getNodes() const
+	{
+		return nodes.data();
+	}
+
+	int nodeCount() const
+	{
+		return (int)nodes.size();
+	}
+
+	size_t memoryUsage() const
+	{
+		return nodes.capacity() * sizeof(WideBVHNode<Width>);
+	}
+
+	template <typename Leaf>
+	bool intersect(const Ray& ray, const float& tMax, Leaf leaf) const
+	{
+		return !nodes.empty() && intersectWide(nodes.data(), ray, tMax, leaf);
+	}
+
+	template <typename Leaf>
+	bool occluded(const Ray& ray, Leaf leaf) const
+	{
+		return !nodes.empty() && occludedWide(nodes.data(), ray, leaf);
+	}
+};
+
+// WideBVH with its nodes quantized to CompressedBVHNode. The boxes only
+// grow, so it finds the same hits in exchange for visiting a few more nodes.
+template <int Width>
+class CompressedBVH
+{
+protected:
+
+	typedef std::vector<CompressedBVHNode<Width>, AlignedAllocator<CompressedBVHNode<Width>, 64>> NodeVector;
+
+	NodeVector nodes;
+
+public:
+
+	void build(const WideBVH<Width>& wide);
+
+	// Also releases the memory
+	void clear();
+
+	bool isEmpty() const
+	{
+		return nodes.empty();
+	}
+
+	size_t memoryUsage() const
+	{
+		return nodes.capacity() * sizeof(CompressedBVHNode<Width>);
+	}
+
+	template <typename Leaf>
+	bool intersect(const Ray& ray, const float& tMax, Leaf leaf) const
+	{
+		return !nodes.empty() && intersectWide(nodes.data(), ray, tMax, leaf);
+	}
+
+	template <typename Leaf>
+	bool occluded(const Ray& ray, Leaf leaf) const
+	{
+		return !nodes.empty() && occludedWide(nodes.data(), ray, leaf);
+	}
+};
+
+#endif // WIDEBVH_H
@@ -0,0 +1,292 @@
+#pragma once
+#include <cmath>
+#include "Vector3.h"
+#include "Math/Vector2.h"
+#include "MatrixSimd.h"
+
+/// 3x3 float matrix, stored row by row and applied to column vectors, so
+/// a * b applies b first. It is a linear map of 3D vectors and, through
+/// translation() and transform(Vector2), an affine map of 2D points taken
+/// as (x, y, 1). Rows are padded to 16 aligned bytes for SIMD loads.
+class alignas(16) Matrix33
+{
+public:
+
+	/// m[row][3] is padding and always 0
+	float m[3][4];
+
+	/// Construct a new identity matrix
+	Matrix33()
+		: Matrix33(1.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 1.0f)
+	{
+	}
+
+	/// Construct a new matrix from explicit values, row by row
+	Matrix33(float m00, float m01, float m02,
+		float m10, float m11, float m12,
+		float m20, float m21, float m22)
+		: m{ { m00, m01, m02, 0.0f },
+			{ m10, m11, m12, 0.0f },
+			{ m20, m21, m22, 0.0f } }
+	{
+	}
+
+	/// Construct a new matrix from its columns, e.g. an orthonormal basis
+	static Matrix33 fromAxes(const Vector& x, const Vector& y, const Vector& z)
+	{
+		return Matrix33(x.x, y.x, z.x,
+			x.y, y.y, z.y,
+			x.z, y.z, z.z);
+	}
+
+	/// Creates an identity matrix
+	static Matrix33 identity()
+	{
+		return Matrix33();
+	}
+
+	/// Creates a translation matrix for 2D points
+	static Matrix33 translation(const Vector2& offset)
+	{
+		return Matrix33(1.0f, 0.0f, offset.x,
+			0.0f, 1.0f, offset.y,
+			0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a scale matrix
+	static Matrix33 scale(const Vector& factors)
+	{
+		return Matrix33(factors.x, 0.0f, 0.0f,
+			0.0f, factors.y, 0.0f,
+			0.0f, 0.0f, factors.z);
+	}
+
+	/// Creates a uniform scale matrix
+	static Matrix33 scale(float factor)
+	{
+		return scale(Vector(factor));
+	}
+
+	/// Creates a rotation matrix around an arbitrary axis (angle in radians),
+	/// counter-clockwise when looking down the axis
+	static Matrix33 rotation(const Vector& axis, float angle)
+	{
+		Vector a = axis.normalized();
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		float t = 1.0f - c;
+		return Matrix33(t * a.x * a.x + c, t * a.x * a.y - s * a.z, t * a.x * a.z + s * a.y,
+			t * a.x * a.y + s * a.z, t * a.y * a.y + c, t * a.y * a.z - s * a.x,
+			t * a.x * a.z - s * a.y, t * a.y * a.z + s * a.x, t * a.z * a.z + c);
+	}
+
+	/// Creates a rotation matrix around the x axis (angle in radians)
+	static Matrix33 rotationX(float angle)
+	{
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return Matrix33(1.0f, 0.0f, 0.0f,
+			0.0f, c, -s,
+			0.0f, s, c);
+	}
+
+	/// Creates a rotation matrix around the y axis (angle in radians)
+	static Matrix33 rotationY(float angle)
+	{
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return Matrix33(c, 0.0f, s,
+			0.0f, 1.0f, 0.0f,
+			-s, 0.0f, c);
+	}
+
+	/// Creates a rotation matrix around the z axis (angle in radians)
+	static Matrix33 rotationZ(float angle)
+	{
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return Matrix33(c, -s, 0.0f,
+			s, c, 0.0f,
+			0.0f, 0.0f, 1.0f);
+	}
+
+	/// Matrix addition
+	Matrix33 operator +(const Matrix33& other) const
+	{
+		Matrix33 result;
+#ifdef MATRIX_SSE
+		for (int row = 0; row < 3; row++)
+			_mm_store_ps(result.m[row], _mm_add_ps(_mm_load_ps(m[row]), _mm_load_ps(other.m[row])));
+#else
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+				result.m[row][column] = m[row][column] + other.m[row][column];
+		}
+#endif
+		return result;
+	}
+
+	/// Matrix subtraction
+	Matrix33 operator -(const Matrix33& other) const
+	{
+		Matrix33 result;
+#ifdef MATRIX_SSE
+		for (int row = 0; row < 3; row++)
+			_mm_store_ps(result.m[row], _mm_sub_ps(_mm_load_ps(m[row]), _mm_load_ps(other.m[row])));
+#else
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+				result.m[row][column] = m[row][column] - other.m[row][column];
+		}
+#endif
+		return result;
+	}
+
+	/// Matrix multiplication
+	Matrix33 operator *(const Matrix33& other) const
+	{
+		Matrix33 result;
+#ifdef MATRIX_SSE
+		// Each result row is a combination of the rows of other
+		__m128 row0 = _mm_load_ps(other.m[0]);
+		__m128 row1 = _mm_load_ps(other.m[1]);
+		__m128 row2 = _mm_load_ps(other.m[2]);
+		for (int row = 0; row < 3; row++)
+		{
+			__m128 sum = _mm_mul_ps(_mm_set1_ps(m[row][0]), row0);
+			sum = multiplyAdd(_mm_set1_ps(m[row][1]), row1, sum);
+			sum = multiplyAdd(_mm_set1_ps(m[row][2]), row2, sum);
+			_mm_store_ps(result.m[row], sum);
+		}
+#else
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+			{
+				result.m[row][column] = m[row][0] * other.m[0][column]
+					+ m[row][1] * other.m[1][column]
+					+ m[row][2] * other.m[2][column];
+			}
+		}
+#endif
+		return result;
+	}
+
+	/// Get the determinant of this matrix
+	float determinant() const
+	{
+		return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+			- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+			+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	}
+
+	/// Returns the inverse of this matrix, which must not be singular
+	Matrix33 inverse() const
+	{
+		// The rows of the inverse are the cross products of the columns
+		// over the determinant
+		Vector x = getXAxis();
+		Vector y = getYAxis();
+		Vector z = getZAxis();
+		Vector r0 = cross(y, z);
+		Vector r1 = cross(z, x);
+		Vector r2 = cross(x, y);
+		float inv = 1.0f / dot(x, r0);
+		return Matrix33(r0.x * inv, r0.y * inv, r0.z * inv,
+			r1.x * inv, r1.y * inv, r1.z * inv,
+			r2.x * inv, r2.y * inv, r2.z * inv);
+	}
+
+	/// Returns this matrix with rows and columns swapped
+	Matrix33 transposed() const
+	{
+		return Matrix33(m[0][0], m[1][0], m[2][0],
+			m[0][1], m[1][1], m[2][1],
+			m[0][2], m[1][2], m[2][2]);
+	}
+
+	/// Transform the given vector by this matrix
+	Vector transform(const Vector& v) const
+	{
+		return Vector(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+			m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+			m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+	}
+
+	/// Transform the given 2D point, taken as (x, y, 1)
+	Vector2 transform(const Vector2& p) const
+	{
+		return Vector2(m[0][0] * p.x + m[0][1] * p.y + m[0][2],
+			m[1][0] * p.x + m[1][1] * p.y + m[1][2]);
+	}
+
+	/// Transforms count vectors at once, four per SIMD step; result may
+	/// be vectors itself
+	void transform(const Vector* vectors, Vector* result, int count) const
+	{
+		int i = 0;
+#ifdef MATRIX_SSE
+		__m128 c[3][3];
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+				c[row][column] = _mm_set1_ps(m[row][column]);
+		}
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x, y, z;
+			loadVectors4(vectors + i, x, y, z);
+			__m128 r[3];
+			for (int row = 0; row < 3; row++)
+			{
+				__m128 sum = _mm_mul_ps(c[row][0], x);
+				sum = multiplyAdd(c[row][1], y, sum);
+				r[row] = multiplyAdd(c[row][2], z, sum);
+			}
+			storeVectors4(result + i, r[0], r[1], r[2]);
+		}
+#endif
+		for (; i < count; i++)
+			result[i] = transform(vectors[i]);
+	}
+
+	/// Get the x axis, the first column
+	Vector getXAxis() const
+	{
+		return Vector(m[0][0], m[1][0], m[2][0]);
+	}
+
+	/// Get the y axis, the second column
+	Vector getYAxis() const
+	{
+		return Vector(m[0][1], m[1][1], m[2][1]);
+	}
+
+	/// Get the z axis, the third column
+	Vector getZAxis() const
+	{
+		return Vector(m[0][2], m[1][2], m[2][2]);
+	}
+
+	bool operator ==(const Matrix33& other) const
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+			{
+				if (m[row][column] != other.m[row][column])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool operator !=(const Matrix33& other) const
+	{
+		return !(*this == other);
+	}
+};
@@ -0,0 +1,432 @@
+#pragma once
+#include <cmath>
+#include "Vector3.h"
+#include "Matrix33.h"
+#include "MatrixSimd.h"
+
+/// 4x4 float matrix, stored row by row and applied to column vectors, so
+/// transform(p) is m * (p, 1) and a * b applies b first. Rows are 16-byte
+/// aligned for SIMD loads. Projections follow OpenGL: the camera looks down
+/// -z and clip space z runs from -1 at the near plane to 1 at the far one.
+class alignas(16) Matrix44
+{
+public:
+
+	float m[4][4];
+
+	/// Construct a new identity matrix
+	Matrix44()
+		: Matrix44(1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f)
+	{
+	}
+
+	/// Construct a new matrix from explicit values, row by row
+	Matrix44(float m00, float m01, float m02, float m03,
+		float m10, float m11, float m12, float m13,
+		float m20, float m21, float m22, float m23,
+		float m30, float m31, float m32, float m33)
+		: m{ { m00, m01, m02, m03 },
+			{ m10, m11, m12, m13 },
+			{ m20, m21, m22, m23 },
+			{ m30, m31, m32, m33 } }
+	{
+	}
+
+	/// Construct a new affine matrix from an orientation and a translation
+	Matrix44(const Matrix33& orientation, const Vector& translation)
+		: Matrix44(orientation.m[0][0], orientation.m[0][1], orientation.m[0][2], translation.x,
+			orientation.m[1][0], orientation.m[1][1], orientation.m[1][2], translation.y,
+			orientation.m[2][0], orientation.m[2][1], orientation.m[2][2], translation.z,
+			0.0f, 0.0f, 0.0f, 1.0f)
+	{
+	}
+
+	/// Creates an identity matrix
+	static Matrix44 identity()
+	{
+		return Matrix44();
+	}
+
+	/// Creates a translation matrix
+	static Matrix44 translation(const Vector& offset)
+	{
+		return Matrix44(1.0f, 0.0f, 0.0f, offset.x,
+			0.0f, 1.0f, 0.0f, offset.y,
+			0.0f, 0.0f, 1.0f, offset.z,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a scale matrix
+	static Matrix44 scale(const Vector& factors)
+	{
+		return Matrix44(factors.x, 0.0f, 0.0f, 0.0f,
+			0.0f, factors.y, 0.0f, 0.0f,
+			0.0f, 0.0f, factors.z, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a uniform scale matrix
+	static Matrix44 scale(float factor)
+	{
+		return scale(Vector(factor));
+	}
+
+	/// Creates a rotation matrix around an arbitrary axis (angle in radians),
+	/// counter-clockwise when looking down the axis
+	static Matrix44 rotation(const Vector& axis, float angle)
+	{
+		Vector a = axis.normalized();
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		float t = 1.0f - c;
+		return Matrix44(t * a.x * a.x + c, t * a.x * a.y - s * a.z, t * a.x * a.z + s * a.y, 0.0f,
+			t * a.x * a.y + s * a.z, t * a.y * a.y + c, t * a.y * a.z - s * a.x, 0.0f,
+			t * a.x * a.z - s * a.y, t * a.y * a.z + s * a.x, t * a.z * a.z + c, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a rotation matrix around the x axis (angle in radians)
+	static Matrix44 rotationX(float angle)
+	{
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return Matrix44(1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, c, -s, 0.0f,
+			0.0f, s, c, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a rotation matrix around the y axis (angle in radians)
+	static Matrix44 rotationY(float angle)
+	{
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return Matrix44(c, 0.0f, s, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			-s, 0.0f, c, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a rotation matrix around the z axis (angle in radians)
+	static Matrix44 rotationZ(float angle)
+	{
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return Matrix44(c, -s, 0.0f, 0.0f,
+			s, c, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates an orthographic projection matrix
+	static Matrix44 orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+	{
+		return Matrix44(2.0f / (right - left), 0.0f, 0.0f, -(right + left) / (right - left),
+			0.0f, 2.0f / (top - bottom), 0.0f, -(top + bottom) / (top - bottom),
+			0.0f, 0.0f, -2.0f / (zFar - zNear), -(zFar + zNear) / (zFar - zNear),
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Creates a frustum projection matrix, the bounds are those of the
+	/// near plane
+	static Matrix44 frustum(float left, float right, float bottom, float top, float zNear, float zFar)
+	{
+		return Matrix44(2.0f * zNear / (right - left), 0.0f, (right + left) / (right - left), 0.0f,
+			0.0f, 2.0f * zNear / (top - bottom), (top + bottom) / (top - bottom), 0.0f,
+			0.0f, 0.0f, -(zFar + zNear) / (zFar - zNear), -2.0f * zFar * zNear / (zFar - zNear),
+			0.0f, 0.0f, -1.0f, 0.0f);
+	}
+
+	/// Creates a perspective projection matrix from camera settings, fov
+	/// is the vertical field of view in radians
+	static Matrix44 perspective(float fov, float aspectRatio, float zNear, float zFar)
+	{
+		float top = zNear * std::tan(0.5f * fov);
+		float right = top * aspectRatio;
+		return frustum(-right, right, -top, top, zNear, zFar);
+	}
+
+	/// Creates a look at matrix, usually a view matrix: it moves eye to the
+	/// origin and turns target to -z and up towards +y
+	static Matrix44 lookAt(const Point& eye, const Point& target, const Vector& up)
+	{
+		Vector forward = (target - eye).normalized();
+		Vector right = cross(forward, up).normalized();
+		Vector trueUp = cross(right, forward);
+		return Matrix44(right.x, right.y, right.z, -dot(right, eye),
+			trueUp.x, trueUp.y, trueUp.z, -dot(trueUp, eye),
+			-forward.x, -forward.y, -forward.z, dot(forward, eye),
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	/// Matrix addition
+	Matrix44 operator +(const Matrix44& other) const
+	{
+		Matrix44 result;
+#ifdef MATRIX_SSE
+		for (int row = 0; row < 4; row++)
+			_mm_store_ps(result.m[row], _mm_add_ps(_mm_load_ps(m[row]), _mm_load_ps(other.m[row])));
+#else
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+				result.m[row][column] = m[row][column] + other.m[row][column];
+		}
+#endif
+		return result;
+	}
+
+	/// Matrix subtraction
+	Matrix44 operator -(const Matrix44& other) const
+	{
+		Matrix44 result;
+#ifdef MATRIX_SSE
+		for (int row = 0; row < 4; row++)
+			_mm_store_ps(result.m[row], _mm_sub_ps(_mm_load_ps(m[row]), _mm_load_ps(other.m[row])));
+#else
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+				result.m[row][column] = m[row][column] - other.m[row][column];
+		}
+#endif
+		return result;
+	}
+
+	/// Matrix multiplication
+	Matrix44 operator *(const Matrix44& other) const
+	{
+		Matrix44 result;
+#ifdef MATRIX_SSE
+		// Each result row is a combination of the rows of other
+		__m128 row0 = _mm_load_ps(other.m[0]);
+		__m128 row1 = _mm_load_ps(other.m[1]);
+		__m128 row2 = _mm_load_ps(other.m[2]);
+		__m128 row3 = _mm_load_ps(other.m[3]);
+		for (int row = 0; row < 4; row++)
+		{
+			__m128 sum = _mm_mul_ps(_mm_set1_ps(m[row][0]), row0);
+			sum = multiplyAdd(_mm_set1_ps(m[row][1]), row1, sum);
+			sum = multiplyAdd(_mm_set1_ps(m[row][2]), row2, sum);
+			sum = multiplyAdd(_mm_set1_ps(m[row][3]), row3, sum);
+			_mm_store_ps(result.m[row], sum);
+		}
+#else
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				result.m[row][column] = m[row][0] * other.m[0][column]
+					+ m[row][1] * other.m[1][column]
+					+ m[row][2] * other.m[2][column]
+					+ m[row][3] * other.m[3][column];
+			}
+		}
+#endif
+		return result;
+	}
+
+	/// Get the determinant of this matrix
+	float determinant() const
+	{
+		float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+		float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+		float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+		float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+		float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+		float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+		float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+		float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+		float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+		float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+		float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+		float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+		return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	}
+
+	/// Returns the inverse of this matrix, which must not be singular
+	Matrix44 inverse() const
+	{
+		// Laplace expansion by the 2x2 minors of the upper and lower rows
+		float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+		float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+		float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+		float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+		float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+		float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+		float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+		float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+		float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+		float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+		float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+		float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+		float inv = 1.0f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+		return Matrix44(
+			(m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * inv,
+			(-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * inv,
+			(m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * inv,
+			(-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * inv,
+
+			(-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * inv,
+			(m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * inv,
+			(-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * inv,
+			(m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * inv,
+
+			(m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * inv,
+			(-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * inv,
+			(m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * inv,
+			(-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * inv,
+
+			(-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * inv,
+			(m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * inv,
+			(-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * inv,
+			(m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * inv);
+	}
+
+	/// Returns this matrix with rows and columns swapped
+	Matrix44 transposed() const
+	{
+		return Matrix44(m[0][0], m[1][0], m[2][0], m[3][0],
+			m[0][1], m[1][1], m[2][1], m[3][1],
+			m[0][2], m[1][2], m[2][2], m[3][2],
+			m[0][3], m[1][3], m[2][3], m[3][3]);
+	}
+
+	/// Transform the given point by this matrix, which is taken to be affine
+	Point transform(const Point& p) const
+	{
+		return Point(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+			m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+			m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+	}
+
+	/// Transform the direction vector by this matrix, ignoring the translation
+	Vector transformDirection(const Vector& v) const
+	{
+		return Vector(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+			m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+			m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+	}
+
+	/// Transform the given point and divide by w, e.g. into clip space
+	Point project(const Point& p) const
+	{
+		float w = m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3];
+		return transform(p) / w;
+	}
+
+	/// Transforms count points at once, four per SIMD step, like
+	/// transform(); result may be points itself
+	void transform(const Point* points, Point* result, int count) const
+	{
+		transformBatch(points, result, count, true);
+	}
+
+	/// Transforms count directions at once, like transformDirection()
+	void transformDirections(const Vector* directions, Vector* result, int count) const
+	{
+		transformBatch(directions, result, count, false);
+	}
+
+	/// Retrieve translation part of the matrix
+	Vector getTranslation() const
+	{
+		return Vector(m[0][3], m[1][3], m[2][3]);
+	}
+
+	/// Set the translation of the matrix
+	void setTranslation(const Vector& translation)
+	{
+		m[0][3] = translation.x;
+		m[1][3] = translation.y;
+		m[2][3] = translation.z;
+	}
+
+	/// Get the x orientation axis, the first column
+	Vector getXAxis() const
+	{
+		return Vector(m[0][0], m[1][0], m[2][0]);
+	}
+
+	/// Get the y orientation axis, the second column
+	Vector getYAxis() const
+	{
+		return Vector(m[0][1], m[1][1], m[2][1]);
+	}
+
+	/// Get the z orientation axis, the third column
+	Vector getZAxis() const
+	{
+		return Vector(m[0][2], m[1][2], m[2][2]);
+	}
+
+	/// Sets the orientation of the matrix to the orthogonal basis vectors,
+	/// which become its first three columns
+	void setOrientation(const Vector& x, const Vector& y, const Vector& z)
+	{
+		m[0][0] = x.x; m[0][1] = y.x; m[0][2] = z.x;
+		m[1][0] = x.y; m[1][1] = y.y; m[1][2] = z.y;
+		m[2][0] = x.z; m[2][1] = y.z; m[2][2] = z.z;
+	}
+
+	/// The upper 3x3 part
+	Matrix33 getOrientation() const
+	{
+		return Matrix33(m[0][0], m[0][1], m[0][2],
+			m[1][0], m[1][1], m[1][2],
+			m[2][0], m[2][1], m[2][2]);
+	}
+
+	bool operator ==(const Matrix44& other) const
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				if (m[row][column] != other.m[row][column])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool operator !=(const Matrix44& other) const
+	{
+		return !(*this == other);
+	}
+
+private:
+
+	void transformBatch(const Vector* vectors, Vector* result, int count, bool translate) const
+	{
+		int i = 0;
+#ifdef MATRIX_SSE
+		__m128 c[3][4];
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 4; column++)
+				c[row][column] = _mm_set1_ps(column < 3 || translate ? m[row][column] : 0.0f);
+		}
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x, y, z;
+			loadVectors4(vectors + i, x, y, z);
+			__m128 r[3];
+			for (int row = 0; row < 3; row++)
+			{
+				__m128 sum = _mm_mul_ps(c[row][0], x);
+				sum = multiplyAdd(c[row][1], y, sum);
+				sum = multiplyAdd(c[row][2], z, sum);
+				r[row] = translate ? _mm_add_ps(sum, c[row][3]) : sum;
+			}
+			storeVectors4(result + i, r[0], r[1], r[2]);
+		}
+#endif
+		for (; i < count; i++)
+			result[i] = translate ? transform(vectors[i]) : transformDirection(vectors[i]);
+	}
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include "Vector3.h"
+
+/// SSE2 is part of every x86-64 target, so the matrices use it without
+/// architecture flags; other targets get the plain loops
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATRIX_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef MATRIX_SSE
+
+/// Loads the 12 floats of four consecutive vectors and transposes them
+/// into one register per component
+inline void loadVectors4(const Vector* vectors, __m128& x, __m128& y, __m128& z)
+{
+	const float* data = &vectors[0].x;
+	__m128 a = _mm_loadu_ps(data);     // x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps(data + 4); // y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps(data + 8); // z2 x3 y3 z3
+
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+		_mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+		_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/// Inverse of loadVectors4
+inline void storeVectors4(Vector* vectors, __m128 x, __m128 y, __m128 z)
+{
+	__m128 xy = _mm_unpacklo_ps(x, y); // x0 y0 x1 y1
+	__m128 a = _mm_shuffle_ps(xy, _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+	__m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)),
+		_mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)),
+		_mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+	float* data = &vectors[0].x;
+	_mm_storeu_ps(data, a);
+	_mm_storeu_ps(data + 4, b);
+	_mm_storeu_ps(data + 8, c);
+}
+
+/// a * b + c, in that order so the result matches the scalar code
+inline __m128 multiplyAdd(__m128 a, __m128 b, __m128 c)
+{
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+#endif // MATRIX_SSE
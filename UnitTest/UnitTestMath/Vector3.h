@@ -1,34 +1,32 @@
 #pragma once
 #include <cmath>
+#include <type_traits>
 #define PI 3.1415926f
+#ifndef NULL
 #define NULL 0
+#endif
 
-inline float sqr(float n)
+constexpr float sqr(float n)
 {
 	return n * n;
 }
 
+/// Plain 3 float vector: no vtable and trivially copyable, so it stays in
+/// registers and arrays of it can be copied with memcpy
 class Vector
 {
 public:
 
 	float x, y, z;
 
-	Vector()
+	constexpr Vector()
 		: x(0.0f),
 		y(0.0f),
 		z(0.0f)
 	{
 	}
 
-	Vector(const Vector& v)
-		: x(v.x),
-		y(v.y),
-		z(v.z)
-	{
-	}
-
-	Vector(float x, float y, float z)
+	constexpr Vector(float x, float y, float z)
 		: x(x),
 		y(y),
 		z(z)
@@ -36,33 +34,29 @@ public:
 	}
 
 
-	Vector(float f)
+	constexpr Vector(float f)
 		: x(f),
 		y(f),
 		z(f)
 	{
 	}
 
-	virtual ~Vector()
-	{
-	}
-
-	float length2()
+	constexpr float length2() const
 	{
 		return sqr(x) + sqr(y) + sqr(z);
 	}
 
-	float length()
+	float length() const
 	{
 		return std::sqrt(length2());
 	}
 
-	void Clear()
+	constexpr void Clear()
 	{
 		x = y = z = 0;
 	}
 
-	void negative()
+	constexpr void negative()
 	{
 		this->x = -this->x;
 		this->y = -this->y;
@@ -78,127 +72,119 @@ public:
 		return l;
 	}
 
-	Vector normalized()
+	Vector normalized() const
 	{
 		Vector v(*this);
 		v.normalize();
 		return v;
 	}
 
-	Vector& operator =(const Vector& v)
-	{
-		x = v.x;
-		y = v.y;
-		z = v.z;
-
-		return *this;
-	}
-	Vector& operator +=(const Vector& v)
+	constexpr Vector& operator +=(const Vector& v)
 	{
 		x += v.x;
 		y += v.y;
 		z += v.z;
 		return *this;
 	}
-	Vector& operator -=(const Vector& v)
+	constexpr Vector& operator -=(const Vector& v)
 	{
 		x -= v.x;
 		y -= v.y;
 		z -= v.z;
 		return *this;
 	}
-	Vector& operator *=(float f)
+	constexpr Vector& operator *=(float f)
 	{
 		x *= f;
 		y *= f;
 		z *= f;
 		return *this;
 	}
-	Vector& operator /=(float f)
+	constexpr Vector& operator /=(float f)
 	{
 		x /= f;
 		y /= f;
 		z /= f;
 		return *this;
 	}
-	Vector operator -() const
+	constexpr Vector operator -() const
 	{
 		return Vector(-x, -y, -z);
 	}
 
-	bool operator==(const Vector& other) const
+	constexpr bool operator==(const Vector& other) const
 	{
 		return x == other.x && y == other.y && z == other.z;
 	}
 
-	bool operator!=(const Vector& other) const
+	constexpr bool operator!=(const Vector& other) const
 	{
 		return !(*this == other);
 	}
 };
 
-inline float dot(Vector v1, Vector v2)
+constexpr float dot(Vector v1, Vector v2)
 {
 	return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
 }
 
-inline Vector cross(Vector v1, Vector v2)
+constexpr Vector cross(Vector v1, Vector v2)
 {
 	return Vector(v1.y * v2.z - v1.z * v2.y,
 		v1.z * v2.x - v1.x * v2.z,
 		v1.x * v2.y - v1.y * v2.x);
 }
 
-inline Vector operator +(const Vector& v1, const Vector& v2)
+constexpr Vector operator +(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x + v2.x,
 		v1.y + v2.y,
 		v1.z + v2.z);
 }
 
-inline Vector operator -(const Vector& v1, const Vector& v2)
+constexpr Vector operator -(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x - v2.x,
 		v1.y - v2.y,
 		v1.z - v2.z);
 }
 
-inline Vector operator *(const Vector& v1, const Vector& v2)
+constexpr Vector operator *(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x * v2.x,
 		v1.y * v2.y,
 		v1.z * v2.z);
 }
 
-inline Vector operator *(const Vector& v, float f)
+constexpr Vector operator *(const Vector& v, float f)
 {
 	return Vector(v.x * f,
 		v.y * f,
 		v.z * f);
 }
 
-inline Vector operator *(float f, const Vector& v)
+constexpr Vector operator *(float f, const Vector& v)
 {
 	return Vector(f * v.x,
 		f * v.y,
 		f * v.z);
 }
 
-inline Vector operator /(const Vector& v1, const Vector& v2)
+constexpr Vector operator /(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x / v2.x,
 		v1.y / v2.y,
 		v1.z / v2.z);
 }
 
-inline Vector operator /(const Vector& v, float f)
+constexpr Vector operator /(const Vector& v, float f)
 {
 	return Vector(v.x / f,
 		v.y / f,
 		v.z / f);
 }
 
-inline Vector operator /(float f, const Vector& v)
+constexpr Vector operator /(float f, const Vector& v)
 {
 	return Vector(f / v.x,
 		f / v.y,
@@ -207,3 +193,6 @@ inline Vector operator /(float f, const Vector& v)
 
 typedef Vector Point;
 
+static_assert(sizeof(Vector) == 3 * sizeof(float), "Vector must stay three packed floats");
+static_assert(std::is_trivially_copyable<Vector>::value, "Vector must stay trivially copyable");
+
@@ -3,6 +3,8 @@
 
 #include "Math/Vector2.h"
 #include "Vector3.h"
+#include "Matrix33.h"
+#include "Matrix44.h"
 
 TEST_CASE("Testing Vector2 functionality")
 {
@@ -280,6 +282,23 @@ TEST_CASE("Testing Vector3 functionality")
 		/// Checks if the two vectors have non-identical components
 		CHECK(v2 != v0);
 	}
+
+	SUBCASE("Plain data")
+	{
+		/// Three packed floats without a vtable, copyable with memcpy
+		CHECK(sizeof(Vector) == 3 * sizeof(float));
+		CHECK(std::is_trivially_copyable<Vector>::value);
+
+		/// Arithmetic can be evaluated at compile time
+		constexpr Vector v0(1.0f, 2.0f, -3.0f);
+		constexpr Vector v1(2.0f, 3.0f, 4.0f);
+		constexpr Vector v2 = v0 + v1 * 2.0f;
+		static_assert(v2.x == 5.0f && v2.y == 8.0f && v2.z == 5.0f, "constexpr arithmetic");
+		static_assert(dot(v0, v1) == -4.0f, "constexpr dot product");
+		static_assert(cross(v0, v1) == Vector(17.0f, -10.0f, -1.0f), "constexpr cross product");
+		static_assert(v0.length2() == 14.0f, "constexpr squared length");
+		CHECK(v2 == Vector(5.0f, 8.0f, 5.0f));
+	}
 }
 
 
@@ -288,36 +307,147 @@ TEST_CASE("Testing Matrix33 functionality")
 	SUBCASE("Construction")
 	{
 		/// Construct a new matrix from explicit values
+		const Matrix33 m0(1.0f, 2.0f, 3.0f,
+			4.0f, 5.0f, 6.0f,
+			7.0f, 8.0f, 9.0f);
+		CHECK(m0.m[0][1] == 2.0f);
+		CHECK(m0.m[1][0] == 4.0f);
+		CHECK(m0.m[2][2] == 9.0f);
+
 		/// Construct a new identity matrix
+		const Matrix33 m1;
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+				CHECK(m1.m[row][column] == (row == column ? 1.0f : 0.0f));
+		}
 
 		/// Creates an identity matrix
+		CHECK(Matrix33::identity() == m1);
+
 		/// Creates a translation matrix
+		const Vector2 p0 = Matrix33::translation(Vector2(2.0f, -1.0f)).transform(Vector2(1.0f, 1.0f));
+		CHECK(p0.x == 3.0f);
+		CHECK(p0.y == 0.0f);
+
 		/// Creates a scale matrix
+		CHECK(Matrix33::scale(Vector(2.0f, 3.0f, 4.0f)).transform(Vector(1.0f, -1.0f, 0.5f)) == Vector(2.0f, -3.0f, 2.0f));
+
 		/// Creates a uniform scale matrix
+		CHECK(Matrix33::scale(3.0f).transform(Vector(1.0f, -1.0f, 0.5f)) == Vector(3.0f, -3.0f, 1.5f));
 
 		/// Creates a rotation matrix around an arbitrary axis (angle in radians)
+		const Vector v0 = Matrix33::rotation(Vector(1.0f, 1.0f, 1.0f), 2.0f * PI / 3.0f).transform(Vector(0.0f, 0.0f, 1.0f));
+		CHECK(v0.x == doctest::Approx(1.0f));
+		CHECK(v0.y == doctest::Approx(0.0f));
+		CHECK(v0.z == doctest::Approx(0.0f));
+
 		/// Creates a rotation matrix around the x axis (angle in radians)
+		const Vector v1 = Matrix33::rotationX(PI / 2.0f).transform(Vector(0.0f, 0.0f, 1.0f));
+		CHECK(v1.y == doctest::Approx(-1.0f));
+		CHECK(v1.z == doctest::Approx(0.0f));
+
 		/// Creates a rotation matrix around the y axis (angle in radians)
+		const Vector v2 = Matrix33::rotationY(PI / 2.0f).transform(Vector(1.0f, 0.0f, 0.0f));
+		CHECK(v2.x == doctest::Approx(0.0f));
+		CHECK(v2.z == doctest::Approx(-1.0f));
+
 		/// Creates a rotation matrix around the z axis (angle in radians)
+		const Vector v3 = Matrix33::rotationZ(PI / 2.0f).transform(Vector(0.0f, 1.0f, 0.0f));
+		CHECK(v3.x == doctest::Approx(-1.0f));
+		CHECK(v3.y == doctest::Approx(0.0f));
+
+		/// Same rotations as the 4x4 matrices
+		CHECK(Matrix33::rotation(Vector(1.0f, 2.0f, 3.0f), 0.4f) == Matrix44::rotation(Vector(1.0f, 2.0f, 3.0f), 0.4f).getOrientation());
 	}
 
 	SUBCASE("Mathematical operations")
 	{
+		const Matrix33 m0(1.0f, 2.0f, 3.0f,
+			0.0f, 1.0f, 4.0f,
+			5.0f, 6.0f, 0.0f);
+		const Matrix33 m1 = Matrix33::scale(2.0f);
+
 		/// Matrix addition
+		const Matrix33 m2 = m0 + m1;
+		CHECK(m2 == Matrix33(3.0f, 2.0f, 3.0f,
+			0.0f, 3.0f, 4.0f,
+			5.0f, 6.0f, 2.0f));
+
 		/// Matrix subtraction
+		CHECK(m2 - m1 == m0);
+
 		/// Matrix multiplication
+		CHECK(m0 * m1 == Matrix33(2.0f, 4.0f, 6.0f,
+			0.0f, 2.0f, 8.0f,
+			10.0f, 12.0f, 0.0f));
+		CHECK(m0 * Matrix33() == m0);
+		const Vector v0(1.0f, -2.0f, 0.5f);
+		const Vector v1 = (m0 * m1).transform(v0);
+		const Vector v2 = m0.transform(m1.transform(v0));
+		CHECK(v1 == v2);
+
+		/// Many vectors at once, including a remainder after the SIMD steps
+		Vector vectors[7];
+		Vector transformed[7];
+		for (int i = 0; i < 7; i++)
+			vectors[i] = Vector((float)i, 1.0f - i, 0.25f * i);
+		m0.transform(vectors, transformed, 7);
+		for (int i = 0; i < 7; i++)
+		{
+			Vector expected = m0.transform(vectors[i]);
+			CHECK(transformed[i].x == doctest::Approx(expected.x));
+			CHECK(transformed[i].y == doctest::Approx(expected.y));
+			CHECK(transformed[i].z == doctest::Approx(expected.z));
+		}
 
 		SUBCASE("Inversion")
 		{
 			/// Get the determinant of this matrix
+			CHECK(m0.determinant() == 1.0f);
+			CHECK(m1.determinant() == 8.0f);
+
 			/// Inverts this matrix
+			CHECK(m0.inverse() == Matrix33(-24.0f, 18.0f, 5.0f,
+				20.0f, -15.0f, -4.0f,
+				-5.0f, 4.0f, 1.0f));
+			const Matrix33 m3 = Matrix33::rotation(Vector(0.3f, -1.0f, 2.0f), 1.1f) * Matrix33::scale(Vector(1.0f, 2.0f, 0.5f));
+			const Matrix33 m4 = m3 * m3.inverse();
+			for (int row = 0; row < 3; row++)
+			{
+				for (int column = 0; column < 3; column++)
+					CHECK(m4.m[row][column] == doctest::Approx(row == column ? 1.0f : 0.0f));
+			}
+
 			/// Transposes this matrix
+			const Matrix33 m5 = m0.transposed();
+			CHECK(m5.m[0][2] == 5.0f);
+			CHECK(m5.m[2][0] == 3.0f);
+			CHECK(m5.transposed() == m0);
+
+			/// A rotation is inverted by its transpose
+			const Matrix33 m6 = Matrix33::rotation(Vector(1.0f, 1.0f, 0.0f), 0.8f);
+			const Matrix33 m7 = m6.inverse();
+			const Matrix33 m8 = m6.transposed();
+			for (int row = 0; row < 3; row++)
+			{
+				for (int column = 0; column < 3; column++)
+					CHECK(m7.m[row][column] == doctest::Approx(m8.m[row][column]));
+			}
 		}
 	}
 
+	const Matrix33 m0 = Matrix33::fromAxes(Vector(1.0f, 2.0f, 3.0f), Vector(4.0f, 5.0f, 6.0f), Vector(7.0f, 8.0f, 9.0f));
+
 	/// Get the x axis 
+	CHECK(m0.getXAxis() == Vector(1.0f, 2.0f, 3.0f));
+
 	/// Get the y axis 
+	CHECK(m0.getYAxis() == Vector(4.0f, 5.0f, 6.0f));
+
 	/// Get the z axis 
+	CHECK(m0.getZAxis() == Vector(7.0f, 8.0f, 9.0f));
+	CHECK(m0.transform(Vector(0.0f, 0.0f, 1.0f)) == m0.getZAxis());
 }
 
 TEST_CASE("Testing Matrix44 functionality")
@@ -325,49 +455,219 @@ TEST_CASE("Testing Matrix44 functionality")
 	SUBCASE("Construction")
 	{
 		/// Construct a new matrix from explicit values
+		const Matrix44 m0(1.0f, 2.0f, 3.0f, 4.0f,
+			5.0f, 6.0f, 7.0f, 8.0f,
+			9.0f, 10.0f, 11.0f, 12.0f,
+			13.0f, 14.0f, 15.0f, 16.0f);
+		CHECK(m0.m[0][1] == 2.0f);
+		CHECK(m0.m[1][0] == 5.0f);
+		CHECK(m0.m[3][3] == 16.0f);
+
 		/// Construct a new identity matrix
+		const Matrix44 m1;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+				CHECK(m1.m[row][column] == (row == column ? 1.0f : 0.0f));
+		}
 
 		/// Creates an identity matrix
+		CHECK(Matrix44::identity() == m1);
+
 		/// Creates a translation matrix
+		const Point p0(1.0f, -2.0f, 3.0f);
+		CHECK(Matrix44::translation(Vector(4.0f, 5.0f, 6.0f)).transform(p0) == Point(5.0f, 3.0f, 9.0f));
+
 		/// Creates a scale matrix
+		CHECK(Matrix44::scale(Vector(2.0f, 3.0f, 4.0f)).transform(p0) == Point(2.0f, -6.0f, 12.0f));
+
 		/// Creates a uniform scale matrix
+		CHECK(Matrix44::scale(2.0f).transform(p0) == Point(2.0f, -4.0f, 6.0f));
 
 		/// Creates a rotation matrix around an arbitrary axis (angle in radians)
+		const Vector axis = Vector(1.0f, 1.0f, 1.0f).normalized();
+		const Point p1 = Matrix44::rotation(axis, 2.0f * PI / 3.0f).transform(Point(1.0f, 0.0f, 0.0f));
+		CHECK(p1.x == doctest::Approx(0.0f));
+		CHECK(p1.y == doctest::Approx(1.0f));
+		CHECK(p1.z == doctest::Approx(0.0f));
+
 		/// Creates a rotation matrix around the x axis (angle in radians)
+		const Point p2 = Matrix44::rotationX(PI / 2.0f).transform(Point(0.0f, 1.0f, 0.0f));
+		CHECK(p2.y == doctest::Approx(0.0f));
+		CHECK(p2.z == doctest::Approx(1.0f));
+
 		/// Creates a rotation matrix around the y axis (angle in radians)
+		const Point p3 = Matrix44::rotationY(PI / 2.0f).transform(Point(0.0f, 0.0f, 1.0f));
+		CHECK(p3.x == doctest::Approx(1.0f));
+		CHECK(p3.z == doctest::Approx(0.0f));
+
 		/// Creates a rotation matrix around the z axis (angle in radians)
+		const Point p4 = Matrix44::rotationZ(PI / 2.0f).transform(Point(1.0f, 0.0f, 0.0f));
+		CHECK(p4.x == doctest::Approx(0.0f));
+		CHECK(p4.y == doctest::Approx(1.0f));
+
+		/// The axis versions agree with the arbitrary axis one
+		const Matrix44 m2 = Matrix44::rotation(Vector(0.0f, 1.0f, 0.0f), 0.7f);
+		const Matrix44 m3 = Matrix44::rotationY(0.7f);
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+				CHECK(m2.m[row][column] == doctest::Approx(m3.m[row][column]));
+		}
+
 		/// Creates an orthographic projection matrix
+		const Matrix44 m4 = Matrix44::orthographic(-2.0f, 2.0f, -1.0f, 1.0f, 1.0f, 11.0f);
+		CHECK(m4.project(Point(-2.0f, -1.0f, -1.0f)) == Point(-1.0f, -1.0f, -1.0f));
+		CHECK(m4.project(Point(2.0f, 1.0f, -11.0f)) == Point(1.0f, 1.0f, 1.0f));
+		CHECK(m4.project(Point(0.0f, 0.0f, -6.0f)) == Point(0.0f, 0.0f, 0.0f));
+
 		/// Creates a frustum projection matrix
+		const Matrix44 m5 = Matrix44::frustum(-1.0f, 1.0f, -0.5f, 0.5f, 1.0f, 100.0f);
+		const Point p5 = m5.project(Point(1.0f, 0.5f, -1.0f));
+		CHECK(p5.x == doctest::Approx(1.0f));
+		CHECK(p5.y == doctest::Approx(1.0f));
+		CHECK(p5.z == doctest::Approx(-1.0f));
+		const Point p6 = m5.project(Point(-50.0f, 25.0f, -100.0f));
+		CHECK(p6.x == doctest::Approx(-0.5f));
+		CHECK(p6.y == doctest::Approx(0.5f));
+		CHECK(p6.z == doctest::Approx(1.0f));
+
 		/// Creates a perspective projection matrix from camera settings
+		const Matrix44 m6 = Matrix44::perspective(PI / 2.0f, 2.0f, 1.0f, 100.0f);
+		const Matrix44 m7 = Matrix44::frustum(-2.0f, 2.0f, -1.0f, 1.0f, 1.0f, 100.0f);
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+				CHECK(m6.m[row][column] == doctest::Approx(m7.m[row][column]));
+		}
+
 		/// Creates a look at matrix, usually a view matrix  
+		const Matrix44 m8 = Matrix44::lookAt(Point(1.0f, 2.0f, 3.0f), Point(1.0f, 2.0f, -7.0f), Vector(0.0f, 1.0f, 0.0f));
+		CHECK(m8.transform(Point(1.0f, 2.0f, 3.0f)) == Point(0.0f, 0.0f, 0.0f));
+		CHECK(m8.transform(Point(1.0f, 2.0f, -7.0f)) == Point(0.0f, 0.0f, -10.0f));
+		CHECK(m8.transform(Point(2.0f, 4.0f, 3.0f)) == Point(1.0f, 2.0f, 0.0f));
+		const Matrix44 m9 = Matrix44::lookAt(Point(0.0f, 0.0f, 0.0f), Point(5.0f, 0.0f, 0.0f), Vector(0.0f, 1.0f, 0.0f));
+		const Point p9 = m9.transform(Point(5.0f, 0.0f, 1.0f));
+		CHECK(p9.x == doctest::Approx(1.0f));
+		CHECK(p9.y == doctest::Approx(0.0f));
+		CHECK(p9.z == doctest::Approx(-5.0f));
 	}
 
 	SUBCASE("Mathematical operations")
 	{
 		/// Matrix addition
+		const Matrix44 m4 = Matrix44::translation(Vector(1.0f, 2.0f, 3.0f));
+		const Matrix44 m5 = m4 + Matrix44::scale(2.0f);
+		CHECK(m5 == Matrix44(3.0f, 0.0f, 0.0f, 1.0f,
+			0.0f, 3.0f, 0.0f, 2.0f,
+			0.0f, 0.0f, 3.0f, 3.0f,
+			0.0f, 0.0f, 0.0f, 2.0f));
+
 		/// Matrix subtraction
-		/// Matrix multiplication
+		CHECK(m5 - Matrix44::scale(2.0f) == m4);
+		CHECK(m4 - m4 == Matrix44(0.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 0.0f));
+
+		/// Matrix multiplication, the right hand side applies first
+		const Matrix44 m0 = Matrix44::translation(Vector(1.0f, 0.0f, 0.0f)) * Matrix44::scale(2.0f);
+		CHECK(m0.transform(Point(1.0f, 1.0f, 1.0f)) == Point(3.0f, 2.0f, 2.0f));
+		CHECK(m0 * Matrix44() == m0);
 
 		SUBCASE("Inversion")
 		{
+			const Matrix44 m1 = Matrix44::translation(Vector(3.0f, -1.0f, 2.0f))
+				* Matrix44::rotation(Vector(1.0f, 2.0f, 3.0f), 0.9f)
+				* Matrix44::scale(Vector(2.0f, 0.5f, 4.0f));
+
 			/// Get the determinant of this matrix
+			CHECK(Matrix44::scale(Vector(2.0f, 3.0f, 4.0f)).determinant() == 24.0f);
+			CHECK(m1.determinant() == doctest::Approx(4.0f));
+
 			/// Inverts this matrix
+			const Matrix44 m2 = m1 * m1.inverse();
+			for (int row = 0; row < 4; row++)
+			{
+				for (int column = 0; column < 4; column++)
+					CHECK(m2.m[row][column] == doctest::Approx(row == column ? 1.0f : 0.0f));
+			}
+			const Point p0 = m1.inverse().transform(m1.transform(Point(0.5f, -7.0f, 2.0f)));
+			CHECK(p0.x == doctest::Approx(0.5f));
+			CHECK(p0.y == doctest::Approx(-7.0f));
+			CHECK(p0.z == doctest::Approx(2.0f));
+
 			/// Transposes this matrix
+			const Matrix44 m3 = m1.transposed();
+			CHECK(m3.m[0][3] == m1.m[3][0]);
+			CHECK(m3.m[2][1] == m1.m[1][2]);
+			CHECK(m3.transposed() == m1);
 		}
 	}
 
 	SUBCASE("Transformation")
 	{
+		const Matrix44 m0 = Matrix44::translation(Vector(1.0f, 2.0f, 3.0f)) * Matrix44::scale(2.0f);
+
 		/// Transform the given vector by this matrix.
+		CHECK(m0.transform(Point(1.0f, 1.0f, 1.0f)) == Point(3.0f, 4.0f, 5.0f));
+
 		/// Transform the direction vector of this matrix
+		CHECK(m0.transformDirection(Vector(1.0f, 1.0f, 1.0f)) == Vector(2.0f, 2.0f, 2.0f));
+
+		/// Many points and directions at once, including a remainder after
+		/// the SIMD steps, and in place
+		const Matrix44 m1 = Matrix44::translation(Vector(-1.0f, 0.5f, 2.0f)) * Matrix44::rotation(Vector(1.0f, -2.0f, 0.5f), 0.6f);
+		Point points[11];
+		Point transformed[11];
+		Vector directions[11];
+		for (int i = 0; i < 11; i++)
+		{
+			points[i] = Point(0.5f * i, 2.0f - i, 1.0f + 0.25f * i);
+			directions[i] = Vector(1.0f, -0.5f * i, 0.1f * i);
+		}
+		m1.transform(points, transformed, 11);
+		m1.transformDirections(directions, directions, 11);
+		for (int i = 0; i < 11; i++)
+		{
+			Point expected = m1.transform(points[i]);
+			CHECK(transformed[i].x == doctest::Approx(expected.x));
+			CHECK(transformed[i].y == doctest::Approx(expected.y));
+			CHECK(transformed[i].z == doctest::Approx(expected.z));
+
+			Vector direction = m1.transformDirection(Vector(1.0f, -0.5f * i, 0.1f * i));
+			CHECK(directions[i].x == doctest::Approx(direction.x));
+			CHECK(directions[i].y == doctest::Approx(direction.y));
+			CHECK(directions[i].z == doctest::Approx(direction.z));
+		}
 	}
 
 	/// Retrieve translation part of the matrix
+	CHECK(Matrix44::translation(Vector(1.0f, 2.0f, 3.0f)).getTranslation() == Vector(1.0f, 2.0f, 3.0f));
+
 	/// Set the translation of the matrix
+	Matrix44 m0 = Matrix44::rotationZ(0.3f);
+	m0.setTranslation(Vector(4.0f, 5.0f, 6.0f));
+	CHECK(m0.getTranslation() == Vector(4.0f, 5.0f, 6.0f));
+	CHECK(m0.transform(Point(0.0f, 0.0f, 0.0f)) == Point(4.0f, 5.0f, 6.0f));
+
 	/// Get the x orientation axis 
+	const Matrix44 m1 = Matrix44::rotationZ(PI / 2.0f);
+	CHECK(m1.getXAxis().x == doctest::Approx(0.0f));
+	CHECK(m1.getXAxis().y == doctest::Approx(1.0f));
+
 	/// Get the y orientation axis 
+	CHECK(m1.getYAxis().x == doctest::Approx(-1.0f));
+	CHECK(m1.getYAxis().y == doctest::Approx(0.0f));
+
 	/// Get the z orientation axis 
+	CHECK(m1.getZAxis() == Vector(0.0f, 0.0f, 1.0f));
 
 	/// Sets the orientation of the matrix to the orthogonal basis vector
+	m0.setOrientation(Vector(0.0f, 0.0f, -1.0f), Vector(0.0f, 1.0f, 0.0f), Vector(1.0f, 0.0f, 0.0f));
+	CHECK(m0.getXAxis() == Vector(0.0f, 0.0f, -1.0f));
+	CHECK(m0.getTranslation() == Vector(4.0f, 5.0f, 6.0f));
+	CHECK(m0.transformDirection(Vector(1.0f, 0.0f, 0.0f)) == Vector(0.0f, 0.0f, -1.0f));
+	CHECK(Matrix44(m0.getOrientation(), m0.getTranslation()) == m0);
 }
 